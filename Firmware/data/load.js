@@ -152,8 +152,68 @@ class API {
   }
 }
 
+class Telemetry {
+  static MSG_MEASUREMENT = 1;
+  static MSG_STATE = 2;
+
+  static FIELD_SET_CURRENT = 4;
+  static FIELD_FAN_SPEED = 7;
+
+  reconnectInterval = 2000;
+
+  constructor(url, rateHz, measurementHandler, stateHandler) {
+    this.url = url;
+    this.rateHz = rateHz;
+    this.measurementHandler = measurementHandler;
+    this.stateHandler = stateHandler;
+
+    this.connect();
+  }
+
+  connect() {
+    let that = this;
+
+    this.ws = new WebSocket(this.url);
+    this.ws.binaryType = "arraybuffer";
+
+    this.ws.onopen = function() {
+      console.info(`Telemetry connected: ${that.url}`);
+      that.ws.send(`rate ${that.rateHz}`);
+    }
+
+    this.ws.onmessage = function(event) {
+      that._handleMessage(new DataView(event.data));
+    }
+
+    this.ws.onclose = function() {
+      setTimeout(() => that.connect(), that.reconnectInterval);
+    }
+  }
+
+  _handleMessage(view) {
+    const type = view.getUint8(0);
+    if (type == Telemetry.MSG_MEASUREMENT) {
+      this.measurementHandler({
+        seq: view.getUint32(4, true),
+        timestampMicros: view.getBigUint64(8, true),
+        voltage: view.getFloat32(16, true),
+        current: view.getFloat32(20, true),
+        power: view.getFloat32(24, true),
+        temperature: view.getFloat32(28, true)
+      });
+
+    } else if (type == Telemetry.MSG_STATE) {
+      const nrFields = view.getUint8(1);
+      for (let idx = 0; idx < nrFields; idx++) {
+        const offset = 2 + idx * 5;
+        this.stateHandler(view.getUint8(offset), view.getFloat32(offset + 1, true));
+      }
+    }
+  }
+}
+
 class App {
-  updateInterval = 1000;
+  telemetryRateHz = 10;
 
   constructor(baseUrl) {
     if (baseUrl == undefined) {
@@ -167,32 +227,27 @@ class App {
     this.ui = new UI((what, value) => that.setHandler(what, value));
     this.api = new API(baseUrl);
 
-    this.scheduleUpdate();
+    // pushed measurements and state changes (instead of polling)
+    const telemetryUrl = baseUrl.replace(/^http/, "ws").replace(/\/api$/, "") + "/ws";
+    this.telemetry = new Telemetry(telemetryUrl, this.telemetryRateHz,
+      (measurement) => that.updateMeasurement(measurement),
+      (field, value) => that.updateState(field, value));
   }
 
-  scheduleUpdate() {
-    let that = this;
-    setTimeout(() => that.update(that), this.updateInterval);
+  updateMeasurement(measurement) {
+    this.ui.setVoltage(measurement.voltage);
+    this.ui.setCurrent(measurement.current);
+    this.ui.setPower(measurement.power);
+    this.ui.setTemperature(measurement.temperature);
   }
 
-  async update() {
-    // voltage
-    const voltage = await this.api.getVoltage();
-    this.ui.setVoltage(voltage);
-
-    // current
-    const current = await this.api.getCurrent();
-    this.ui.setCurrent(current);
+  updateState(field, value) {
+    if (field == Telemetry.FIELD_SET_CURRENT) {
+      this.ui.setSetCurrent(value);
 
-    // power
-    const power = voltage * current;
-    this.ui.setPower(power);
-
-    // temperature
-    const temperature = await this.api.getTemperature();
-    this.ui.setTemperature(temperature);
-
-    this.scheduleUpdate();
+    } else if (field == Telemetry.FIELD_FAN_SPEED) {
+      this.ui.setFanSpeed(value * 100.0);
+    }
   }
 
   async setCurrent(current) {
@@ -0,0 +1,104 @@
+#
+# Copyright (c) 2025 by Attila Tőkés.
+#
+# Licence: MIT
+#
+# PlatformIO pre-build script: gzips the web UI files from data/ and embeds them into
+# the firmware image (include/static_assets.h), served straight from flash by web.h.
+#
+# The header is only rewritten when the content changes (no needless rebuilds).
+#
+
+import gzip
+import hashlib
+import os
+
+Import("env")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "text/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+}
+
+HEADER_PREFIX = """/*
+ * Web UI files, gzipped (generated by scripts/embed_assets.py from data/, do not edit).
+ */
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+
+/** An embedded (gzipped) static file */
+struct StaticAsset {
+  const char *path;
+  const char *contentType;
+  const uint8_t *data;
+  size_t len;
+  const char *etag;
+};
+
+"""
+
+
+def c_identifier(name):
+    return "ASSET_" + "".join(c if c.isalnum() else "_" for c in name).upper()
+
+
+def c_bytes(data):
+    lines = []
+    for idx in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[idx:idx + 16]) + ",")
+    return "\n".join(lines)
+
+
+def generate(data_dir):
+    arrays = []
+    entries = []
+
+    for name in sorted(os.listdir(data_dir)):
+        path = os.path.join(data_dir, name)
+        extension = os.path.splitext(name)[1].lower()
+        if not os.path.isfile(path) or extension not in CONTENT_TYPES:
+            continue
+
+        with open(path, "rb") as file:
+            content = file.read()
+
+        # mtime=0: reproducible output (stable ETag)
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha256(compressed).hexdigest()[:16]
+        identifier = c_identifier(name)
+
+        print("Embedding %s: %d -> %d bytes (gzip)" % (name, len(content), len(compressed)))
+
+        arrays.append("static const uint8_t %s[%d] = {\n%s\n};\n" % (identifier, len(compressed), c_bytes(compressed)))
+
+        paths = ["/" + name] + (["/"] if name == "index.html" else [])
+        for url in paths:
+            entries.append('  { "%s", "%s", %s, sizeof(%s), "%s" },' % (
+                url, CONTENT_TYPES[extension], identifier, identifier, etag.replace('"', '\\"')))
+
+    return (HEADER_PREFIX + "\n".join(arrays) +
+            "\nstatic const StaticAsset STATIC_ASSETS[] = {\n" + "\n".join(entries) + "\n};\n\n" +
+            "static const size_t NR_STATIC_ASSETS = sizeof(STATIC_ASSETS) / sizeof(STATIC_ASSETS[0]);\n\n" +
+            "#endif\n")
+
+
+data_dir = env.subst("$PROJECT_DATA_DIR")
+header_path = os.path.join(env.subst("$PROJECT_INCLUDE_DIR"), "static_assets.h")
+
+header = generate(data_dir)
+
+existing = None
+if os.path.exists(header_path):
+    with open(header_path, "r") as file:
+        existing = file.read()
+
+if header != existing:
+    with open(header_path, "w") as file:
+        file.write(header)
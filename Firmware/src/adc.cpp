@@ -8,16 +8,21 @@ const uint8_t LED_PIN = 21;
 //#define DEBUG_CONTINUOUS_ADC_LED_PIN 1
 
 /** Continuous ADC result interrupt handler */
-void ARDUINO_ISR_ATTR adcComplete() {
+bool ARDUINO_ISR_ATTR adcComplete(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *userData) {
 
 #ifdef DEBUG_CONTINUOUS_ADC_LED_PIN
   GPIO.out_w1tc = ((uint32_t) 1 << LED_PIN);
 #endif
 
-  ADC::instance->readContinuousValues();
+  // decode the DMA frame in place (and check the fast protection)
+  ADC::instance->decodeFrame(edata->conv_frame_buffer, edata->size);
+
+  // wake up the control loop (also handles the fast protection trips)
+  bool taskWoken = ADC::instance->notifyFrame();
 
 #ifdef DEBUG_CONTINUOUS_ADC_LED_PIN
   GPIO.out_w1ts = ((uint32_t) 1 << LED_PIN);
 #endif
 
+  return taskWoken;
 }
\ No newline at end of file
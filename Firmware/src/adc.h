@@ -8,6 +8,14 @@
 #ifndef ADC_H
 #define ADC_H
 
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "samples.h"
+#include "stats.h"
+#include "protect.h"
+
 /**
  * Continuous ADC parameters:
  *   - frequency: 83.333 kHz (max, overall for all pins)
@@ -17,8 +25,37 @@
 const uint8_t ADC_CONTINUOUS_CONVERSIONS_PER_PIN = 4;
 const uint32_t ADC_CONTINUOUS_FREQ = 83333; // max freq
 
-/** Continuous ADC callback */
-void ARDUINO_ISR_ATTR adcComplete();
+/**
+ * DMA output format:
+ *   - ESP32-S2: type 1 (2 bytes per conversion), ADC1 only
+ *   - ESP32-S3: type 2 (4 bytes per conversion)
+ */
+#if defined ESP32_S2
+#define ADC_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define ADC_GET_CHANNEL(p_data) ((p_data)->type1.channel)
+#define ADC_GET_DATA(p_data) ((p_data)->type1.data)
+#else // S3
+#define ADC_OUTPUT_FORMAT ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define ADC_GET_CHANNEL(p_data) ((p_data)->type2.channel)
+#define ADC_GET_DATA(p_data) ((p_data)->type2.data)
+#endif
+
+/**
+ * Raw code shift applied before the eFuse calibration.
+ *
+ * The ESP32-S2 line fitting scheme is characterized for 13-bit codes, while the DMA
+ * delivers 12-bit codes (this was the "2x multiplier" needed on the S2 before).
+ */
+#if defined ESP32_S2
+const uint8_t ADC_CALI_RAW_SHIFT = 1;
+const adc_bitwidth_t ADC_CALI_BITWIDTH = ADC_BITWIDTH_13;
+#else // S3
+const uint8_t ADC_CALI_RAW_SHIFT = 0;
+const adc_bitwidth_t ADC_CALI_BITWIDTH = ADC_BITWIDTH_12;
+#endif
+
+/** Continuous ADC conversion done callback (called from ISR) */
+bool ARDUINO_ISR_ATTR adcComplete(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *userData);
 
 /** Analog to Digital Converter (ADC) implemented on the ESP32-S3 chip. */
 class ADC {
@@ -27,20 +64,26 @@ public:
 
   const uint8_t nrChannels;
   const uint8_t *pins;
-  uint16_t *values;
-  uint64_t lastReadTimeMicros = 0;
 
-  adc_continuous_data_t *result = NULL;
+  /** Sample history (written by the continuous ADC callback, raw 12-bit codes) */
+  SampleBuffer samples;
+
+  /** DMA frame decode time statistics (in CPU cycles) */
+  RunningStats decodeCycles;
 
   static ADC *instance;
 
+  /** Task notified on each new frame (optional) */
+  TaskHandle_t notifyTask = NULL;
+
+  /** Fast protection checked on each new frame (optional) */
+  FastProtection *protection = NULL;
+
   ADC(const uint8_t nrChannels, const uint8_t *pins)
     : nrChannels(nrChannels), pins(pins) {
 
     instance = this;
 
-    this->values = new uint16_t[nrChannels];
-
     // Synchonous read mode (disabled)
     // analogReadResolution(12);
     // analogSetAttenuation(ADC_11db);
@@ -48,18 +91,21 @@ public:
 
   /** Initialize and start ADC reads */
   void begin() {
+    if (!this->samples.isAllocated()) {
+      Serial.println("Sample buffer allocation ERROR!");
+      return;
+    }
+
     // init continuous ADC reads
     Serial.println("Setting up continuous ADC reads...");
-    analogContinuousSetWidth(12);
-    analogContinuousSetAtten(ADC_11db);
-    if (!analogContinuous(pins, nrChannels, ADC_CONTINUOUS_CONVERSIONS_PER_PIN, ADC_CONTINUOUS_FREQ, &adcComplete)) {
+    if (!this->setupContinuous()) {
       Serial.println("Continuous ADC setup ERROR!");
       return;
     };
 
     // start continuous ADC reads
     Serial.println("Starting continuous ADC reads...");
-    if (!analogContinuousStart()) {
+    if (adc_continuous_start(this->adcHandle) != ESP_OK) {
       Serial.println("Continuous ADC start ERROR!");
       return;
     }
@@ -67,37 +113,84 @@ public:
 
   void pause() {
     Serial.print("P!");
-    if (!analogContinuousStop()) {
+    if (adc_continuous_stop(this->adcHandle) != ESP_OK) {
       Serial.println("Continuous ADC stop (pause) ERROR!");
     }
   }
 
   void resume() {
     Serial.print("R!");
-    if (!analogContinuousStart()) {
+    if (adc_continuous_start(this->adcHandle) != ESP_OK) {
       Serial.println("Continuous ADC restart ERROR!");
     }
   }
 
-  /** Consumes the continuous ADC read values (called by the continuous ADC callback) */
-  void readContinuousValues() {
-    // note: analogContinuousRead() takes ~10us, which is bit slow
-    if (!analogContinuousRead(&result, 0)) {
-      Serial.println("Continuous ADC read ERROR!");
-      return;
+  /**
+   * Decodes a DMA conversion frame in place (called by the continuous ADC callback).
+   *
+   * The raw conversion results are demultiplexed by channel id and summed into per channel
+   * accumulators. Only the averaged raw codes are published, the conversion to millivolts
+   * is done by the consumers. The fast protection is checked before publishing.
+   */
+  void ARDUINO_ISR_ATTR decodeFrame(const uint8_t *buffer, uint32_t size) {
+    // 64-bit time since boot (micros() wraps after ~71.6 minutes)
+    uint64_t timestampMicros = esp_timer_get_time();
+    uint32_t startCycles = esp_cpu_get_cycle_count();
+
+    uint32_t sums[SOC_ADC_MAX_CHANNEL_NUM] = { 0 };
+    uint8_t counts[SOC_ADC_MAX_CHANNEL_NUM] = { 0 };
+
+    const adc_digi_output_data_t *data = (const adc_digi_output_data_t *) buffer;
+    const adc_digi_output_data_t *end = (const adc_digi_output_data_t *) (buffer + size);
+    for (; data < end; data++) {
+      uint32_t chan = ADC_GET_CHANNEL(data);
+      if (chan < SOC_ADC_MAX_CHANNEL_NUM) {
+        sums[chan] += ADC_GET_DATA(data);
+        counts[chan]++;
+      }
+    }
+
+    // average per pin
+    uint16_t values[SAMPLE_MAX_CHANNELS];
+    for (uint8_t idx = 0; idx < this->nrChannels; idx++) {
+      uint8_t chan = this->channels[idx];
+      values[idx] = counts[chan] > 0 ? sums[chan] / counts[chan] : 0;
+    }
+
+    // decode time only (without the protection check and the publishing)
+    this->decodeCycles.add(esp_cpu_get_cycle_count() - startCycles);
+
+    // check the fast protection
+    if (this->protection != NULL) {
+      this->protection->check(values, this->nrChannels, timestampMicros);
     }
 
-    // save the avg ADC value
-    for (int chan = 0; chan < this->nrChannels; chan++) {
-      #ifdef ESP32_S2
-      // why the 2x multiplier is needed?
-      this->values[chan] = 2 * result[chan].avg_read_mvolts;
-      #else // S3
-      this->values[chan] = result[chan].avg_read_mvolts;
-      #endif
+    // publish the frame
+    this->samples.push(values, this->nrChannels, timestampMicros);
+  }
+
+  /** Notify the waiting task about a new frame (called by the continuous ADC callback). Returns true if a higher priority task was woken. */
+  bool ARDUINO_ISR_ATTR notifyFrame() {
+    BaseType_t taskWoken = pdFALSE;
+    if (this->notifyTask != NULL) {
+      vTaskNotifyGiveFromISR(this->notifyTask, &taskWoken);
     }
+    return taskWoken == pdTRUE;
+  }
+
+  /** Set the fast protection to be checked on each new frame */
+  void setProtection(FastProtection *protection) {
+    this->protection = protection;
+  }
+
+  /** Set the task to be notified on each new frame (direct-to-task notification) */
+  void setNotifyTask(TaskHandle_t task) {
+    this->notifyTask = task;
+  }
 
-    this->lastReadTimeMicros = micros();
+  /** Time between two frames (in microseconds) */
+  uint32_t getFramePeriodMicros() {
+    return (uint64_t) 1000000 * ADC_CONTINUOUS_CONVERSIONS_PER_PIN * this->nrChannels / ADC_CONTINUOUS_FREQ;
   }
 
   void handle() {
@@ -105,19 +198,116 @@ public:
 
     // Synchonous read mode (disabled)
     // for (uint8_t chan = 0; chan < this->nrChannels; chan++) {
-    //   this->values[chan] = analogRead(this->pins[chan]);
-    //   this->values[chan] = analogReadRaw(this->pins[chan]);
-    //   this->values[chan] = result[chan].avg_read_mvolts;
+    //   values[chan] = analogRead(this->pins[chan]);
+    //   values[chan] = analogReadRaw(this->pins[chan]);
     // }
   }
 
-  /** Get the ADC value for a given channel (in millivolts) */
-  uint16_t getMilliVolts(uint8_t chan) {
-    // note: values currently are in millivolts
-    return this->values[chan];
+  /** Get the latest raw ADC code for a given channel */
+  uint16_t getRaw(uint8_t chan) {
+    SampleFrame frame;
+    if (!this->samples.readLatest(frame)) {
+      // no data yet
+      return 0;
+    }
+
+    return frame.values[chan];
+  }
+
+  /** Initialize the eFuse based calibration (optional, falls back to an ideal ADC) */
+  void initCalibration() {
+    if (this->caliHandle != NULL) {
+      // already initialized
+      return;
+    }
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t caliConfig = {};
+    caliConfig.unit_id = ADC_UNIT_1;
+    caliConfig.atten = ADC_ATTEN_DB_11;
+    caliConfig.bitwidth = ADC_CALI_BITWIDTH;
+    if (adc_cali_create_scheme_curve_fitting(&caliConfig, &this->caliHandle) != ESP_OK) {
+      Serial.println("ADC calibration not available!");
+      this->caliHandle = NULL;
+    }
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    adc_cali_line_fitting_config_t caliConfig = {};
+    caliConfig.unit_id = ADC_UNIT_1;
+    caliConfig.atten = ADC_ATTEN_DB_11;
+    caliConfig.bitwidth = ADC_CALI_BITWIDTH;
+    if (adc_cali_create_scheme_line_fitting(&caliConfig, &this->caliHandle) != ESP_OK) {
+      Serial.println("ADC calibration not available!");
+      this->caliHandle = NULL;
+    }
+#endif
+  }
+
+  /** Convert a raw ADC code to millivolts (using the eFuse calibration of the chip, slow) */
+  uint16_t toMilliVolts(uint16_t raw) {
+    int milliVolts = 0;
+    if ((this->caliHandle == NULL) || (adc_cali_raw_to_voltage(this->caliHandle, raw << ADC_CALI_RAW_SHIFT, &milliVolts) != ESP_OK)) {
+      // no calibration, assume ideal 12-bit ADC with ~3.1V full scale
+      return (uint32_t) raw * 3100 / 4095;
+    }
+
+    return milliVolts;
   }
 
 private:
+  adc_continuous_handle_t adcHandle = NULL;
+  adc_cali_handle_t caliHandle = NULL;
+
+  /** ADC channel ids of the pins */
+  uint8_t channels[SAMPLE_MAX_CHANNELS];
+
+  /** Setup the continuous ADC driver */
+  bool setupContinuous() {
+    if ((this->nrChannels > SAMPLE_MAX_CHANNELS) || (this->nrChannels > SOC_ADC_PATT_LEN_MAX)) {
+      return false;
+    }
+
+    adc_continuous_handle_cfg_t handleConfig = {};
+    handleConfig.conv_frame_size = ADC_CONTINUOUS_CONVERSIONS_PER_PIN * this->nrChannels * SOC_ADC_DIGI_RESULT_BYTES;
+    handleConfig.max_store_buf_size = 2 * handleConfig.conv_frame_size;
+    if (adc_continuous_new_handle(&handleConfig, &this->adcHandle) != ESP_OK) {
+      return false;
+    }
+
+    adc_digi_pattern_config_t patterns[SOC_ADC_PATT_LEN_MAX] = {};
+    for (uint8_t idx = 0; idx < this->nrChannels; idx++) {
+      adc_unit_t unit;
+      adc_channel_t channel;
+      if ((adc_continuous_io_to_channel(this->pins[idx], &unit, &channel) != ESP_OK) || (unit != ADC_UNIT_1)) {
+        // only ADC1 pins are supported
+        return false;
+      }
+
+      this->channels[idx] = channel;
+
+      patterns[idx].atten = ADC_ATTEN_DB_11;
+      patterns[idx].channel = channel;
+      patterns[idx].unit = ADC_UNIT_1;
+      patterns[idx].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_continuous_config_t config = {};
+    config.pattern_num = this->nrChannels;
+    config.adc_pattern = patterns;
+    config.sample_freq_hz = ADC_CONTINUOUS_FREQ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_OUTPUT_FORMAT;
+    if (adc_continuous_config(this->adcHandle, &config) != ESP_OK) {
+      return false;
+    }
+
+    adc_continuous_evt_cbs_t callbacks = {};
+    callbacks.on_conv_done = &adcComplete;
+    if (adc_continuous_register_event_callbacks(this->adcHandle, &callbacks, this) != ESP_OK) {
+      return false;
+    }
+
+    return true;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef BODY_H
+#define BODY_H
+
+#include <Arduino.h>
+
+/** Max. length of the plain text request bodies */
+const size_t BODY_MAX_LENGTH = 255;
+
+/**
+ * Plain text request body (or a field of it), parsed in place.
+ *
+ * A view of the request data (not terminated, no copy): numbers and enum names are
+ * parsed straight from the received bytes. Surrounding white space is ignored.
+ */
+class BodyField {
+
+public:
+
+  BodyField()
+    : data(NULL), len(0) {
+  }
+
+  BodyField(const char *data, size_t len)
+    : data(data), len(len) {
+      this->trim();
+  }
+
+  /** Body of a request (invalid if chunked, or longer than BODY_MAX_LENGTH) */
+  static BodyField of(const uint8_t *data, size_t len, size_t index, size_t total) {
+    if ((index != 0) || (len >= BODY_MAX_LENGTH) || (len != total)) {
+      return BodyField();
+    }
+
+    return BodyField((const char*) data, len);
+  }
+
+  bool isEmpty() const {
+    return this->len == 0;
+  }
+
+  /** Equals the given name, ignoring the case */
+  bool equals(const char *name) const {
+    size_t idx = 0;
+    for (; (idx < this->len) && (name[idx] != '\0'); idx++) {
+      if (toupper((unsigned char) this->data[idx]) != toupper((unsigned char) name[idx])) {
+        return false;
+      }
+    }
+    return (idx == this->len) && (name[idx] == '\0');
+  }
+
+  /** Index of the first occurrence of a character (-1 if not found) */
+  int indexOf(char c) const {
+    const char *p = (const char*) memchr(this->data, c, this->len);
+    return p != NULL ? p - this->data : -1;
+  }
+
+  /** Field before / after the given index */
+  BodyField left(size_t idx) const {
+    return BodyField(this->data, min(idx, this->len));
+  }
+
+  BodyField right(size_t idx) const {
+    return idx < this->len ? BodyField(this->data + idx, this->len - idx) : BodyField();
+  }
+
+  /** Split into separated fields (the ones above maxFields are ignored). Returns the number of fields. */
+  uint8_t split(char separator, BodyField *fields, uint8_t maxFields) const {
+    if (this->isEmpty()) {
+      return 0;
+    }
+
+    uint8_t nrFields = 0;
+    BodyField rest = *this;
+    while (nrFields < maxFields) {
+      int separatorIdx = rest.indexOf(separator);
+      if (separatorIdx == -1) {
+        fields[nrFields++] = rest;
+        break;
+      }
+
+      fields[nrFields++] = rest.left(separatorIdx);
+      rest = BodyField(rest.data + separatorIdx + 1, rest.len - separatorIdx - 1);
+    }
+
+    return nrFields;
+  }
+
+  /** Parse an unsigned integer (the whole field). Returns false if not a number. */
+  bool toUint(uint32_t &value) const {
+    if (this->isEmpty() || (this->len > 10)) {
+      return false;
+    }
+
+    uint64_t result = 0;
+    for (size_t idx = 0; idx < this->len; idx++) {
+      if (!isdigit((unsigned char) this->data[idx])) {
+        return false;
+      }
+      result = result * 10 + (this->data[idx] - '0');
+    }
+
+    if (result > 0xFFFFFFFF) {
+      return false;
+    }
+
+    value = result;
+    return true;
+  }
+
+  /** Parse a decimal number: [-+]digits[.digits][e[-+]digits] (the whole field). Returns false if not a number. */
+  bool toFloat(float &value) const {
+    size_t idx = 0;
+    bool negative = false;
+    if ((idx < this->len) && ((this->data[idx] == '-') || (this->data[idx] == '+'))) {
+      negative = this->data[idx] == '-';
+      idx++;
+    }
+
+    // mantissa (up to 18 significant digits, the rest only scales)
+    uint64_t mantissa = 0;
+    int32_t exponent = 0;
+    uint8_t nrDigits = 0;
+    bool fraction = false;
+    bool anyDigit = false;
+    for (; idx < this->len; idx++) {
+      char c = this->data[idx];
+      if ((c == '.') && !fraction) {
+        fraction = true;
+        continue;
+      }
+      if (!isdigit((unsigned char) c)) {
+        break;
+      }
+
+      anyDigit = true;
+      if (nrDigits < 18) {
+        mantissa = mantissa * 10 + (c - '0');
+        nrDigits += mantissa > 0 ? 1 : 0;
+        exponent -= fraction ? 1 : 0;
+      } else {
+        exponent += fraction ? 0 : 1;
+      }
+    }
+
+    if (!anyDigit) {
+      return false;
+    }
+
+    if ((idx < this->len) && ((this->data[idx] == 'e') || (this->data[idx] == 'E'))) {
+      uint32_t exponentValue = 0;
+      bool negativeExponent = false;
+      idx++;
+      if ((idx < this->len) && ((this->data[idx] == '-') || (this->data[idx] == '+'))) {
+        negativeExponent = this->data[idx] == '-';
+        idx++;
+      }
+      if (!BodyField(this->data + idx, this->len - idx).toUint(exponentValue) || (exponentValue > 60)) {
+        return false;
+      }
+      exponent += negativeExponent ? -(int32_t) exponentValue : (int32_t) exponentValue;
+      idx = this->len;
+    }
+
+    if (idx != this->len) {
+      return false;
+    }
+
+    double result = mantissa;
+    for (; exponent > 0; exponent--) {
+      result *= 10.0;
+    }
+    for (; exponent < 0; exponent++) {
+      result /= 10.0;
+    }
+
+    value = negative ? -result : result;
+    return true;
+  }
+
+private:
+  const char *data;
+  size_t len;
+
+  void trim() {
+    while ((this->len > 0) && isspace((unsigned char) this->data[0])) {
+      this->data++;
+      this->len--;
+    }
+    while ((this->len > 0) && isspace((unsigned char) this->data[this->len - 1])) {
+      this->len--;
+    }
+  }
+};
+
+#endif
\ No newline at end of file
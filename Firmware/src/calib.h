@@ -8,6 +8,8 @@
 #ifndef CALIB_H
 #define CALIB_H
 
+#include "esp_heap_caps.h"
+
 /** Software calibration for sensor values */
 class Calibration {
 
@@ -60,4 +62,82 @@ private:
   }
 };
 
+/**
+ * Precomputed lookup table from raw 12-bit ADC codes to calibrated values.
+ *
+ * Folds together the eFuse calibration of the ADC, the hardware multipliers and the
+ * software calibration, so a conversion is a single indexed load.
+ */
+class CalibrationTable {
+
+public:
+
+  /** Number of entries (one per 12-bit ADC code) */
+  static const uint16_t SIZE = 4096;
+
+  CalibrationTable() {
+    // prefer PSRAM (when present), fallback to internal RAM
+    this->values = (float*) heap_caps_malloc_prefer(sizeof(float) * SIZE, 2,
+        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+
+  /** Was the table allocated (must be checked before use) */
+  bool isAllocated() {
+    return this->values != NULL;
+  }
+
+  /** Set the calibrated value of a raw code */
+  void set(uint16_t code, float value) {
+    this->values[code & (SIZE - 1)] = value;
+  }
+
+  /** Get the calibrated value of a raw code */
+  float get(uint16_t code) {
+    return this->values[code & (SIZE - 1)];
+  }
+
+  /** Check whether the values are non-decreasing (once all set). Returns the result, also used by findCode(). */
+  bool validate() {
+    this->monotonic = true;
+    for (uint16_t code = 1; code < SIZE; code++) {
+      if (this->values[code] < this->values[code - 1]) {
+        this->monotonic = false;
+        break;
+      }
+    }
+    return this->monotonic;
+  }
+
+  /** Find the lowest raw code with a calibrated value >= the given value (SIZE if none) */
+  uint16_t findCode(float value) {
+    if (!this->monotonic) {
+      // linear search (binary search needs a monotonic table)
+      for (uint16_t code = 0; code < SIZE; code++) {
+        if (this->values[code] >= value) {
+          return code;
+        }
+      }
+      return SIZE;
+    }
+
+    uint16_t start = 0;
+    uint16_t end = SIZE;
+    while (start < end) {
+      uint16_t mid = start + (end - start) / 2;
+      if (this->values[mid] < value) {
+        start = mid + 1;
+      } else {
+        end = mid;
+      }
+    }
+    return start;
+  }
+
+private:
+  float *values;
+
+  /** Set by validate() */
+  bool monotonic = false;
+};
+
 #endif
\ No newline at end of file
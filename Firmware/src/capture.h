@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_heap_caps.h"
+#include "samples.h"
+#include "load.h"
+#include "snapshot.h"
+
+/**
+ * Max number of captured frames (12 bytes each):
+ *   - with PSRAM: 16384 frames = 192 kB, ~4s @ 4.1 kHz
+ *   - without PSRAM: 1024 frames = 12 kB, ~250ms @ 4.1 kHz
+ */
+#if defined BOARD_HAS_PSRAM
+const uint32_t CAPTURE_MAX_FRAMES = 16384;
+#else
+const uint32_t CAPTURE_MAX_FRAMES = 1024;
+#endif
+
+/** Max number of pre-trigger frames (taken from the ADC sample history) */
+const uint32_t CAPTURE_MAX_PRE_FRAMES = SAMPLE_BUFFER_SIZE / 2;
+
+/** Max number of frames processed per control loop tick (well ahead of the ADC, ~1 frame per tick) */
+const uint32_t CAPTURE_FRAMES_PER_TICK = 64;
+
+/**
+ * Capture export format (little endian):
+ *
+ *   header (24 bytes):
+ *     uint32_t magic                   "CAPT"
+ *     uint16_t version                 1
+ *     uint8_t  source                  trigger source
+ *     uint8_t  reserved
+ *     uint32_t nrFrames
+ *     uint32_t preFrames               frames before the trigger
+ *     uint64_t triggerTimestampMicros  (since boot)
+ *
+ *   frames (12 bytes each):
+ *     int32_t  timeMicros              relative to the trigger
+ *     float    voltage                 (in volts)
+ *     float    current                 (in amps)
+ */
+const uint32_t CAPTURE_MAGIC = 0x54504143; // "CAPT"
+const uint16_t CAPTURE_VERSION = 1;
+
+/**
+ * Oscilloscope-style triggered capture of the load voltage and current.
+ *
+ * While armed the pre-trigger history is kept by the ADC sample buffer, so nothing is
+ * copied until the trigger. After the trigger, the control loop copies the pre-trigger
+ * and the post-trigger frames (converted to volts / amps) into the capture buffer, a
+ * limited number of frames per tick. The capture can not be re-armed while the captured
+ * frames are being read (see beginRead()).
+ */
+class Capture {
+
+public:
+
+  enum Source {
+    API,
+    OUTPUT_EDGE,      // shaper step / dynamic load edge
+    VOLTAGE_LEVEL,
+    CURRENT_LEVEL,
+    PROTECTION_TRIP
+  };
+
+  enum Slope {
+    RISING,
+    FALLING
+  };
+
+  enum State {
+    IDLE,
+    ARMED,
+    TRIGGERED,
+    DONE,
+    FAILED
+  };
+
+  /** Capture settings */
+  struct Config {
+    Source source;
+    uint32_t preFrames;
+    uint32_t postFrames;
+    float level;      // level triggers (in volts / amps)
+    Slope slope;      // level triggers
+  };
+
+  /** Consistent status (published by the control loop once per tick) */
+  struct Status {
+    State state;
+    Config config;
+    uint32_t nrFrames;
+  };
+
+  struct __attribute__((packed)) Header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t source;
+    uint8_t reserved;
+    uint32_t nrFrames;
+    uint32_t preFrames;
+    uint64_t triggerTimestampMicros;
+  };
+
+  struct Frame {
+    int32_t timeMicros;
+    float voltage;
+    float current;
+  };
+
+  Capture(SampleBuffer &samples, Load &load)
+    : samples(samples), load(load), cursor(samples) {
+
+      // prefer PSRAM (when present), fallback to internal RAM
+      this->frames = (Frame*) heap_caps_malloc_prefer(sizeof(Frame) * CAPTURE_MAX_FRAMES, 2,
+          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+
+  /** Arm the capture (control loop only). Not allowed while the captured frames are being read. */
+  bool arm(const Config &config) {
+    if ((this->frames == NULL) || (config.postFrames == 0) || (config.preFrames > CAPTURE_MAX_PRE_FRAMES)
+        || (config.preFrames + config.postFrames > CAPTURE_MAX_FRAMES)) {
+      return false;
+    }
+
+    taskENTER_CRITICAL(&this->lock);
+    bool reading = this->nrReaders > 0;
+    if (!reading) {
+      this->state = IDLE;
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    if (reading) {
+      return false;
+    }
+
+    this->config = config;
+    this->nrFrames = 0;
+    this->levelInitialized = false;
+    this->wasTripped = this->load.isTripped();
+    this->cursor.seek(this->samples.head());
+    this->pendingTrigger.store(false, std::memory_order_relaxed);
+
+    this->state = ARMED;
+    return true;
+  }
+
+  /** Disarm / abort the capture (control loop only) */
+  void disarm() {
+    if ((this->state == ARMED) || (this->state == TRIGGERED)) {
+      this->state = IDLE;
+    }
+  }
+
+  /** Trigger from an event source (safe to call from ISR, ignored if not armed for the source) */
+  void ARDUINO_ISR_ATTR trigger(Source source) {
+    if ((this->state != ARMED) || ((source != this->config.source) && (source != API))) {
+      return;
+    }
+
+    if (!this->pendingTrigger.load(std::memory_order_relaxed)) {
+      // the next frame is the first one after the event
+      this->pendingTriggerSeq = this->samples.head();
+      this->pendingTrigger.store(true, std::memory_order_release);
+    }
+  }
+
+  /** Handle the capture (control loop only) */
+  void handle() {
+    if (this->state == ARMED) {
+      this->checkTriggers();
+    }
+
+    if (this->state == TRIGGERED) {
+      this->copyFrames();
+    }
+
+    this->publishStatus();
+  }
+
+  State getState() {
+    return this->state;
+  }
+
+  const Config& getConfig() {
+    return this->config;
+  }
+
+  /** Get a consistent copy of the latest published status (lock-free, any task) */
+  Status getStatus() {
+    Status status = {};
+    this->status.read(status);
+    return status;
+  }
+
+  /** Export header (valid in DONE state) */
+  Header getHeader() {
+    Header header = {};
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.source = this->config.source;
+    header.nrFrames = this->nrFrames;
+    header.preFrames = this->triggerSeq - this->startSeq;
+    header.triggerTimestampMicros = this->triggerTimestampMicros;
+    return header;
+  }
+
+  /** Captured frames (valid in DONE state, between beginRead() and endRead()) */
+  const Frame* getFrames() {
+    return this->frames;
+  }
+
+  /** Start reading the captured frames (any task, blocks re-arming). Returns false if there is no capture. */
+  bool beginRead() {
+    taskENTER_CRITICAL(&this->lock);
+    bool done = this->state == DONE;
+    if (done) {
+      this->nrReaders++;
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return done;
+  }
+
+  /** Finish reading the captured frames (any task) */
+  void endRead() {
+    taskENTER_CRITICAL(&this->lock);
+    this->nrReaders--;
+    taskEXIT_CRITICAL(&this->lock);
+  }
+
+  /** Number of captured frames */
+  uint32_t getNrFrames() {
+    return this->nrFrames;
+  }
+
+private:
+  SampleBuffer &samples;
+  Load &load;
+  SampleBuffer::Cursor cursor;
+
+  Frame *frames;
+  Config config = {};
+  volatile State state = IDLE;
+
+  /** Number of readers of the captured frames (protected by the lock) */
+  uint32_t nrReaders = 0;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  std::atomic<bool> pendingTrigger { false };
+  volatile uint32_t pendingTriggerSeq = 0;
+
+  /** Level trigger: previous value */
+  bool levelInitialized = false;
+  float lastLevelValue = 0.0;
+
+  /** Protection trip trigger: previous state */
+  bool wasTripped = false;
+
+  /** Trigger: frame sequence number and time */
+  uint32_t triggerSeq = 0;
+  uint64_t triggerTimestampMicros = 0;
+
+  /** Captured range [startSeq, endSeq) */
+  uint32_t startSeq = 0;
+  uint32_t endSeq = 0;
+  uint32_t nrFrames = 0;
+
+  /** Status seen by the other tasks */
+  Snapshot<Status> status;
+
+  /** Publish the current status */
+  void publishStatus() {
+    Status status;
+    status.state = this->state;
+    status.config = this->config;
+    status.nrFrames = this->nrFrames;
+
+    this->status.publish(status);
+  }
+
+  /** Frames with the timestamp made relative to the trigger */
+  uint32_t nrRelativeFrames = 0;
+
+  /** Check the trigger conditions on the new frames */
+  void checkTriggers() {
+    if (this->pendingTrigger.load(std::memory_order_acquire)) {
+      this->triggered(this->pendingTriggerSeq);
+      return;
+    }
+
+    if (this->config.source == PROTECTION_TRIP) {
+      bool tripped = this->load.isTripped();
+      if (tripped && !this->wasTripped) {
+        this->triggered(this->samples.head());
+        return;
+      }
+      this->wasTripped = tripped;
+    }
+
+    if ((this->config.source != VOLTAGE_LEVEL) && (this->config.source != CURRENT_LEVEL)) {
+      this->cursor.seek(this->samples.head());
+      return;
+    }
+
+    SampleFrame frame;
+    while (this->cursor.read(frame)) {
+      Load::Measurement measurement;
+      this->load.measure(frame, measurement);
+
+      float value = this->config.source == VOLTAGE_LEVEL ? measurement.voltage : measurement.current;
+      bool crossed = this->config.slope == RISING
+          ? (this->lastLevelValue < this->config.level) && (value >= this->config.level)
+          : (this->lastLevelValue > this->config.level) && (value <= this->config.level);
+
+      if (this->levelInitialized && crossed) {
+        this->triggered(frame.seq);
+        return;
+      }
+
+      this->lastLevelValue = value;
+      this->levelInitialized = true;
+    }
+  }
+
+  /** Trigger at a given frame */
+  void triggered(uint32_t seq) {
+    this->triggerSeq = seq;
+
+    // pre-trigger frames still in the sample history
+    uint32_t head = this->samples.head();
+    uint32_t oldest = head > SAMPLE_BUFFER_SIZE - 1 ? head - (SAMPLE_BUFFER_SIZE - 1) : 0;
+    uint32_t preFrames = min(this->config.preFrames, seq - oldest);
+
+    this->startSeq = seq - preFrames;
+    this->endSeq = seq + this->config.postFrames;
+    this->nrFrames = 0;
+    this->nrRelativeFrames = 0;
+    this->triggerTimestampMicros = 0;
+
+    this->state = TRIGGERED;
+  }
+
+  /** Copy the available frames of the capture range (up to CAPTURE_FRAMES_PER_TICK) */
+  void copyFrames() {
+    uint32_t head = this->samples.head();
+    uint32_t budget = CAPTURE_FRAMES_PER_TICK;
+    while ((budget > 0) && (this->startSeq + this->nrFrames < this->endSeq) && (this->startSeq + this->nrFrames < head)) {
+      budget--;
+      uint32_t seq = this->startSeq + this->nrFrames;
+
+      SampleFrame frame;
+      if (!this->samples.read(seq, frame)) {
+        // overwritten before copied
+        this->state = FAILED;
+        return;
+      }
+
+      if (seq == this->triggerSeq) {
+        this->triggerTimestampMicros = frame.timestampMicros;
+      }
+
+      Load::Measurement measurement;
+      this->load.measure(frame, measurement);
+
+      Frame &captured = this->frames[this->nrFrames++];
+      captured.timeMicros = frame.timestampMicros;  // made relative once the trigger frame is known
+      captured.voltage = measurement.voltage;
+      captured.current = measurement.current;
+    }
+
+    if (this->startSeq + this->nrFrames < this->endSeq) {
+      return;
+    }
+
+    // make the timestamps relative to the trigger (spread over the ticks as well)
+    while ((budget > 0) && (this->nrRelativeFrames < this->nrFrames)) {
+      this->frames[this->nrRelativeFrames++].timeMicros -= (int32_t) this->triggerTimestampMicros;
+      budget--;
+    }
+
+    if (this->nrRelativeFrames == this->nrFrames) {
+      this->state = DONE;
+    }
+  }
+};
+
+#endif
\ No newline at end of file
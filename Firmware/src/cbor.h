@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <Arduino.h>
+
+/**
+ * Minimal CBOR (RFC 8949) writer over a fixed buffer: indefinite length maps / arrays,
+ * text strings, unsigned integers, single precision floats and booleans.
+ *
+ * On overflow the output is truncated and isOverflowed() returns true.
+ */
+class CborWriter {
+
+public:
+
+  CborWriter(uint8_t *buffer, size_t size)
+    : buffer(buffer), size(size) {
+  }
+
+  void beginMap() {
+    this->write(0xBF);
+  }
+
+  void beginArray() {
+    this->write(0x9F);
+  }
+
+  /** End of map / array */
+  void end() {
+    this->write(0xFF);
+  }
+
+  void value(const char *str) {
+    size_t len = strlen(str);
+    this->writeHead(3, len);
+    this->write((const uint8_t*) str, len);
+  }
+
+  void value(bool value) {
+    this->write(value ? 0xF5 : 0xF4);
+  }
+
+  void value(uint32_t value) {
+    this->writeHead(0, value);
+  }
+
+  void value(uint64_t value) {
+    this->writeHead(0, value);
+  }
+
+  void value(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    this->write(0xFA);
+    this->writeBigEndian(bits, 4);
+  }
+
+  /** Map key and value */
+  template<typename T>
+  void field(const char *name, T value) {
+    this->value(name);
+    this->value(value);
+  }
+
+  /** Output length */
+  size_t length() {
+    return this->len;
+  }
+
+  bool isOverflowed() {
+    return this->overflowed;
+  }
+
+private:
+  uint8_t *buffer;
+  size_t size;
+  size_t len = 0;
+  bool overflowed = false;
+
+  /** Major type and argument (shortest encoding) */
+  void writeHead(uint8_t majorType, uint64_t argument) {
+    uint8_t type = majorType << 5;
+    if (argument < 24) {
+      this->write(type | argument);
+    } else if (argument <= 0xFF) {
+      this->write(type | 24);
+      this->writeBigEndian(argument, 1);
+    } else if (argument <= 0xFFFF) {
+      this->write(type | 25);
+      this->writeBigEndian(argument, 2);
+    } else if (argument <= 0xFFFFFFFF) {
+      this->write(type | 26);
+      this->writeBigEndian(argument, 4);
+    } else {
+      this->write(type | 27);
+      this->writeBigEndian(argument, 8);
+    }
+  }
+
+  void writeBigEndian(uint64_t value, uint8_t nrBytes) {
+    for (int8_t idx = nrBytes - 1; idx >= 0; idx--) {
+      this->write((uint8_t) (value >> (idx * 8)));
+    }
+  }
+
+  void write(uint8_t b) {
+    if (this->len < this->size) {
+      this->buffer[this->len++] = b;
+    } else {
+      this->overflowed = true;
+    }
+  }
+
+  void write(const uint8_t *data, size_t len) {
+    size_t copyLen = min(len, this->size - this->len);
+    memcpy(this->buffer + this->len, data, copyLen);
+    this->len += copyLen;
+    if (copyLen < len) {
+      this->overflowed = true;
+    }
+  }
+};
+
+#endif
\ No newline at end of file
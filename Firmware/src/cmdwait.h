@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef CMDWAIT_H
+#define CMDWAIT_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "commands.h"
+#include "shaper.h"
+#include "dynamic.h"
+#include "capture.h"
+
+/** Max number of requests waiting for a command result */
+const uint8_t COMMAND_MAX_WAITERS = 8;
+
+/**
+ * Deferred command responses (web server).
+ *
+ * The request submitting a command is paused (kept open without blocking AsyncTCP), and
+ * answered from the loop() task once the control loop applied the command, or when it times
+ * out. Each waiter owns the data of its command: the slot is released only once the command
+ * completed, even if the request timed out or the client disconnected before.
+ */
+class CommandWaiters {
+
+public:
+
+  /** Response type (see WebServer::sendCommandResponse()) */
+  enum Response : uint8_t {
+    STATUS,
+    BATCH,
+    PROGRAM
+  };
+
+  /** Command data (owned by the waiter until the command completes) */
+  union Payload {
+    CommandBatch batch;
+    Shaper::GeneratorConfig generator;
+    DynamicLoad::Config dynamic;
+    Capture::Config capture;
+  };
+
+  struct Waiter {
+    bool used;
+    bool ready;
+    Response response;
+    uint8_t token;
+    uint32_t deadlineMs;
+
+    /** Response parameter (PROGRAM: number of instructions) */
+    uint32_t param;
+
+    /** Request to answer (empty once answered) */
+    AsyncWebServerRequestPtr request;
+
+    Payload payload;
+  };
+
+  CommandWaiters(CommandQueue &commands)
+    : commands(commands) {
+  }
+
+  /** Reserve a waiter, its payload to be filled in before submit() (AsyncTCP task). Returns NULL if all are in use. */
+  Waiter* reserve() {
+    Waiter *waiter = NULL;
+    taskENTER_CRITICAL(&this->lock);
+    for (uint8_t idx = 0; idx < COMMAND_MAX_WAITERS; idx++) {
+      if (!this->waiters[idx].used) {
+        waiter = &this->waiters[idx];
+        waiter->used = true;
+        waiter->ready = false;
+        break;
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    if (waiter != NULL) {
+      waiter->param = 0;
+    }
+    return waiter;
+  }
+
+  /**
+   * Post the command and pause the request until it completes (AsyncTCP task).
+   *
+   * Returns false if the command queue is full (the waiter is released, the request is not answered).
+   */
+  bool submit(Waiter *waiter, AsyncWebServerRequest *request, Response response, Command::Type type, float value = 0.0, uint32_t param = 0, const void *data = NULL) {
+    int8_t token = this->commands.post(type, value, param, data);
+    if (token < 0) {
+      this->release(*waiter);
+      return false;
+    }
+
+    waiter->response = response;
+    waiter->token = token;
+    waiter->deadlineMs = millis() + COMMAND_TIMEOUT_MS;
+    AsyncWebServerRequestPtr requestPtr = request->pause();
+
+    taskENTER_CRITICAL(&this->lock);
+    waiter->request = requestPtr;
+    waiter->ready = true;
+    taskEXIT_CRITICAL(&this->lock);
+
+    return true;
+  }
+
+  /**
+   * Answer the completed commands, or the timed out requests (loop() task).
+   *
+   * The handler is called once per completed command: handler(request, waiter, result), with a
+   * NULL request if it was already answered (timeout) or the client disconnected.
+   */
+  template<typename Handler>
+  void handle(Handler handler) {
+    uint32_t now = millis();
+
+    for (uint8_t idx = 0; idx < COMMAND_MAX_WAITERS; idx++) {
+      Waiter &waiter = this->waiters[idx];
+
+      taskENTER_CRITICAL(&this->lock);
+      bool ready = waiter.used && waiter.ready;
+      AsyncWebServerRequestPtr requestPtr = waiter.request;
+      taskEXIT_CRITICAL(&this->lock);
+
+      if (!ready) {
+        continue;
+      }
+
+      std::shared_ptr<AsyncWebServerRequest> request = requestPtr.lock();
+      bool result;
+      if (this->commands.poll(waiter.token, result)) {
+        handler(request.get(), waiter, result);
+        this->release(waiter);
+
+      } else if (request && ((int32_t) (now - waiter.deadlineMs) >= 0)) {
+        // the slot is kept until the command completes (owns its data)
+        const char *timeout = "{ \"error\": \"Timeout\" }";
+        request->send(503, "application/json", (const uint8_t*) timeout, strlen(timeout));
+        this->dropRequest(waiter);
+      }
+    }
+  }
+
+private:
+  CommandQueue &commands;
+
+  Waiter waiters[COMMAND_MAX_WAITERS] = {};
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  void release(Waiter &waiter) {
+    // (the request reference is dropped outside of the critical section)
+    AsyncWebServerRequestPtr requestPtr;
+
+    taskENTER_CRITICAL(&this->lock);
+    requestPtr.swap(waiter.request);
+    waiter.ready = false;
+    waiter.used = false;
+    taskEXIT_CRITICAL(&this->lock);
+  }
+
+  /** Forget the request (answered), the waiter stays in use */
+  void dropRequest(Waiter &waiter) {
+    AsyncWebServerRequestPtr requestPtr;
+
+    taskENTER_CRITICAL(&this->lock);
+    requestPtr.swap(waiter.request);
+    taskEXIT_CRITICAL(&this->lock);
+  }
+};
+
+#endif
\ No newline at end of file
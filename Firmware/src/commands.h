@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/** Command sent to the control loop */
+struct Command {
+
+  enum Type {
+    SET_ENABLED,
+    SET_MODE,
+    SET_CURRENT,
+    SET_POWER,
+    SET_RESISTANCE,
+    SET_FAN_SPEED,
+    SET_OVER_TEMPERATURE_LIMIT,
+    SET_OVER_CURRENT_LIMIT,
+    SET_OVER_VOLTAGE_LIMIT,
+    SET_OVER_POWER_LIMIT,
+    RESET_PROTECTIONS,
+    ENABLE_PROTECTIONS,
+    SET_AUTO_ENABLE,
+    SET_AUTO_ENABLE_DELAY,
+    SET_POWER_ENABLE_SETTLE,
+    SET_POWER_DISABLE_SETTLE,
+    SHAPER_PULSE,
+    SHAPER_START,
+    SHAPER_STOP,
+    SHAPER_GENERATOR,
+    DYNAMIC_SET,
+    DYNAMIC_START,
+    DYNAMIC_STOP,
+    CAPTURE_ARM,
+    CAPTURE_DISARM,
+    CAPTURE_TRIGGER,
+    SEQUENCER_PROGRAM,
+    SEQUENCER_START,
+    SEQUENCER_STOP,
+    BATCH
+  };
+
+  Type type;
+
+  /** Value (set points, limits) */
+  float value;
+
+  /** Parameter (enums, flags, times) */
+  uint32_t param;
+
+  /** Extra data (larger settings, owned by the submitter, must stay valid until the command completes) */
+  const void *data;
+
+  /** Completion token index */
+  uint8_t token;
+
+  /** Set point commands: only the latest of consecutive commands is applied */
+  bool isCoalescable() const {
+    return (this->type == SET_CURRENT) || (this->type == SET_POWER) || (this->type == SET_RESISTANCE) || (this->type == SET_FAN_SPEED);
+  }
+
+  /** Load settings (set points, limits, enable / mode): allowed in a batch */
+  bool isBatchable() const {
+    return (this->type >= SET_ENABLED) && (this->type <= SET_POWER_DISABLE_SETTLE);
+  }
+};
+
+/** Commands applied together in one control loop tick (data of a BATCH command) */
+struct CommandBatch {
+
+  static const uint8_t MAX_COMMANDS = 12;
+
+  enum Result : uint8_t {
+    SKIPPED,
+    OK,
+    FAILED,
+    BUSY      // set point / mode owned by the shaper, dynamic load or sequencer
+  };
+
+  uint8_t nrCommands;
+  Command commands[MAX_COMMANDS];
+
+  /** Result of each command (written by the control loop) */
+  Result results[MAX_COMMANDS];
+};
+
+/** Max time to wait for a command to be applied by the control loop (in milliseconds) */
+const uint32_t COMMAND_TIMEOUT_MS = 100;
+
+/**
+ * Bounded multi-producer / single-consumer command queue (lock-free).
+ *
+ * External interfaces (web server, etc.) post commands, the control loop drains the queue
+ * at the start of each tick. The result is reported back through a completion token.
+ */
+class CommandQueue {
+
+public:
+
+  /** Queue size (and number of completion tokens, must be a power of two) */
+  static const uint8_t SIZE = 16;
+
+  /** Max number of commands applied in one tick */
+  static const uint8_t MAX_DRAIN = SIZE;
+
+  CommandQueue() {
+    for (uint32_t idx = 0; idx < SIZE; idx++) {
+      this->cells[idx].sequence.store(idx, std::memory_order_relaxed);
+      this->tokens[idx].store(TOKEN_FREE, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Post a command to the control loop (does not wait, must not be called from the control loop).
+   *
+   * Returns the completion token (see poll()), or -1 if the queue is full. The data must stay
+   * valid until the command completes.
+   */
+  int8_t post(Command::Type type, float value = 0.0, uint32_t param = 0, const void *data = NULL) {
+    int8_t token = this->acquireToken();
+    if (token < 0) {
+      return -1;
+    }
+
+    Command command = { type, value, param, data, (uint8_t) token };
+    if (!this->push(command)) {
+      this->tokens[token].store(TOKEN_FREE, std::memory_order_release);
+      return -1;
+    }
+
+    return token;
+  }
+
+  /** Check if a posted command completed (and its result). The token is released once completed. */
+  bool poll(uint8_t token, bool &result) {
+    uint8_t state = this->tokens[token].load(std::memory_order_acquire);
+    if ((state != TOKEN_OK) && (state != TOKEN_FAIL)) {
+      return false;
+    }
+
+    result = state == TOKEN_OK;
+    this->tokens[token].store(TOKEN_FREE, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Give up on a posted command (ex. on a timeout): its result is not polled, the token is
+   * released once the command completes. The data must still stay valid until then.
+   */
+  void abandon(uint8_t token) {
+    uint8_t expected = TOKEN_PENDING;
+    if (!this->tokens[token].compare_exchange_strong(expected, TOKEN_ABANDONED)) {
+      // completed in the meantime
+      this->tokens[token].store(TOKEN_FREE, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Drain the queue and apply the commands (control loop only).
+   *
+   * Consecutive set point commands of the same type are coalesced, only the latest is applied.
+   */
+  template<typename Handler>
+  void drain(Handler handler) {
+    Command commands[MAX_DRAIN];
+    uint8_t count = 0;
+    while ((count < MAX_DRAIN) && this->pop(commands[count])) {
+      count++;
+    }
+
+    for (uint8_t idx = 0; idx < count; idx++) {
+      Command &command = commands[idx];
+      if (command.isCoalescable() && (idx + 1 < count) && (commands[idx + 1].type == command.type)) {
+        // superseded by the next command
+        this->complete(command.token, true);
+        continue;
+      }
+
+      bool result = handler(command);
+      this->complete(command.token, result);
+    }
+  }
+
+private:
+
+  enum TokenState : uint8_t {
+    TOKEN_FREE,
+    TOKEN_PENDING,
+    TOKEN_OK,
+    TOKEN_FAIL,
+    TOKEN_ABANDONED
+  };
+
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    Command command;
+  };
+
+  Cell cells[SIZE];
+  std::atomic<uint32_t> enqueuePos { 0 };
+  uint32_t dequeuePos = 0;
+
+  std::atomic<uint8_t> tokens[SIZE];
+
+  /** Acquire a free completion token */
+  int8_t acquireToken() {
+    for (uint8_t idx = 0; idx < SIZE; idx++) {
+      uint8_t expected = TOKEN_FREE;
+      if (this->tokens[idx].compare_exchange_strong(expected, TOKEN_PENDING)) {
+        return idx;
+      }
+    }
+    return -1;
+  }
+
+  /** Complete a command */
+  void complete(uint8_t token, bool result) {
+    uint8_t expected = TOKEN_PENDING;
+    if (!this->tokens[token].compare_exchange_strong(expected, result ? TOKEN_OK : TOKEN_FAIL)) {
+      // abandoned by the submitter
+      this->tokens[token].store(TOKEN_FREE, std::memory_order_release);
+    }
+  }
+
+  /** Push a command (multiple producers) */
+  bool push(const Command &command) {
+    uint32_t pos = this->enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = this->cells[pos & (SIZE - 1)];
+      int32_t diff = (int32_t) cell.sequence.load(std::memory_order_acquire) - (int32_t) pos;
+      if (diff == 0) {
+        if (this->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.command = command;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+
+      } else if (diff < 0) {
+        // full
+        return false;
+
+      } else {
+        pos = this->enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** Pop a command (single consumer) */
+  bool pop(Command &command) {
+    Cell &cell = this->cells[this->dequeuePos & (SIZE - 1)];
+    int32_t diff = (int32_t) cell.sequence.load(std::memory_order_acquire) - (int32_t) (this->dequeuePos + 1);
+    if (diff != 0) {
+      // empty
+      return false;
+    }
+
+    command = cell.command;
+    cell.sequence.store(this->dequeuePos + SIZE, std::memory_order_release);
+    this->dequeuePos++;
+    return true;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "adc.h"
+#include "load.h"
+#include "shaper.h"
+#include "dynamic.h"
+#include "capture.h"
+#include "sequencer.h"
+#include "stats.h"
+#include "commands.h"
+#include "events.h"
+
+/**
+ * Control loop core:
+ *   - ESP32-S3: core 1 (WiFi and AsyncTCP are running on core 0)
+ *   - ESP32-S2: core 0 (single core)
+ */
+#if defined ESP32_S2
+const BaseType_t CONTROL_LOOP_CORE = 0;
+#else // S3
+const BaseType_t CONTROL_LOOP_CORE = 1;
+#endif
+
+/** Max time to wait for a new ADC frame (in milliseconds) */
+const uint32_t CONTROL_LOOP_TIMEOUT_MS = 10;
+
+/**
+ * Event driven control loop.
+ *
+ * The control loop task is woken up by the continuous ADC callback (direct-to-task
+ * notification), and processes exactly one ADC frame per wakeup. Commands from the
+ * external interfaces are applied at the start of each tick.
+ */
+class ControlLoop {
+
+public:
+
+  /** Wakeup latency: ADC frame done to control loop running (in microseconds) */
+  Histogram wakeupLatency = Histogram(10);
+
+  /** Wakeup jitter: deviation of the wakeup interval from the ADC frame period (in microseconds) */
+  Histogram wakeupJitter = Histogram(10);
+
+  /** Number of ADC frames not processed (control loop was too slow) */
+  uint32_t missedFrames = 0;
+
+  ControlLoop(ADC &adc, Load &load, Shaper &shaper, DynamicLoad &dynamicLoad, Sequencer &sequencer, Capture &capture, EventLog &events, CommandQueue &commands)
+    : adc(adc), load(load), shaper(shaper), dynamicLoad(dynamicLoad), sequencer(sequencer), capture(capture), events(events), commands(commands) {
+  }
+
+  /** Start the ADC reads, the shaper and dynamic load timers (must be called from the control loop task) */
+  void begin() {
+    this->adc.setNotifyTask(xTaskGetCurrentTaskHandle());
+    this->adc.begin();
+    this->shaper.begin();
+    this->dynamicLoad.begin();
+    this->shaper.setCapture(&this->capture);
+    this->dynamicLoad.setCapture(&this->capture);
+  }
+
+  /** Wait for the next ADC frame and process it */
+  void handle() {
+    uint32_t notifications = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONTROL_LOOP_TIMEOUT_MS));
+    if (notifications > 0) {
+      this->updateStats(notifications);
+    }
+
+    // apply the pending commands
+    this->commands.drain([this](const Command &command) {
+      return this->apply(command);
+    });
+
+    this->load.handle();
+    this->shaper.handle();
+    this->dynamicLoad.handle();
+    this->sequencer.handle();
+    this->capture.handle();
+
+    this->publishEvents();
+  }
+
+  /** Reset the statistics */
+  void resetStats() {
+    this->wakeupLatency.reset();
+    this->wakeupJitter.reset();
+    this->missedFrames = 0;
+    this->lastWakeupMicros = 0;
+  }
+
+private:
+  ADC &adc;
+  Load &load;
+  Shaper &shaper;
+  DynamicLoad &dynamicLoad;
+  Sequencer &sequencer;
+  Capture &capture;
+  EventLog &events;
+  CommandQueue &commands;
+
+  uint64_t lastWakeupMicros = 0;
+
+  /** States seen in the previous tick (event detection) */
+  bool wasTripped = false;
+  bool wasEnabled = false;
+  bool wasPowerReady = false;
+  bool wasShaperActive = false;
+  bool wasDynamicActive = false;
+  bool wasSequencerActive = false;
+  bool wasCaptureDone = false;
+
+  /**
+   * Is the command a set point / mode / enable owned by the active shaper, dynamic load or
+   * sequencer (rejected while they run). Disabling the load is always allowed (stops them).
+   */
+  bool isBusy(const Command &command) {
+    switch (command.type) {
+      case Command::SET_ENABLED:
+        if (command.param == 0) {
+          return false;
+        }
+        break;
+      case Command::SET_MODE:
+      case Command::SET_CURRENT:
+      case Command::SET_POWER:
+      case Command::SET_RESISTANCE:
+        break;
+      default:
+        return false;
+    }
+
+    return this->shaper.isActive() || this->dynamicLoad.isActive() || this->sequencer.isActive();
+  }
+
+  /** Apply a command */
+  bool apply(const Command &command) {
+    if (this->isBusy(command)) {
+      return false;
+    }
+
+    switch (command.type) {
+      case Command::SET_ENABLED:
+        return this->load.setEnabled(command.param != 0);
+      case Command::SET_MODE:
+        return this->load.setMode((Load::Mode) command.param);
+      case Command::SET_CURRENT:
+        return this->load.setCurrent(command.value);
+      case Command::SET_POWER:
+        return this->load.setPower(command.value);
+      case Command::SET_RESISTANCE:
+        return this->load.setResistance(command.value);
+      case Command::SET_FAN_SPEED:
+        return this->load.setFanSpeed(command.value);
+      case Command::SET_OVER_TEMPERATURE_LIMIT:
+        return this->load.setOverTemperatureLimit(command.value);
+      case Command::SET_OVER_CURRENT_LIMIT:
+        return this->load.setOverCurrentLimit(command.value);
+      case Command::SET_OVER_VOLTAGE_LIMIT:
+        return this->load.setOverVoltageLimit(command.value);
+      case Command::SET_OVER_POWER_LIMIT:
+        return this->load.setOverPowerLimit(command.value);
+      case Command::RESET_PROTECTIONS:
+        return this->load.resetProtections();
+      case Command::ENABLE_PROTECTIONS:
+        return this->load.enableProtections(command.param != 0);
+      case Command::SET_AUTO_ENABLE:
+        return this->load.setAutoEnableDisableOnPower(command.param != 0);
+      case Command::SET_AUTO_ENABLE_DELAY:
+        return this->load.setAutoEnableDelayMs(command.param);
+      case Command::SET_POWER_ENABLE_SETTLE:
+        return this->load.setPowerEnableSettleMs(command.param);
+      case Command::SET_POWER_DISABLE_SETTLE:
+        return this->load.setPowerDisableSettleMs(command.param);
+      case Command::SHAPER_PULSE:
+        // shaper, dynamic load and sequencer are mutually exclusive
+        return !this->dynamicLoad.isActive() && !this->sequencer.isActive() && this->shaper.pulse(command.value, command.param);
+      case Command::SHAPER_START:
+        return !this->dynamicLoad.isActive() && !this->sequencer.isActive() && this->shaper.start();
+      case Command::SHAPER_STOP:
+        // cleaned up right away (the next commands of the tick are not rejected as busy)
+        this->shaper.stop();
+        this->shaper.handle();
+        return true;
+      case Command::SHAPER_GENERATOR:
+        return this->shaper.setGenerator(*(const Shaper::GeneratorConfig *) command.data);
+      case Command::DYNAMIC_SET:
+        return this->dynamicLoad.setConfig(*(const DynamicLoad::Config *) command.data);
+      case Command::DYNAMIC_START:
+        return !this->shaper.isActive() && !this->sequencer.isActive() && this->dynamicLoad.start();
+      case Command::DYNAMIC_STOP:
+        this->dynamicLoad.stop();
+        this->dynamicLoad.handle();
+        return true;
+      case Command::CAPTURE_ARM:
+        return this->capture.arm(*(const Capture::Config *) command.data);
+      case Command::CAPTURE_DISARM:
+        this->capture.disarm();
+        return true;
+      case Command::CAPTURE_TRIGGER:
+        this->capture.trigger(Capture::API);
+        return this->capture.getState() != Capture::IDLE;
+      case Command::SEQUENCER_PROGRAM:
+        return this->sequencer.setProgram(*(const Program *) command.data);
+      case Command::SEQUENCER_START:
+        return !this->shaper.isActive() && !this->dynamicLoad.isActive() && this->sequencer.start();
+      case Command::SEQUENCER_STOP:
+        this->sequencer.stop();
+        this->sequencer.handle();
+        return true;
+      case Command::BATCH:
+        return this->applyBatch(*(CommandBatch *) command.data);
+      default:
+        return false;
+    }
+  }
+
+  /**
+   * Apply a batch of load settings, all or nothing: the whole batch is validated first, and
+   * applied (in order) only if every command is valid. A protection tripping while the batch
+   * is applied can still fail a later set point (reported as FAILED, the rest is skipped).
+   */
+  bool applyBatch(CommandBatch &batch) {
+    for (uint8_t idx = 0; idx < batch.nrCommands; idx++) {
+      batch.results[idx] = CommandBatch::SKIPPED;
+    }
+
+    uint8_t invalidIdx = this->validateBatch(batch);
+    if (invalidIdx < batch.nrCommands) {
+      batch.results[invalidIdx] = this->isBusy(batch.commands[invalidIdx]) ? CommandBatch::BUSY : CommandBatch::FAILED;
+      return false;
+    }
+
+    for (uint8_t idx = 0; idx < batch.nrCommands; idx++) {
+      if (!this->apply(batch.commands[idx])) {
+        batch.results[idx] = CommandBatch::FAILED;
+        return false;
+      }
+
+      batch.results[idx] = CommandBatch::OK;
+    }
+
+    return true;
+  }
+
+  /**
+   * Check a batch without applying it: the values, the set points against the mode /
+   * protection state left by the previous commands of the batch, and the running shaper /
+   * dynamic load / sequencer.
+   * Returns the index of the first invalid command (nrCommands if all are valid).
+   */
+  uint8_t validateBatch(const CommandBatch &batch) {
+    Load::Mode mode = this->load.getMode();
+    bool tripped = this->load.isTripped();
+    bool protectionTripped = this->load.getProtectState() > Load::OK_DISABLED;
+
+    for (uint8_t idx = 0; idx < batch.nrCommands; idx++) {
+      const Command &command = batch.commands[idx];
+      if (this->isBusy(command)) {
+        return idx;
+      }
+
+      bool valid = command.isBatchable();
+      switch (command.type) {
+        case Command::SET_ENABLED:
+          valid = (command.param == 0) || !tripped;
+          break;
+        case Command::SET_MODE:
+          valid = command.param <= Load::CONSTANT_RESISTANCE;
+          mode = (Load::Mode) command.param;
+          break;
+        case Command::SET_CURRENT:
+          valid = Load::isValidCurrent(command.value) && (mode == Load::CONSTANT_CURRENT) && ((command.value == 0.0) || !tripped);
+          break;
+        case Command::SET_POWER:
+          valid = Load::isValidPower(command.value) && (mode == Load::CONSTANT_POWER) && ((command.value == 0.0) || !tripped);
+          break;
+        case Command::SET_RESISTANCE:
+          valid = Load::isValidResistance(command.value) && (mode == Load::CONSTANT_RESISTANCE);
+          break;
+        case Command::SET_FAN_SPEED:
+          valid = Load::isValidFanSpeed(command.value);
+          break;
+        case Command::SET_OVER_TEMPERATURE_LIMIT:
+        case Command::SET_OVER_CURRENT_LIMIT:
+        case Command::SET_OVER_VOLTAGE_LIMIT:
+        case Command::SET_OVER_POWER_LIMIT:
+          valid = command.value >= 0.0;
+          break;
+        case Command::RESET_PROTECTIONS:
+          tripped = false;
+          protectionTripped = false;
+          break;
+        case Command::ENABLE_PROTECTIONS:
+          valid = !protectionTripped;
+          break;
+        default:
+          break;
+      }
+
+      if (!valid) {
+        return idx;
+      }
+    }
+
+    return batch.nrCommands;
+  }
+
+  /** Detect the state changes of this tick and publish them as events */
+  void publishEvents() {
+    uint64_t now = esp_timer_get_time();
+
+    bool tripped = this->load.isTripped();
+    if (tripped != this->wasTripped) {
+      if (tripped) {
+        // fast trips: time of the ADC interrupt
+        uint64_t tripMicros = this->load.getFastTripTimestampMicros();
+        this->events.publish(Event::PROTECTION_TRIPPED, this->load.getProtectState(), tripMicros != 0 ? tripMicros : now);
+      } else {
+        this->events.publish(Event::PROTECTION_CLEARED, 0, now);
+      }
+      this->wasTripped = tripped;
+    }
+
+    bool enabled = this->load.isEnabled();
+    if (enabled != this->wasEnabled) {
+      this->events.publish(enabled ? Event::LOAD_ENABLED : Event::LOAD_DISABLED, 0, now);
+      this->wasEnabled = enabled;
+    }
+
+    bool powerReady = this->load.isPowerReady();
+    if (powerReady && !this->wasPowerReady) {
+      this->events.publish(Event::POWER_READY, 0, now);
+    }
+    this->wasPowerReady = powerReady;
+
+    bool shaperActive = this->shaper.isActive();
+    if (!shaperActive && this->wasShaperActive) {
+      this->events.publish(this->shaper.getLastEndState() == Shaper::FINISHED ? Event::SHAPER_FINISHED : Event::SHAPER_ABORTED, 0, now);
+    }
+    this->wasShaperActive = shaperActive;
+
+    bool dynamicActive = this->dynamicLoad.isActive();
+    if (!dynamicActive && this->wasDynamicActive) {
+      this->events.publish(Event::DYNAMIC_STOPPED, 0, now);
+    }
+    this->wasDynamicActive = dynamicActive;
+
+    bool sequencerActive = this->sequencer.isActive();
+    if (!sequencerActive && this->wasSequencerActive) {
+      Sequencer::StopReason reason = this->sequencer.getStopReason();
+      this->events.publish(reason == Sequencer::COMPLETED ? Event::SEQUENCER_FINISHED : Event::SEQUENCER_ABORTED, reason, now);
+    }
+    this->wasSequencerActive = sequencerActive;
+
+    bool captureDone = this->capture.getState() == Capture::DONE;
+    if (captureDone && !this->wasCaptureDone) {
+      this->events.publish(Event::CAPTURE_DONE, this->capture.getNrFrames(), now);
+    }
+    this->wasCaptureDone = captureDone;
+  }
+
+  /** Update the wakeup latency / jitter statistics */
+  void updateStats(uint32_t notifications) {
+    uint64_t now = esp_timer_get_time();
+
+    if (notifications > 1) {
+      // more than one frame since the last wakeup
+      this->missedFrames += notifications - 1;
+      this->lastWakeupMicros = 0;
+      return;
+    }
+
+    SampleFrame frame;
+    if (this->adc.samples.readLatest(frame) && (now >= frame.timestampMicros)) {
+      this->wakeupLatency.add(now - frame.timestampMicros);
+    }
+
+    if (this->lastWakeupMicros > 0) {
+      int32_t deviation = (int32_t) (now - this->lastWakeupMicros) - (int32_t) this->adc.getFramePeriodMicros();
+      this->wakeupJitter.add(abs(deviation));
+    }
+
+    this->lastWakeupMicros = now;
+  }
+};
+
+#endif
\ No newline at end of file
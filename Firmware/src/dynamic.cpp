@@ -0,0 +1,9 @@
+#include "dynamic.h"
+
+/** Dynamic load timer alarm interrupt handler */
+bool ARDUINO_ISR_ATTR dynamicAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userData) {
+  ((DynamicLoad *) userData)->handleAlarm(edata);
+
+  // no task woken
+  return false;
+}
\ No newline at end of file
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef DYNAMIC_H
+#define DYNAMIC_H
+
+#include <Arduino.h>
+#include "driver/gptimer.h"
+#include "load.h"
+#include "dac.h"
+#include "hw.h"
+#include "stats.h"
+#include "capture.h"
+#include "snapshot.h"
+
+/** Dynamic load timer resolution: 1 MHz (1 tick = 1 us) */
+const uint32_t DYNAMIC_TIMER_RESOLUTION_HZ = 1000000;
+
+/** Min dwell time of a level (in microseconds) */
+const uint32_t DYNAMIC_MIN_DWELL_MICROS = 20;
+
+/** Dynamic load timer alarm callback (called from ISR) */
+bool ARDUINO_ISR_ATTR dynamicAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userData);
+
+/**
+ * Dynamic load: switches between two (A/B) or more current levels.
+ *
+ * Every level has its own DAC preset, prepared when the levels are set. The timer alarm
+ * ISR only applies the preset of the next level and schedules the next alarm (absolute
+ * time), so there is no per-edge computation.
+ *
+ * Mutually exclusive with the Shaper (checked by the control loop).
+ */
+class DynamicLoad {
+
+public:
+
+  /** Max number of levels (one DAC preset each) */
+  static const uint8_t MAX_LEVELS = HardwareValues::DAC_PRESET_DYNAMIC_COUNT;
+
+  /** Dynamic load level */
+  struct Level {
+    float current;
+    uint32_t dwellMicros;
+  };
+
+  /** Dynamic load settings */
+  struct Config {
+    Level levels[MAX_LEVELS];
+    uint8_t nrLevels;
+  };
+
+  enum State {
+    IDLE,
+    WAITING_POWER,
+    RUNNING,
+    ABORTED
+  };
+
+  /** Consistent status (published by the control loop once per tick) */
+  struct Status {
+    State state;
+    Config config;
+  };
+
+  /** Edge timing error: actual vs programmed edge time (in microseconds) */
+  Histogram edgeErrors = Histogram(1);
+
+  DynamicLoad(Load &load, DAC &dac)
+    : load(load), dac(dac) {
+  }
+
+  /** Initialize the switching timer (the alarm interrupt is allocated on the calling core) */
+  bool begin() {
+    gptimer_config_t timerConfig = {};
+    timerConfig.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    timerConfig.direction = GPTIMER_COUNT_UP;
+    timerConfig.resolution_hz = DYNAMIC_TIMER_RESOLUTION_HZ;
+    if (gptimer_new_timer(&timerConfig, &this->timer) != ESP_OK) {
+      Serial.println("Dynamic load timer setup ERROR!");
+      return false;
+    }
+
+    gptimer_event_callbacks_t callbacks = {};
+    callbacks.on_alarm = &dynamicAlarm;
+    if ((gptimer_register_event_callbacks(this->timer, &callbacks, this) != ESP_OK) || (gptimer_enable(this->timer) != ESP_OK)) {
+      Serial.println("Dynamic load timer setup ERROR!");
+      return false;
+    }
+
+    return true;
+  }
+
+  /** Set the capture triggered by the level edges (optional) */
+  void setCapture(Capture *capture) {
+    this->capture = capture;
+  }
+
+  /** Is the dynamic load currently active */
+  bool isActive() {
+    return this->state != IDLE;
+  }
+
+  /** Get the dynamic load state */
+  State getState() {
+    return this->state;
+  }
+
+  /** Get the current settings */
+  const Config& getConfig() {
+    return this->config;
+  }
+
+  /** Get a consistent copy of the latest published status (lock-free, any task) */
+  Status getStatus() {
+    Status status = {};
+    this->status.read(status);
+    return status;
+  }
+
+  /** Set the levels (DAC presets prepared). Not allowed while active. */
+  bool setConfig(const Config &config) {
+    if (this->isActive() || (config.nrLevels < 2) || (config.nrLevels > MAX_LEVELS)) {
+      return false;
+    }
+
+    for (uint8_t idx = 0; idx < config.nrLevels; idx++) {
+      if ((config.levels[idx].current < 0.0) || (config.levels[idx].current > HardwareValues::MAX_TOTAL_CURRENT)
+          || (config.levels[idx].dwellMicros < DYNAMIC_MIN_DWELL_MICROS)) {
+        // invalid level
+        return false;
+      }
+    }
+
+    for (uint8_t idx = 0; idx < config.nrLevels; idx++) {
+      uint16_t dacValue = config.levels[idx].current * HardwareValues::currentSetDacMultiplier;
+      this->dac.preparePreset(HardwareValues::DAC_PRESET_DYNAMIC_FIRST + idx, dacValue);
+      this->dwellTicks[idx] = (uint64_t) config.levels[idx].dwellMicros * DYNAMIC_TIMER_RESOLUTION_HZ / 1000000;
+    }
+    this->config = config;
+
+    return true;
+  }
+
+  /** Build A/B settings from a frequency and a duty cycle (time spent at level A) */
+  static bool toABConfig(float currentA, float currentB, float frequencyHz, float duty, Config &config) {
+    if ((frequencyHz <= 0.0) || (duty <= 0.0) || (duty >= 1.0)) {
+      return false;
+    }
+
+    float periodMicros = 1000000.0 / frequencyHz;
+    config = {};
+    config.levels[0] = { currentA, (uint32_t) (periodMicros * duty + 0.5) };
+    config.levels[1] = { currentB, (uint32_t) (periodMicros * (1.0 - duty) + 0.5) };
+    config.nrLevels = 2;
+
+    return true;
+  }
+
+  /** Start switching (constant current mode only, enables the load) */
+  bool start() {
+    if (this->isActive() || (this->config.nrLevels < 2) || (this->timer == NULL)) {
+      return false;
+    }
+
+    if ((this->load.getMode() != Load::CONSTANT_CURRENT) || this->load.isTripped()) {
+      return false;
+    }
+
+    // the timer is started once the power stage is ready
+    if (!this->load.setEnabled(true)) {
+      return false;
+    }
+
+    this->state = WAITING_POWER;
+    this->handle();
+
+    return true;
+  }
+
+  /** Stop switching (the current is set to zero) */
+  void stop() {
+    if (this->state == RUNNING) {
+      this->state = ABORTED;
+    } else if (this->state == WAITING_POWER) {
+      this->state = IDLE;
+    }
+  }
+
+  /** Handle the dynamic load (start when the power stage is ready, cleanup when stopped) */
+  void handle() {
+    switch (this->state) {
+      case WAITING_POWER:
+        if (this->load.isTripped() || !this->load.isEnabled()) {
+          // load disabled while waiting
+          this->state = IDLE;
+
+        } else if (this->load.isPowerReady()) {
+          this->startTimer();
+        }
+        break;
+
+      case ABORTED:
+        gptimer_stop(this->timer);
+        this->load.setCurrent(0.0);
+        this->state = IDLE;
+        break;
+
+      default:
+        break;
+    }
+
+    this->publishStatus();
+  }
+
+  /** Reset the edge timing statistics */
+  void resetStats() {
+    this->edgeErrors.reset();
+  }
+
+  /** Switch to the next level (called from the timer alarm ISR) */
+  void ARDUINO_ISR_ATTR handleAlarm(const gptimer_alarm_event_data_t *edata) {
+    if (this->state != RUNNING) {
+      return;
+    }
+
+    if (this->load.isTripped() || !this->load.isPowerReady()) {
+      // protection tripped / load disabled => stop
+      this->dac.setPreset(HardwareValues::DAC_PRESET_ZERO);
+      this->state = ABORTED;
+      return;
+    }
+
+    this->levelIdx++;
+    if (this->levelIdx >= this->config.nrLevels) {
+      this->levelIdx = 0;
+    }
+
+    if (!this->load.setDacPresetFromISR(HardwareValues::DAC_PRESET_DYNAMIC_FIRST + this->levelIdx)) {
+      // tripped since the check above
+      this->state = ABORTED;
+      return;
+    }
+    if (this->capture != NULL) {
+      this->capture->trigger(Capture::OUTPUT_EDGE);
+    }
+
+    uint64_t now = 0;
+    gptimer_get_raw_count(this->timer, &now);
+    this->edgeErrors.add(now - edata->alarm_value);
+
+    // schedule the next edge (absolute time, no accumulated drift)
+    this->alarmCount += this->dwellTicks[this->levelIdx];
+    gptimer_alarm_config_t alarmConfig = {};
+    alarmConfig.alarm_count = this->alarmCount;
+    gptimer_set_alarm_action(this->timer, &alarmConfig);
+  }
+
+private:
+  Load &load;
+  DAC &dac;
+
+  gptimer_handle_t timer = NULL;
+  Capture *capture = NULL;
+
+  Config config = {};
+  uint32_t dwellTicks[MAX_LEVELS];
+
+  volatile State state = IDLE;
+  uint8_t levelIdx = 0;
+  uint64_t alarmCount = 0;
+
+  /** Status seen by the other tasks */
+  Snapshot<Status> status;
+
+  /** Publish the current status */
+  void publishStatus() {
+    Status status;
+    status.state = this->state;
+    status.config = this->config;
+
+    this->status.publish(status);
+  }
+
+  /** Start switching (first level applied immediately) */
+  void startTimer() {
+    this->levelIdx = 0;
+
+    gptimer_set_raw_count(this->timer, 0);
+    this->alarmCount = this->dwellTicks[0];
+    gptimer_alarm_config_t alarmConfig = {};
+    alarmConfig.alarm_count = this->alarmCount;
+    gptimer_set_alarm_action(this->timer, &alarmConfig);
+
+    if (!this->load.setDacPreset(HardwareValues::DAC_PRESET_DYNAMIC_FIRST)) {
+      // tripped (cleaned up by the next handle())
+      this->state = ABORTED;
+      return;
+    }
+    this->state = RUNNING;
+    if (this->capture != NULL) {
+      this->capture->trigger(Capture::OUTPUT_EDGE);
+    }
+    gptimer_start(this->timer);
+  }
+};
+
+#endif
\ No newline at end of file
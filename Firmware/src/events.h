@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/** Event log size (in events, must be a power of two) */
+const uint32_t EVENT_LOG_SIZE = 32;
+
+/** A timestamped state change of the load / shaper / dynamic load / sequencer / capture */
+struct Event {
+
+  enum Type : uint8_t {
+    PROTECTION_TRIPPED,   // param: Load::ProtectState (fast trips: TRIPPED_OVER_VOLTAGE / TRIPPED_OVER_CURRENT)
+    PROTECTION_CLEARED,
+    LOAD_ENABLED,
+    LOAD_DISABLED,
+    POWER_READY,          // power stage on (incl. the end of the auto-enable delay)
+    SHAPER_FINISHED,
+    SHAPER_ABORTED,
+    DYNAMIC_STOPPED,
+    SEQUENCER_FINISHED,
+    SEQUENCER_ABORTED,    // param: Sequencer::StopReason
+    CAPTURE_DONE,         // param: number of frames
+    NR_TYPES
+  };
+
+  /** Mask of all the event types */
+  static const uint32_t ALL = (1 << NR_TYPES) - 1;
+
+  uint32_t seq;
+  Type type;
+  uint32_t param;
+  uint64_t timestampMicros;
+};
+
+/**
+ * Single-producer / multi-consumer ring of the latest events.
+ *
+ * Written by the control loop (never blocks), read by the web server through the event
+ * sequence numbers. Each slot is protected by its own guard counter (seqlock, odd while
+ * written), like the sample buffer.
+ */
+class EventLog {
+
+public:
+
+  EventLog() {
+    for (uint32_t idx = 0; idx < EVENT_LOG_SIZE; idx++) {
+      this->slots[idx].guard.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /** Publish an event (control loop only) */
+  void publish(Event::Type type, uint32_t param, uint64_t timestampMicros) {
+    uint32_t seq = this->nextSeq.load(std::memory_order_relaxed);
+    Slot &slot = this->slots[seq & (EVENT_LOG_SIZE - 1)];
+
+    // mark the slot as being written (odd guard)
+    uint32_t guard = slot.guard.load(std::memory_order_relaxed);
+    slot.guard.store(guard + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.event.seq = seq;
+    slot.event.type = type;
+    slot.event.param = param;
+    slot.event.timestampMicros = timestampMicros;
+
+    slot.guard.store(guard + 2, std::memory_order_release);
+    this->nextSeq.store(seq + 1, std::memory_order_release);
+  }
+
+  /** Sequence number of the next event (equals the total number of events) */
+  uint32_t head() {
+    return this->nextSeq.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Find the first event with a sequence number >= from, matching the mask.
+   * Events already overwritten are skipped. Returns false if there is none (yet).
+   */
+  bool find(uint32_t from, uint32_t mask, Event &event) {
+    uint32_t head = this->head();
+    if ((int32_t) (head - from) <= 0) {
+      return false;
+    }
+
+    if (head - from > EVENT_LOG_SIZE) {
+      // skip the overwritten events
+      from = head - EVENT_LOG_SIZE;
+    }
+
+    for (uint32_t seq = from; seq != head; seq++) {
+      if (this->read(seq, event) && ((mask & (1 << event.type)) != 0)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+private:
+  struct Slot {
+    /** Odd while the slot is being written */
+    std::atomic<uint32_t> guard;
+    Event event;
+  };
+
+  Slot slots[EVENT_LOG_SIZE];
+  std::atomic<uint32_t> nextSeq { 0 };
+
+  /** Read a given event. Returns false if not (or no longer) available. */
+  bool read(uint32_t seq, Event &event) {
+    Slot &slot = this->slots[seq & (EVENT_LOG_SIZE - 1)];
+
+    uint32_t guard = slot.guard.load(std::memory_order_acquire);
+    if ((guard & 1) != 0) {
+      return false;
+    }
+
+    event = slot.event;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (slot.guard.load(std::memory_order_relaxed) == guard) && (event.seq == seq);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef EVENTWAIT_H
+#define EVENTWAIT_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "events.h"
+#include "json.h"
+
+/** Max number of requests waiting for events */
+const uint8_t EVENT_MAX_WAITERS = 4;
+
+/** Wait timeout: default / max (in milliseconds) */
+const uint32_t EVENT_WAIT_DEFAULT_TIMEOUT_MS = 30000;
+const uint32_t EVENT_WAIT_MAX_TIMEOUT_MS = 60000;
+
+/**
+ * Long-poll event waits (GET /api/events/wait).
+ *
+ * A request without a matching event is paused (kept open without blocking AsyncTCP), and
+ * answered from the loop() task once a matching event is published by the control loop,
+ * or when it times out. Disconnected requests are dropped.
+ */
+class EventWaiters {
+
+public:
+
+  EventWaiters(EventLog &events, JsonBufferPool &jsonPool)
+    : events(events), jsonPool(jsonPool) {
+  }
+
+  /** Event type name */
+  static const char* toTypeStr(Event::Type type) {
+    const char* typeStr = "";
+    switch (type) {
+      case Event::PROTECTION_TRIPPED:
+        typeStr = "PROTECTION_TRIPPED";
+        break;
+      case Event::PROTECTION_CLEARED:
+        typeStr = "PROTECTION_CLEARED";
+        break;
+      case Event::LOAD_ENABLED:
+        typeStr = "LOAD_ENABLED";
+        break;
+      case Event::LOAD_DISABLED:
+        typeStr = "LOAD_DISABLED";
+        break;
+      case Event::POWER_READY:
+        typeStr = "POWER_READY";
+        break;
+      case Event::SHAPER_FINISHED:
+        typeStr = "SHAPER_FINISHED";
+        break;
+      case Event::SHAPER_ABORTED:
+        typeStr = "SHAPER_ABORTED";
+        break;
+      case Event::DYNAMIC_STOPPED:
+        typeStr = "DYNAMIC_STOPPED";
+        break;
+      case Event::SEQUENCER_FINISHED:
+        typeStr = "SEQUENCER_FINISHED";
+        break;
+      case Event::SEQUENCER_ABORTED:
+        typeStr = "SEQUENCER_ABORTED";
+        break;
+      case Event::CAPTURE_DONE:
+        typeStr = "CAPTURE_DONE";
+        break;
+      default:
+        break;
+    }
+    return typeStr;
+  }
+
+  /**
+   * Wait for the first event matching the mask, with a sequence number >= from (AsyncTCP task).
+   * Answered right away if there is one already. Returns false if there are too many waiters.
+   */
+  bool wait(AsyncWebServerRequest *request, uint32_t mask, uint32_t from, uint32_t timeoutMs) {
+    Event event;
+    if (this->events.find(from, mask, event)) {
+      this->send(request, &event, event.seq + 1);
+      return true;
+    }
+
+    // reserve a slot
+    Waiter *waiter = NULL;
+    taskENTER_CRITICAL(&this->lock);
+    for (uint8_t idx = 0; idx < EVENT_MAX_WAITERS; idx++) {
+      if (!this->waiters[idx].used) {
+        waiter = &this->waiters[idx];
+        waiter->used = true;
+        waiter->ready = false;
+        break;
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    if (waiter == NULL) {
+      return false;
+    }
+
+    waiter->mask = mask;
+    waiter->from = from;
+    waiter->deadlineMs = millis() + timeoutMs;
+    AsyncWebServerRequestPtr requestPtr = request->pause();
+
+    taskENTER_CRITICAL(&this->lock);
+    waiter->request = requestPtr;
+    waiter->ready = true;
+    taskEXIT_CRITICAL(&this->lock);
+
+    return true;
+  }
+
+  /** Answer the waiters with a matching event, or on timeout (loop() task) */
+  void handle() {
+    uint32_t now = millis();
+
+    for (uint8_t idx = 0; idx < EVENT_MAX_WAITERS; idx++) {
+      Waiter &waiter = this->waiters[idx];
+
+      taskENTER_CRITICAL(&this->lock);
+      bool ready = waiter.used && waiter.ready;
+      AsyncWebServerRequestPtr requestPtr = waiter.request;
+      taskEXIT_CRITICAL(&this->lock);
+
+      if (!ready) {
+        continue;
+      }
+
+      std::shared_ptr<AsyncWebServerRequest> request = requestPtr.lock();
+      if (!request) {
+        // client disconnected
+        this->release(waiter);
+        continue;
+      }
+
+      // events before head are checked now (not again in the next round)
+      uint32_t head = this->events.head();
+      Event event;
+      if (this->events.find(waiter.from, waiter.mask, event)) {
+        this->send(request.get(), &event, event.seq + 1);
+        this->release(waiter);
+
+      } else if ((int32_t) (now - waiter.deadlineMs) >= 0) {
+        this->send(request.get(), NULL, head);
+        this->release(waiter);
+
+      } else if ((int32_t) (head - waiter.from) > 0) {
+        waiter.from = head;
+      }
+    }
+  }
+
+private:
+  EventLog &events;
+  JsonBufferPool &jsonPool;
+
+  struct Waiter {
+    bool used;
+    bool ready;
+    uint32_t mask;
+    uint32_t from;
+    uint32_t deadlineMs;
+    AsyncWebServerRequestPtr request;
+  };
+
+  Waiter waiters[EVENT_MAX_WAITERS] = {};
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  void release(Waiter &waiter) {
+    // (the request reference is dropped outside of the critical section)
+    AsyncWebServerRequestPtr requestPtr;
+
+    taskENTER_CRITICAL(&this->lock);
+    requestPtr.swap(waiter.request);
+    waiter.ready = false;
+    waiter.used = false;
+    taskEXIT_CRITICAL(&this->lock);
+  }
+
+  /** Send the event (NULL: timeout) and the sequence number to wait from next */
+  void send(AsyncWebServerRequest *request, const Event *event, uint32_t next) {
+    PooledJsonResponse *response = new PooledJsonResponse(this->jsonPool);
+    if (!response->isValid()) {
+      delete response;
+      const char *busy = "{ \"error\": \"Busy\" }";
+      request->send(503, "application/json", (const uint8_t*) busy, strlen(busy));
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.beginObject();
+    if (event != NULL) {
+      json.key("event");
+      json.beginObject();
+      json.field("seq", event->seq);
+      json.field("type", toTypeStr(event->type));
+      json.field("param", event->param);
+      json.field("timestampMicros", event->timestampMicros);
+      json.endObject();
+    } else {
+      json.field("timeout", true);
+    }
+    json.field("next", next);
+    json.endObject();
+    response->finish();
+
+    request->send(response);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef FMT_H
+#define FMT_H
+
+#include <Arduino.h>
+
+/** Two digit pairs "00" - "99" (integer formatting, two digits per division) */
+static const char FMT_DIGIT_PAIRS[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/**
+ * Format an unsigned integer in decimal (no terminator).
+ * Returns the number of characters written (buffer: at least 20 characters).
+ */
+inline size_t fmtUint64(char *buffer, uint64_t value) {
+  char digits[20];
+  char *p = digits + sizeof(digits);
+
+  // 32-bit divisions once the value fits (much cheaper on the ESP32)
+  while (value > 0xFFFFFFFF) {
+    uint32_t pair = value % 100;
+    value /= 100;
+    p -= 2;
+    memcpy(p, FMT_DIGIT_PAIRS + pair * 2, 2);
+  }
+
+  uint32_t value32 = value;
+  while (value32 >= 100) {
+    uint32_t pair = value32 % 100;
+    value32 /= 100;
+    p -= 2;
+    memcpy(p, FMT_DIGIT_PAIRS + pair * 2, 2);
+  }
+
+  if (value32 >= 10) {
+    p -= 2;
+    memcpy(p, FMT_DIGIT_PAIRS + value32 * 2, 2);
+  } else {
+    *--p = '0' + value32;
+  }
+
+  size_t len = digits + sizeof(digits) - p;
+  memcpy(buffer, p, len);
+  return len;
+}
+
+/** Format a signed integer in decimal (no terminator). Returns the number of characters written. */
+inline size_t fmtInt64(char *buffer, int64_t value) {
+  if (value < 0) {
+    *buffer = '-';
+    return 1 + fmtUint64(buffer + 1, (uint64_t) 0 - (uint64_t) value);
+  }
+
+  return fmtUint64(buffer, value);
+}
+
+/**
+ * Format a float with a fixed number of decimals (max. 6), with integer math (no printf).
+ * Returns the number of characters written (buffer: at least 28 characters).
+ */
+inline size_t fmtFloat(char *buffer, float value, uint8_t decimals) {
+  static const uint32_t POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+  if (isnan(value) || isinf(value) || (fabsf(value) >= 1e12)) {
+    // no JSON representation
+    memcpy(buffer, "null", 4);
+    return 4;
+  }
+
+  uint32_t scale = POW10[decimals];
+  int64_t scaled = llround((double) value * scale);
+
+  size_t len = 0;
+  if (scaled < 0) {
+    buffer[len++] = '-';
+    scaled = -scaled;
+  }
+
+  len += fmtUint64(buffer + len, scaled / scale);
+  if (decimals > 0) {
+    buffer[len++] = '.';
+
+    // fractional part, zero padded
+    uint32_t fraction = scaled % scale;
+    for (uint8_t idx = decimals; idx > 0; idx--) {
+      buffer[len + idx - 1] = '0' + fraction % 10;
+      fraction /= 10;
+    }
+    len += decimals;
+  }
+
+  return len;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <Arduino.h>
+
+/** Sine lookup table size (one period, must be a power of two) */
+const uint16_t GENERATOR_SINE_TABLE_BITS = 8;
+const uint16_t GENERATOR_SINE_TABLE_SIZE = 1 << GENERATOR_SINE_TABLE_BITS;
+
+/** Phase accumulator: 48-bit fraction of a period */
+const uint8_t GENERATOR_PHASE_BITS = 48;
+
+/**
+ * Table-free parametric waveform generator.
+ *
+ * Uses a fixed-point phase accumulator advanced by the elapsed time, so it can be
+ * evaluated at any (even irregular) tick rate. The output is a normalized 16-bit
+ * sample (0 - 65535), scaled by the caller.
+ */
+class Generator {
+
+public:
+
+  enum Type {
+    SQUARE,
+    TRIANGLE,
+    SINE,
+    RAMP,
+    PWM,
+    STAIRCASE
+  };
+
+  /** Max normalized sample value */
+  static const uint16_t SAMPLE_MAX = 0xFFFF;
+
+  Generator() {
+    // (1 + sin) / 2, one extra entry for the interpolation
+    for (uint16_t idx = 0; idx <= GENERATOR_SINE_TABLE_SIZE; idx++) {
+      float value = (1.0 + sin(2.0 * PI * idx / GENERATOR_SINE_TABLE_SIZE)) / 2.0;
+      this->sineTable[idx] = value * SAMPLE_MAX + 0.5;
+    }
+  }
+
+  /**
+   * Configure the generator.
+   *
+   * duty: PWM duty cycle (0.0 - 1.0), stairs: number of staircase levels (>= 2),
+   * repeat: number of periods to generate (0 = forever).
+   */
+  bool configure(Type type, float frequencyHz, float duty, uint16_t stairs, uint32_t repeat) {
+    if ((frequencyHz <= 0.0) || (duty < 0.0) || (duty > 1.0) || ((type == STAIRCASE) && (stairs < 2))) {
+      return false;
+    }
+
+    this->type = type;
+    this->phaseRate = (uint64_t) ((double) frequencyHz * ((uint64_t) 1 << GENERATOR_PHASE_BITS) / 1000000.0);
+    this->dutyThreshold = (uint64_t) ((double) duty * ((uint64_t) 1 << GENERATOR_PHASE_BITS));
+    this->stairs = stairs;
+    this->repeat = repeat;
+    this->reset();
+
+    return this->phaseRate > 0;
+  }
+
+  /** Restart from the beginning of the first period */
+  void reset() {
+    this->phase = 0;
+    this->periods = 0;
+  }
+
+  /** Advance the phase by the elapsed time (in microseconds). Returns false when all the periods were generated. */
+  bool advance(uint32_t elapsedMicros) {
+    this->phase += this->phaseRate * elapsedMicros;
+
+    // count the completed periods
+    this->periods += this->phase >> GENERATOR_PHASE_BITS;
+    this->phase &= ((uint64_t) 1 << GENERATOR_PHASE_BITS) - 1;
+
+    return (this->repeat == 0) || (this->periods < this->repeat);
+  }
+
+  /** Current normalized sample (0 - SAMPLE_MAX) */
+  uint16_t sample() {
+    // upper 16 bits of the phase
+    uint16_t phase16 = this->phase >> (GENERATOR_PHASE_BITS - 16);
+
+    switch (this->type) {
+      case SQUARE:
+        return phase16 < 0x8000 ? SAMPLE_MAX : 0;
+
+      case PWM:
+        return this->phase < this->dutyThreshold ? SAMPLE_MAX : 0;
+
+      case TRIANGLE:
+        return phase16 < 0x8000 ? (phase16 << 1) | (phase16 >> 14) : ((0xFFFF - phase16) << 1) | 1;
+
+      case RAMP:
+        return phase16;
+
+      case STAIRCASE: {
+        uint32_t level = ((uint32_t) phase16 * this->stairs) >> 16;
+        return level * SAMPLE_MAX / (this->stairs - 1);
+      }
+
+      case SINE: {
+        // linear interpolation between the table entries
+        uint16_t idx = phase16 >> (16 - GENERATOR_SINE_TABLE_BITS);
+        int32_t frac = phase16 & ((1 << (16 - GENERATOR_SINE_TABLE_BITS)) - 1);
+        int32_t from = this->sineTable[idx];
+        int32_t to = this->sineTable[idx + 1];
+        return from + (((to - from) * frac) >> (16 - GENERATOR_SINE_TABLE_BITS));
+      }
+
+      default:
+        return 0;
+    }
+  }
+
+private:
+  uint16_t sineTable[GENERATOR_SINE_TABLE_SIZE + 1];
+
+  Type type = SQUARE;
+  uint64_t phase = 0;
+  uint64_t phaseRate = 0;
+  uint32_t periods = 0;
+  uint64_t dutyThreshold = 0;
+  uint16_t stairs = 2;
+  uint32_t repeat = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include "samples.h"
+#include "load.h"
+#include "fmt.h"
+
+/**
+ * Sample history binary export format (little endian):
+ *
+ *   header (16 bytes):
+ *     uint32_t magic             "SMPL"
+ *     uint16_t version           1
+ *     uint16_t recordSize        32
+ *     uint32_t from              sequence number of the first frame
+ *     uint32_t count             number of frames (less if the export was overtaken by the ADC)
+ *
+ *   records (32 bytes each):
+ *     uint32_t seq
+ *     uint64_t timestampMicros
+ *     float    voltage           (in volts)
+ *     float    current           (in amps)
+ *     uint16_t values[6]         raw ADC codes
+ *
+ * CSV format: "seq,timestamp_us,voltage_mv,current_ma,ch0,...,ch5" (one line per frame)
+ */
+const uint32_t HISTORY_MAGIC = 0x4C504D53; // "SMPL"
+const uint16_t HISTORY_VERSION = 1;
+
+/**
+ * Incremental export of the ADC sample history.
+ *
+ * Reads the frames straight from the sample buffer through its own cursor, and formats
+ * them into the chunks of a (chunked) HTTP response, one record at a time. A record split
+ * between two chunks is kept in a small pending buffer, so no full-size copy is needed.
+ */
+class SampleExport {
+
+public:
+
+  enum Format {
+    BINARY,
+    CSV
+  };
+
+  struct __attribute__((packed)) Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t from;
+    uint32_t count;
+  };
+
+  struct __attribute__((packed)) Record {
+    uint32_t seq;
+    uint64_t timestampMicros;
+    float voltage;
+    float current;
+    uint16_t values[SAMPLE_MAX_CHANNELS];
+  };
+
+  static_assert(sizeof(Header) == 16, "Unexpected history header size");
+  static_assert(sizeof(Record) == 32, "Unexpected history record size");
+
+  /**
+   * Export count frames starting with the from sequence number (clamped to the available
+   * history). count = 0: all the frames available now.
+   */
+  SampleExport(SampleBuffer &samples, Load &load, Format format, uint32_t from, uint32_t count)
+    : samples(samples), load(load), cursor(samples), format(format) {
+
+      uint32_t head = samples.head();
+      uint32_t oldest = head > SAMPLE_BUFFER_SIZE - 1 ? head - (SAMPLE_BUFFER_SIZE - 1) : 0;
+      if ((int32_t) (from - oldest) < 0) {
+        from = oldest;
+      }
+      if ((int32_t) (head - from) < 0) {
+        from = head;
+      }
+
+      uint32_t available = head - from;
+      this->from = from;
+      this->remaining = ((count == 0) || (count > available)) ? available : count;
+      this->count = this->remaining;
+      this->cursor.seek(from);
+
+      // the header is the first "record"
+      this->pendingLen = this->format == BINARY ? this->formatHeader() : this->formatCsvHeader();
+  }
+
+  /** First exported frame */
+  uint32_t getFrom() {
+    return this->from;
+  }
+
+  /** Number of exported frames */
+  uint32_t getCount() {
+    return this->count;
+  }
+
+  /** Fill the next chunk. Returns the number of bytes written, 0 at the end. */
+  size_t fill(uint8_t *buffer, size_t maxLen) {
+    size_t len = 0;
+
+    while (len < maxLen) {
+      if (this->pendingIdx == this->pendingLen) {
+        // format the next record
+        if (!this->nextRecord()) {
+          break;
+        }
+      }
+
+      size_t copyLen = min(maxLen - len, (size_t) (this->pendingLen - this->pendingIdx));
+      memcpy(buffer + len, this->pending + this->pendingIdx, copyLen);
+      this->pendingIdx += copyLen;
+      len += copyLen;
+    }
+
+    return len;
+  }
+
+private:
+  SampleBuffer &samples;
+  Load &load;
+  SampleBuffer::Cursor cursor;
+  Format format;
+
+  uint32_t from = 0;
+  uint32_t count = 0;
+  uint32_t remaining = 0;
+
+  /** Formatted record (partially sent) */
+  uint8_t pending[128];
+  uint8_t pendingLen = 0;
+  uint8_t pendingIdx = 0;
+
+  /** Format the next frame. Returns false at the end (or if the export was overtaken by the ADC). */
+  bool nextRecord() {
+    if (this->remaining == 0) {
+      return false;
+    }
+
+    uint32_t seq = this->cursor.position();
+    SampleFrame frame;
+    if (!this->cursor.read(frame) || (frame.seq != seq)) {
+      // frames overwritten before exported => end the export
+      this->remaining = 0;
+      return false;
+    }
+    this->remaining--;
+
+    Load::Measurement measurement;
+    this->load.measure(frame, measurement);
+
+    this->pendingLen = this->format == BINARY ? this->formatRecord(frame, measurement) : this->formatCsvRecord(frame, measurement);
+    this->pendingIdx = 0;
+    return true;
+  }
+
+  uint8_t formatHeader() {
+    Header header;
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.recordSize = sizeof(Record);
+    header.from = this->from;
+    header.count = this->count;
+
+    memcpy(this->pending, &header, sizeof(header));
+    return sizeof(header);
+  }
+
+  uint8_t formatRecord(const SampleFrame &frame, const Load::Measurement &measurement) {
+    Record record;
+    record.seq = frame.seq;
+    record.timestampMicros = frame.timestampMicros;
+    record.voltage = measurement.voltage;
+    record.current = measurement.current;
+    memcpy(record.values, frame.values, sizeof(record.values));
+
+    memcpy(this->pending, &record, sizeof(record));
+    return sizeof(record);
+  }
+
+  uint8_t formatCsvHeader() {
+    const char *header = "seq,timestamp_us,voltage_mv,current_ma,ch0,ch1,ch2,ch3,ch4,ch5\n";
+    size_t len = strlen(header);
+    memcpy(this->pending, header, len);
+    return len;
+  }
+
+  /** CSV line: integers only (fast formatting, no printf / floating point formatting) */
+  uint8_t formatCsvRecord(const SampleFrame &frame, const Load::Measurement &measurement) {
+    char *p = (char *) this->pending;
+
+    p += fmtUint64(p, frame.seq);
+    *p++ = ',';
+    p += fmtUint64(p, frame.timestampMicros);
+    *p++ = ',';
+    p += fmtInt64(p, (int32_t) lroundf(measurement.voltage * 1000.0));
+    *p++ = ',';
+    p += fmtInt64(p, (int32_t) lroundf(measurement.current * 1000.0));
+    for (uint8_t chan = 0; chan < SAMPLE_MAX_CHANNELS; chan++) {
+      *p++ = ',';
+      p += fmtUint64(p, frame.values[chan]);
+    }
+    *p++ = '\n';
+
+    return p - (char *) this->pending;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -129,6 +129,20 @@ public:
   /** DAC OpAmp Multiplier (3.3V to 10V) */
   static constexpr float DAC_MULTIPLIER = 1.0;
 
+  /** DAC preset used for zero current (fast protection) */
+  static constexpr uint16_t DAC_PRESET_ZERO = 0;
+
+  /** DAC presets used by the shaper (ping-pong, next step prepared while the current one is applied) */
+  static constexpr uint16_t DAC_PRESET_SHAPER_A = 1;
+  static constexpr uint16_t DAC_PRESET_SHAPER_B = 2;
+
+  /** DAC presets used by the dynamic load (one per level) */
+  static constexpr uint16_t DAC_PRESET_DYNAMIC_FIRST = 8;
+  static constexpr uint16_t DAC_PRESET_DYNAMIC_COUNT = 8;
+
+  /** Number of DAC presets */
+  static constexpr uint16_t DAC_NR_PRESETS = DAC_PRESET_DYNAMIC_FIRST + DAC_PRESET_DYNAMIC_COUNT;
+
   /** Volts to DAC Multiplier */
   static constexpr float VOLTS_TO_DAC = ((float) DAC_MAX_VALUE) / (3.3);
 
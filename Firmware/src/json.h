@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef JSON_H
+#define JSON_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <ESPAsyncWebServer.h>
+#include "fmt.h"
+
+/** Number of pooled JSON response buffers (max concurrent JSON responses) */
+const uint8_t JSON_POOL_SIZE = 4;
+
+/** Pooled JSON response buffer size */
+const size_t JSON_BUFFER_SIZE = 1536;
+
+/**
+ * Streaming JSON writer over a fixed buffer (no allocation, no printf).
+ *
+ * Commas are inserted automatically. On overflow the output is truncated and
+ * isOverflowed() returns true.
+ */
+class JsonWriter {
+
+public:
+
+  JsonWriter(char *buffer, size_t size)
+    : buffer(buffer), size(size) {
+  }
+
+  void beginObject() {
+    this->separator();
+    this->write('{');
+    this->first = true;
+  }
+
+  void endObject() {
+    this->write('}');
+    this->first = false;
+  }
+
+  void beginArray() {
+    this->separator();
+    this->write('[');
+    this->first = true;
+  }
+
+  void endArray() {
+    this->write(']');
+    this->first = false;
+  }
+
+  /** Object key (the next value belongs to it) */
+  void key(const char *name) {
+    this->separator();
+    this->writeString(name);
+    this->write(':');
+    this->afterKey = true;
+  }
+
+  void value(const char *str) {
+    this->separator();
+    this->writeString(str);
+  }
+
+  void value(bool value) {
+    this->separator();
+    this->write(value ? "true" : "false");
+  }
+
+  void value(uint32_t value) {
+    this->separator();
+    char digits[20];
+    this->write(digits, fmtUint64(digits, value));
+  }
+
+  void value(uint64_t value) {
+    this->separator();
+    char digits[20];
+    this->write(digits, fmtUint64(digits, value));
+  }
+
+  void value(int32_t value) {
+    this->separator();
+    char digits[21];
+    this->write(digits, fmtInt64(digits, value));
+  }
+
+  void value(float value, uint8_t decimals) {
+    this->separator();
+    char digits[28];
+    this->write(digits, fmtFloat(digits, value, decimals));
+  }
+
+  /** Key and value */
+  template<typename T>
+  void field(const char *name, T value) {
+    this->key(name);
+    this->value(value);
+  }
+
+  void field(const char *name, float value, uint8_t decimals) {
+    this->key(name);
+    this->value(value, decimals);
+  }
+
+  /** Pre-formatted JSON value: write into tail() (remaining() bytes), then commit the length */
+  char* tail() {
+    this->separator();
+    return this->buffer + this->len;
+  }
+
+  size_t remaining() {
+    return this->len < this->size ? this->size - this->len : 0;
+  }
+
+  void commit(size_t len) {
+    this->len += min(len, this->remaining());
+  }
+
+  /** Output length */
+  size_t length() {
+    return this->len;
+  }
+
+  const char* data() {
+    return this->buffer;
+  }
+
+  bool isOverflowed() {
+    return this->overflowed;
+  }
+
+private:
+  char *buffer;
+  size_t size;
+  size_t len = 0;
+  bool first = true;
+  bool afterKey = false;
+  bool overflowed = false;
+
+  /** Comma before the next value (not after a key, or at the start of an object / array) */
+  void separator() {
+    if (this->afterKey) {
+      this->afterKey = false;
+      return;
+    }
+
+    if (!this->first) {
+      this->write(',');
+    }
+    this->first = false;
+  }
+
+  void write(char c) {
+    if (this->len < this->size) {
+      this->buffer[this->len++] = c;
+    } else {
+      this->overflowed = true;
+    }
+  }
+
+  void write(const char *str) {
+    this->write(str, strlen(str));
+  }
+
+  void write(const char *str, size_t len) {
+    size_t copyLen = min(len, this->remaining());
+    memcpy(this->buffer + this->len, str, copyLen);
+    this->len += copyLen;
+    if (copyLen < len) {
+      this->overflowed = true;
+    }
+  }
+
+  void writeString(const char *str) {
+    this->write('"');
+    for (const char *p = str; *p != '\0'; p++) {
+      if ((*p == '"') || (*p == '\\')) {
+        this->write('\\');
+      }
+      this->write(*p);
+    }
+    this->write('"');
+  }
+};
+
+/** Fixed pool of JSON response buffers (lock-free, any task) */
+class JsonBufferPool {
+
+public:
+
+  /** Acquire a free buffer. Returns -1 if all the buffers are in use. */
+  int8_t acquire() {
+    for (uint8_t idx = 0; idx < JSON_POOL_SIZE; idx++) {
+      bool expected = false;
+      if (this->used[idx].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        return idx;
+      }
+    }
+    return -1;
+  }
+
+  void release(int8_t idx) {
+    this->used[idx].store(false, std::memory_order_release);
+  }
+
+  char* get(int8_t idx) {
+    return this->buffers[idx];
+  }
+
+private:
+  char buffers[JSON_POOL_SIZE][JSON_BUFFER_SIZE];
+  std::atomic<bool> used[JSON_POOL_SIZE] = {};
+};
+
+/**
+ * JSON response written straight into a pooled buffer, and sent from there (no copy into
+ * a String). The buffer is returned to the pool when the response is destroyed.
+ *
+ * Other (binary) content types can be written directly into the buffer with content().
+ */
+class PooledJsonResponse : public AsyncAbstractResponse {
+
+public:
+
+  PooledJsonResponse(JsonBufferPool &pool, int code = 200, const char *contentType = "application/json")
+    : pool(pool), slot(pool.acquire()),
+      writer(slot >= 0 ? pool.get(slot) : NULL, slot >= 0 ? JSON_BUFFER_SIZE : 0) {
+
+      this->_code = code;
+      this->_contentType = contentType;
+  }
+
+  ~PooledJsonResponse() {
+    if (this->slot >= 0) {
+      this->pool.release(this->slot);
+    }
+  }
+
+  /** Got a buffer from the pool */
+  bool isValid() {
+    return this->slot >= 0;
+  }
+
+  /** JSON writer of the response body */
+  JsonWriter& json() {
+    return this->writer;
+  }
+
+  /** Done writing (sets the content length) */
+  void finish() {
+    this->_contentLength = this->writer.length();
+  }
+
+  /** Raw content buffer (JSON_BUFFER_SIZE bytes, instead of the JSON writer) */
+  uint8_t* content() {
+    return (uint8_t*) this->pool.get(this->slot);
+  }
+
+  /** Done writing raw content */
+  void finish(size_t len) {
+    this->writer = JsonWriter(this->pool.get(this->slot), JSON_BUFFER_SIZE);
+    this->writer.commit(len);
+    this->finish();
+  }
+
+  bool _sourceValid() const override {
+    return this->slot >= 0;
+  }
+
+  size_t _fillBuffer(uint8_t *buf, size_t maxLen) override {
+    size_t len = min(maxLen, this->writer.length() - this->sent);
+    memcpy(buf, this->writer.data() + this->sent, len);
+    this->sent += len;
+    return len;
+  }
+
+private:
+  JsonBufferPool &pool;
+  int8_t slot;
+  JsonWriter writer;
+  size_t sent = 0;
+};
+
+#endif
\ No newline at end of file
@@ -7,11 +7,14 @@
 #define LOAD_H
 
 #include <Arduino.h>
+#include "esp_timer.h"
 #include "dac.h"
 #include "adc.h"
 #include "fan.h"
 #include "hw.h"
 #include "calib.h"
+#include "protect.h"
+#include "snapshot.h"
 
 /** Main Electronic Load */
 class Load {
@@ -33,91 +36,222 @@ public:
     TRIPPED_OVER_POWER
   };
 
+  enum PowerState {
+    POWER_OFF,
+    POWER_ENABLING,
+    POWER_ON,
+    POWER_DISABLING
+  };
+
+  /** Measured values of a single ADC frame */
+  struct Measurement {
+    uint64_t timestampMicros;
+    uint32_t seq;
+    float voltage;
+    float voltage1;
+    float voltage2;
+    float current;
+    float current1;
+    float current2;
+    float power;
+    float temperature;
+  };
+
+  /** Consistent state of the Load (published by the control loop once per tick) */
+  struct State {
+    uint32_t version;
+    bool enabled;
+    Mode mode;
+    PowerState powerState;
+    ProtectState protectionState;
+    float setCurrent;
+    float setPower;
+    float setResistance;
+    float fanSpeed;
+    float overTemperatureLimit;
+    float overCurrentLimit;
+    float overVoltageLimit;
+    float overPowerLimit;
+    uint32_t fastTripLatencyMicros;
+    bool autoEnableDisableOnPower;
+    uint16_t autoEnableDelayMs;
+    uint16_t powerEnableSettleMs;
+    uint16_t powerDisableSettleMs;
+    Measurement measurement;
+  };
+
   /**
    * Instantiates the Electronic Load.
    */
-  Load(DAC &dac, ADC &adc, Fan &fan, uint8_t pwrEnPin)
-    : dac(dac), adc(adc), fan(fan), pwrEnPin(pwrEnPin),
-      enabled(false), mode(CONSTANT_CURRENT), current(0.0), power(0.0), resistance(10000000.0), fanSpeed(0.0) {
+  Load(DAC &dac, ADC &adc, Fan &fan, FastProtection &fastProtection, uint8_t pwrEnPin)
+    : dac(dac), adc(adc), fan(fan), fastProtection(fastProtection), pwrEnPin(pwrEnPin),
+      enabled(false), mode(CONSTANT_CURRENT), current(0.0), power(0.0), resistance(10000000.0), fanSpeed(0.0),
+      adcCursor(adc.samples) {
 
       digitalWrite(this->pwrEnPin, LOW);
   }
 
+  /**
+   * Initialize the Load (builds the ADC code to calibrated value lookup tables).
+   *
+   * Must be called after the hardware values are initialized. Returns false if the lookup
+   * tables could not be allocated (the Load must not be used).
+   */
+  bool begin() {
+    if (!this->voltageSense1Table.isAllocated() || !this->voltageSense2Table.isAllocated() || !this->currentSense1Table.isAllocated()
+        || !this->currentSense2Table.isAllocated() || !this->temperatureTable.isAllocated()) {
+      Serial.println("Calibration table allocation ERROR!");
+      return false;
+    }
+
+    this->adc.initCalibration();
+
+    for (uint16_t code = 0; code < CalibrationTable::SIZE; code++) {
+      float milliVolts = this->adc.toMilliVolts(code);
+
+      this->voltageSense1Table.set(code, this->voltageSense1Calibration.getCalibratedValue(milliVolts * HardwareValues::loadVoltageAdcMultiplier1));
+      this->voltageSense2Table.set(code, this->voltageSense2Calibration.getCalibratedValue(milliVolts * HardwareValues::loadVoltageAdcMultiplier2));
+      this->currentSense1Table.set(code, this->currentSense1Calibration.getCalibratedValue(milliVolts * HardwareValues::currentSenseAdcMultiplier));
+      this->currentSense2Table.set(code, this->currentSense2Calibration.getCalibratedValue(milliVolts * HardwareValues::currentSenseAdcMultiplier));
+      this->temperatureTable.set(code, this->thermistorTemperature(milliVolts));
+
+      if (milliVolts <= 2500.0) {
+        // the 1st division stage is not saturated bellow ~2.5V
+        this->voltageSense1MaxCode = code;
+      }
+    }
+
+    // the fast protection thresholds are searched in these (the temperature table is decreasing)
+    bool monotonic = this->voltageSense2Table.validate();
+    monotonic = this->currentSense1Table.validate() && monotonic;
+    monotonic = this->currentSense2Table.validate() && monotonic;
+    if (!monotonic) {
+      Serial.println("Calibration table not monotonic, using linear threshold search");
+    }
+
+    // setup the fast protection (needs the lookup tables)
+    this->fastProtection.begin();
+    this->updateFastProtection();
+    this->adc.setProtection(&this->fastProtection);
+
+    // initial state
+    this->publishState();
+    return true;
+  }
+
   void handle() {
     this->adc.handle();
 
-    if (this->adc.lastReadTimeMicros > this->lastAdcTimestamp) {
+    // fast protection tripped (in the ADC interrupt) => update the state
+    this->handleFastTrip();
+
+    // advance the power enable / disable state machine
+    this->handlePowerState();
+
+    SampleFrame frame;
+    if (this->adcCursor.readLatest(frame)) {
       // new ADC data available (this will run at ~4kHz rate)
 
+      // compute the measured values once per frame
+      Measurement measurement;
+      this->measure(frame, measurement);
+
       // adjust load current based on the operating mode
       if (this->mode == CONSTANT_POWER) {
-        this->adjustLoadCurrentForPower();
+        this->adjustLoadCurrentForPower(measurement);
 
       } else if (this->mode == CONSTANT_RESISTANCE) {
-        this->adjustLoadCurrentForResistance();
+        this->adjustLoadCurrentForResistance(measurement);
       }
 
       // check protections
-      this->checkProtections();
+      this->checkProtections(measurement);
 
       // handle auto-enable / disable
-      this->handleAutoEnableDisable();
+      this->handleAutoEnableDisable(measurement);
 
-      // save the last processed ADC timestamp
-      this->lastAdcTimestamp = this->adc.lastReadTimeMicros;
+      this->measurement = measurement;
     }
+
+    // publish the state (incl. the changes made by the commands of this tick)
+    this->publishState();
   }
 
-  /** Get the Load Voltage (in volts). */
-  float getLoadVoltage() {
-    // get the load voltage from the 1st division stage
-    uint16_t loadVoltageRaw1 = this->getLoadVoltage1Raw();
-    if (loadVoltageRaw1 <= 2500) {
+  /** Compute the measured values of an ADC frame (lookup tables only, any task) */
+  void measure(const SampleFrame &frame, Measurement &measurement) {
+    uint16_t loadVoltageRaw1 = frame.values[0];
+    uint16_t loadCurrentRaw1 = frame.values[1];
+    uint16_t loadCurrentRaw2 = frame.values[2];
+    uint16_t tempRaw = frame.values[3];
+    uint16_t loadVoltageRaw2 = frame.values[4];
+
+    measurement.timestampMicros = frame.timestampMicros;
+    measurement.seq = frame.seq;
+
+    measurement.voltage1 = this->voltageSense1Table.get(loadVoltageRaw1);
+    measurement.voltage2 = this->voltageSense2Table.get(loadVoltageRaw2);
+    if (loadVoltageRaw1 <= this->voltageSense1MaxCode) {
       // bellow ~2.5V threshold => use the 1st division stage
-      return getLoadVoltage1();
+      measurement.voltage = measurement.voltage1;
 
     } else {
       // above ~2.5V threshold the 1st division stage may be saturated => use the 2nd division stage
-      return getLoadVoltage2();
+      measurement.voltage = measurement.voltage2;
     }
+
+    measurement.current1 = this->currentSense1Table.get(loadCurrentRaw1);
+    if (HardwareValues::NR_CHANNELS <= 1.0) {
+      // ignore the 2nd channel (reduses noise when only 1 channel is used)
+      measurement.current2 = 0.0;
+    } else {
+      measurement.current2 = this->currentSense2Table.get(loadCurrentRaw2);
+    }
+    measurement.current = measurement.current1 + measurement.current2;
+
+    measurement.power = measurement.voltage * measurement.current;
+    measurement.temperature = this->temperatureTable.get(tempRaw);
+  }
+
+  /** Get a consistent copy of the latest published state (lock-free, any task) */
+  State getState() {
+    State state = {};
+    this->state.read(state);
+    return state;
+  }
+
+  /** Get the latest measurement (copy of the last processed ADC frame) */
+  Measurement getMeasurement() {
+    return this->getState().measurement;
+  }
+
+  /** Get the Load Voltage (in volts). */
+  float getLoadVoltage() {
+    return this->getMeasurement().voltage;
   }
 
   /** Get the lower range of load voltage (in volts). */
   float getLoadVoltage1() {
-    uint16_t loadVoltageRaw1 = this->getLoadVoltage1Raw();
-    float voltage = loadVoltageRaw1 * HardwareValues::loadVoltageAdcMultiplier1;
-    return this->voltageSense1Calibration.getCalibratedValue(voltage);
+    return this->getMeasurement().voltage1;
   }
 
   /** Get the upper range of load voltage (in volts). */
   float getLoadVoltage2() {
-    uint16_t loadVoltageRaw2 = this->getLoadVoltage2Raw();
-    float voltage = loadVoltageRaw2 * HardwareValues::loadVoltageAdcMultiplier2;
-    return this->voltageSense2Calibration.getCalibratedValue(voltage);
+    return this->getMeasurement().voltage2;
   }
 
   /** Get the full Load Current (in amps). */
   float getLoadCurrent() {
-    return this->getLoadCurrent1() + this->getLoadCurrent2();
+    return this->getMeasurement().current;
   }
 
   /** Get the Load Current on channel one (in amps). */
   float getLoadCurrent1() {
-    uint16_t loadCurrentRaw1 = this->adc.getMilliVolts(1);
-    float current = loadCurrentRaw1 * HardwareValues::currentSenseAdcMultiplier;
-    return this->currentSense1Calibration.getCalibratedValue(current);
+    return this->getMeasurement().current1;
   }
 
   /** Get the Load Current on channel two (in amps). */
   float getLoadCurrent2() {
-    if (HardwareValues::NR_CHANNELS <= 1.0) {
-      // ignore the 2nd channel (reduses noise when only 1 channel is used)
-      return 0.0;
-    }
-
-    uint16_t loadCurrentRaw2 = this->adc.getMilliVolts(2);
-    float current = loadCurrentRaw2 * HardwareValues::currentSenseAdcMultiplier;
-    return this->currentSense2Calibration.getCalibratedValue(current);
+    return this->getMeasurement().current2;
   }
 
   /** Enable / Disable the Load */
@@ -127,22 +261,16 @@ public:
       return true;
     }
 
-    if ((enabled) && (this->protectionState > OK_DISABLED)) {
+    if ((enabled) && this->isTripped()) {
       // cannot enable when in tripped state
       return false;
     }
 
     if (enabled) {
-      // TODO: move power enable into a separate method
-      digitalWrite(this->pwrEnPin, HIGH);
-      // TODO: make delay time configurable
-      delay(50);
+      this->powerEnable();
 
     } else {
-      // TODO: move power disable into a separate method
-      digitalWrite(this->pwrEnPin, LOW);
-      // TODO: make delay time configurable
-      delay(50);
+      this->powerDisable();
     }
 
     // save state
@@ -151,6 +279,38 @@ public:
     return true;
   }
 
+  /** Set the power stage enable settle time (in milliseconds) */
+  bool setPowerEnableSettleMs(uint16_t settleMs) {
+    this->powerEnableSettleMs = settleMs;
+    return true;
+  }
+
+  /** Set the power stage disable settle time (in milliseconds) */
+  bool setPowerDisableSettleMs(uint16_t settleMs) {
+    this->powerDisableSettleMs = settleMs;
+    return true;
+  }
+
+  /** Get the power stage enable settle time (in milliseconds) */
+  uint16_t getPowerEnableSettleMs() {
+    return this->powerEnableSettleMs;
+  }
+
+  /** Get the power stage disable settle time (in milliseconds) */
+  uint16_t getPowerDisableSettleMs() {
+    return this->powerDisableSettleMs;
+  }
+
+  /** Get the power stage state */
+  PowerState getPowerState() {
+    return this->powerState;
+  }
+
+  /** Is the power stage ready (enabled and settled) */
+  bool isPowerReady() {
+    return this->powerState == POWER_ON;
+  }
+
   /** Set operating mode */
   bool setMode(Mode mode) {
     if (this->mode == mode) {
@@ -185,9 +345,29 @@ public:
     return true;
   }
 
+  /** Valid set current (in amps) */
+  static bool isValidCurrent(float current) {
+    return (current >= 0.0) && (current <= HardwareValues::MAX_TOTAL_CURRENT);
+  }
+
+  /** Valid set power (in watts) */
+  static bool isValidPower(float power) {
+    return (power >= 0.0) && (power <= HardwareValues::MAX_TOTAL_POWER);
+  }
+
+  /** Valid set resistance (in ohms) */
+  static bool isValidResistance(float resistance) {
+    return resistance >= HardwareValues::MIN_TOTAL_RESISTANCE;
+  }
+
+  /** Valid fan speed (0.0 to 1.0) */
+  static bool isValidFanSpeed(float speed) {
+    return (speed >= 0.0) && (speed <= 1.0);
+  }
+
   /** Set the Load Current (in amps) */
   bool setCurrent(float current, bool checkMode = true) {
-    if ((current < 0.0) || (current > HardwareValues::MAX_TOTAL_CURRENT)) {
+    if (!isValidCurrent(current)) {
       // invalid set current value
       return false;
     }
@@ -197,7 +377,7 @@ public:
       return false;
     }
 
-    if ((current > 0.0) && (this->protectionState > OK_DISABLED)) {
+    if ((current > 0.0) && this->isTripped()) {
       // cannot set current when in tripped state
       return false;
     }
@@ -207,11 +387,19 @@ public:
       this->setEnabled(true);
     }
 
-    // set the DAC value
+    // set the DAC value (queued until the power stage is ready)
     uint16_t dacValue = current * HardwareValues::currentSetDacMultiplier;
-    this->dac.set(dacValue);
+    if ((this->powerState == POWER_ON) || (dacValue == 0)) {
+      // not written if the fast protection tripped meanwhile (see handleFastTrip())
+      this->fastProtection.setDac(dacValue);
+      this->dacValuePending = false;
 
-    if (current == 0.0) {
+    } else {
+      this->pendingDacValue = dacValue;
+      this->dacValuePending = true;
+    }
+
+    if ((current == 0.0) && !this->holdEnabled) {
       // auto-disable load when current is set to 0.0A (TODO: make this configurable)
       this->setEnabled(false);
     }
@@ -224,12 +412,12 @@ public:
 
   /** Set the Load Power (in watts) */
   bool setPower(float power) {
-    if ((power < 0.0) || (power > HardwareValues::MAX_TOTAL_POWER)) {
+    if (!isValidPower(power)) {
       // invalid set power value
       return false;
     }
 
-    if ((power > 0.0) && (this->protectionState > OK_DISABLED)) {
+    if ((power > 0.0) && this->isTripped()) {
       // cannot set power when in tripped state
       return false;
     }
@@ -243,14 +431,14 @@ public:
     this->power = power;
 
     // adjust the load current to maintain the set power
-    this->adjustLoadCurrentForPower();
+    this->adjustLoadCurrentForPower(this->measurement);
 
     return true;
   }
 
   /** Set the Resistance (in ohms) */
   bool setResistance(float resistance) {
-    if ((resistance < HardwareValues::MIN_TOTAL_RESISTANCE)) {
+    if (!isValidResistance(resistance)) {
       // invalid set resistance value
       return false;
     }
@@ -264,14 +452,14 @@ public:
     this->resistance = resistance;
 
     // adjust the load current to maintain the set resistance
-    this->adjustLoadCurrentForResistance();
+    this->adjustLoadCurrentForResistance(this->measurement);
 
     return true;
   }
 
   /** Set the Fan Speed (0.0 to 1.0) */
   bool setFanSpeed(float speed) {
-    if (speed < 0.0 || speed > 1.0) {
+    if (!isValidFanSpeed(speed)) {
       // invalid fan speed
       return false;
     }
@@ -287,41 +475,32 @@ public:
 
   /** Get Temperature (in Celsius). */
   float getTemperature() {
-    uint16_t tempMilliVolts = this->getTemperatureRaw();
-
-    // RT = R1 / (Vin / Vout - 1) = 10 kOhm / (3.3V / Vin - 1)
-    float rTherm = 10000.0 / (3300.0 / tempMilliVolts - 1.0);
-    float rThermLog = log(rTherm);
-
-    float tempK = 1 / (0.001129148 + (0.000234125 + (0.0000000876741 * rThermLog * rThermLog)) * rThermLog);
-    float tempC = tempK - 273.15;
-
-    return tempC;
+    return this->getMeasurement().temperature;
   }
 
-  /** Get the raw Load Voltage reading at the 1st division stage (in millivolts) */
+  /** Get the raw Load Voltage reading at the 1st division stage (raw ADC code) */
   uint16_t getLoadVoltage1Raw() {
-    return this->adc.getMilliVolts(0);
+    return this->adc.getRaw(0);
   }
 
-  /** Get the raw Load Voltage reading at the 2nd division stage (in millivolts) */
+  /** Get the raw Load Voltage reading at the 2nd division stage (raw ADC code) */
   uint16_t getLoadVoltage2Raw() {
-    return this->adc.getMilliVolts(4);
+    return this->adc.getRaw(4);
   }
 
-  /** Get the raw Load Current reading (in millivolts) */
+  /** Get the raw Load Current reading (raw ADC code) */
   uint16_t getLoadCurrentRaw1() {
-    return this->adc.getMilliVolts(1);
+    return this->adc.getRaw(1);
   }
 
-  /** Get the raw Load Current reading (in millivolts) */
+  /** Get the raw Load Current reading (raw ADC code) */
   uint16_t getLoadCurrentRaw2() {
-    return this->adc.getMilliVolts(2);
+    return this->adc.getRaw(2);
   }
 
-  /** Get the raw Temperature reading (in millivolts) */
+  /** Get the raw Temperature reading (raw ADC code) */
   uint16_t getTemperatureRaw() {
-    return this->adc.getMilliVolts(3);
+    return this->adc.getRaw(3);
   }
 
   /** Get Enabled state */
@@ -359,6 +538,41 @@ public:
     return this->protectionState;
   }
 
+  /** Tripped (normal or fast protection) */
+  bool isTripped() {
+    return (this->protectionState > OK_DISABLED) || this->fastProtection.isTripped();
+  }
+
+  /**
+   * Output writes of the shaper / dynamic load: the DAC is written unless the fast protection
+   * tripped, checked under its lock (a trip can not be overwritten). Return false if not written.
+   */
+  bool setDac(uint16_t value) {
+    return this->fastProtection.setDac(value);
+  }
+
+  bool setDacPreset(uint16_t preset) {
+    return this->fastProtection.setDacPreset(preset);
+  }
+
+  bool ARDUINO_ISR_ATTR setDacFromISR(uint16_t value) {
+    return this->fastProtection.setDacFromISR(value);
+  }
+
+  bool ARDUINO_ISR_ATTR setDacPresetFromISR(uint16_t preset) {
+    return this->fastProtection.setDacPresetFromISR(preset);
+  }
+
+  /** Get the time of the current fast protection trip (in microseconds, 0 if not fast tripped) */
+  uint64_t getFastTripTimestampMicros() {
+    return this->fastProtection.isTripped() ? this->fastProtection.getTripTimestampMicros() : 0;
+  }
+
+  /** Get the latency of the last fast protection trip (in microseconds) */
+  uint32_t getFastTripLatencyMicros() {
+    return this->fastProtection.getTripLatencyMicros();
+  }
+
   /** Set over temperature limit */
   bool setOverTemperatureLimit(float temp) {
     if (temp < 0.0) {
@@ -378,6 +592,7 @@ public:
     }
 
     this->overCurrentA = current;
+    this->updateFastProtection();
     return true;
   }
 
@@ -389,6 +604,7 @@ public:
     }
 
     this->overVoltageV = voltage;
+    this->updateFastProtection();
     return true;
   }
 
@@ -426,6 +642,8 @@ public:
   /** Reset tripped protections */
   bool resetProtections() {
     this->protectionState = OK;
+    this->fastProtection.reset();
+    this->updateFastProtection();
     return true;
   }
 
@@ -437,10 +655,19 @@ public:
     }
 
     this->protectionState = enable ? OK : OK_DISABLED;
+    this->updateFastProtection();
 
     return true;
   }
 
+  /**
+   * Keep the load enabled on a zero set point (control loop only, used by the sequencer: zero
+   * set point steps and mode changes would otherwise disable the power stage).
+   */
+  void setHoldEnabled(bool hold) {
+    this->holdEnabled = hold;
+  }
+
   /** Enable / disable power detection */
   bool setAutoEnableDisableOnPower(bool enable) {
     this->autoEnableDisableOnPower = enable;
@@ -467,6 +694,7 @@ private:
   DAC &dac;
   ADC &adc;
   Fan &fan;
+  FastProtection &fastProtection;
   const uint8_t pwrEnPin;
 
   /* State: */
@@ -504,12 +732,37 @@ private:
   /** Protection state */
   ProtectState protectionState = OK;
 
-  /** Last ADC timestamp processed */
-  uint64_t lastAdcTimestamp = 0;
+  /** Power stage state */
+  PowerState powerState = POWER_OFF;
+
+  /** Power stage state change timestamp (esp_timer, does not wrap) */
+  uint64_t powerStateChangeMicros = 0;
+
+  /** Power stage enable settle time (50ms) */
+  uint16_t powerEnableSettleMs = 50;
+
+  /** Power stage disable settle time (50ms) */
+  uint16_t powerDisableSettleMs = 50;
+
+  /** DAC value waiting for the power stage to be ready */
+  uint16_t pendingDacValue = 0;
+  bool dacValuePending = false;
+
+  /** ADC sample read cursor (only the latest frame is processed) */
+  SampleBuffer::Cursor adcCursor;
+
+  /** Latest measurement (control loop only) */
+  Measurement measurement = {};
+
+  /** Published state (read by the other tasks) */
+  Snapshot<State> state;
 
   /** Auto-detect (/enable /disable) load when power is connected */
   bool autoEnableDisableOnPower = true;
 
+  /** No auto-disable on a zero set point (see setHoldEnabled()) */
+  bool holdEnabled = false;
+
   /** Auto-enable delay (3s) */
   uint16_t autoEnableDelayMs = 3000;
 
@@ -528,9 +781,167 @@ private:
   /** Current sense calibration (channel 2) */
   Calibration currentSense2Calibration = Calibration(HardwareValues::CURRENT_SENSE_2_CALIBRATION, sizeof(HardwareValues::CURRENT_SENSE_2_CALIBRATION) / sizeof(HardwareValues::CURRENT_SENSE_2_CALIBRATION[0]));
 
+  /** Lookup tables: raw ADC code to calibrated value (built by begin()) */
+  CalibrationTable voltageSense1Table;
+  CalibrationTable voltageSense2Table;
+  CalibrationTable currentSense1Table;
+  CalibrationTable currentSense2Table;
+  CalibrationTable temperatureTable;
+
+  /** Max raw code of the 1st voltage division stage (above it may be saturated) */
+  uint16_t voltageSense1MaxCode = 0;
+
+  /**
+   * Handle a fast protection trip (first thing of each control loop tick).
+   *
+   * The load current and the power stage were already disabled from the ADC interrupt,
+   * this only updates the state of the Load.
+   */
+  void handleFastTrip() {
+    if (!this->fastProtection.isTripped() || (this->protectionState > OK_DISABLED)) {
+      // not tripped, or already handled
+      return;
+    }
+
+    this->dac.set(0);
+    this->dacValuePending = false;
+    this->current = 0.0;
+    this->power = 0.0;
+    this->resistance = 10000000.0;
+    this->enabled = false;
+    this->powerState = POWER_OFF;
+
+    switch (this->fastProtection.getTrip()) {
+      case FastProtection::OVER_VOLTAGE:
+        this->protectionState = TRIPPED_OVER_VOLTAGE;
+        break;
+      default:
+        this->protectionState = TRIPPED_OVER_CURRENT;
+        break;
+    }
+  }
+
+  /** Enable the power stage (the DAC value is applied once settled) */
+  void powerEnable() {
+    this->fastProtection.enablePower();
+    this->powerState = POWER_ENABLING;
+    this->powerStateChangeMicros = esp_timer_get_time();
+  }
+
+  /** Disable the power stage */
+  void powerDisable() {
+    digitalWrite(this->pwrEnPin, LOW);
+    this->powerState = POWER_DISABLING;
+    this->powerStateChangeMicros = esp_timer_get_time();
+  }
+
+  /** Power enable / disable state machine (non-blocking) */
+  void handlePowerState() {
+    if ((this->powerState != POWER_ENABLING) && (this->powerState != POWER_DISABLING)) {
+      // stable state
+      return;
+    }
+
+    uint64_t elapsedMicros = esp_timer_get_time() - this->powerStateChangeMicros;
+
+    if (this->powerState == POWER_ENABLING) {
+      if (elapsedMicros >= (uint64_t) this->powerEnableSettleMs * 1000) {
+        this->powerState = POWER_ON;
+
+        // apply the queued set point
+        if (this->dacValuePending) {
+          this->fastProtection.setDac(this->pendingDacValue);
+          this->dacValuePending = false;
+        }
+      }
+
+    } else {
+      if (elapsedMicros >= (uint64_t) this->powerDisableSettleMs * 1000) {
+        this->powerState = POWER_OFF;
+      }
+    }
+  }
+
+  /** Publish the current state */
+  void publishState() {
+    State state;
+    state.version = this->state.nextVersion();
+    state.enabled = this->enabled;
+    state.mode = this->mode;
+    state.powerState = this->powerState;
+    state.protectionState = this->protectionState;
+    state.setCurrent = this->current;
+    state.setPower = this->power;
+    state.setResistance = this->resistance;
+    state.fanSpeed = this->fanSpeed;
+    state.overTemperatureLimit = this->overTempC;
+    state.overCurrentLimit = this->overCurrentA;
+    state.overVoltageLimit = this->overVoltageV;
+    state.overPowerLimit = this->overPowerW;
+    state.fastTripLatencyMicros = this->fastProtection.getTripLatencyMicros();
+    state.autoEnableDisableOnPower = this->autoEnableDisableOnPower;
+    state.autoEnableDelayMs = this->autoEnableDelayMs;
+    state.powerEnableSettleMs = this->powerEnableSettleMs;
+    state.powerDisableSettleMs = this->powerDisableSettleMs;
+    state.measurement = this->measurement;
+
+    this->state.publish(state);
+  }
+
+  /** Over current margin of the fast protection (per channel, relative to an equal current split) */
+  static constexpr float FAST_PROTECTION_CURRENT_MARGIN = 1.1;
+
+  /**
+   * Update the raw ADC code thresholds of the fast protection.
+   *
+   * Over voltage is checked on the 2nd (upper range) division stage. Over current is checked
+   * per channel, assuming an equal split of the current, with some margin, as a backup
+   * of the (exact) over current check of the control loop.
+   */
+  void updateFastProtection() {
+    this->fastProtection.setArmed(false);
+
+    uint16_t overVoltageCode = FastProtection::THRESHOLD_DISABLED;
+    if (this->overVoltageV > 0.0) {
+      overVoltageCode = this->voltageSense2Table.findCode(this->overVoltageV);
+    }
+
+    uint16_t overCurrentCode1 = FastProtection::THRESHOLD_DISABLED;
+    uint16_t overCurrentCode2 = FastProtection::THRESHOLD_DISABLED;
+    if (this->overCurrentA > 0.0) {
+      float channelLimit = this->overCurrentA / HardwareValues::NR_CHANNELS * FAST_PROTECTION_CURRENT_MARGIN;
+      overCurrentCode1 = this->currentSense1Table.findCode(channelLimit);
+      if (HardwareValues::NR_CHANNELS > 1.0) {
+        overCurrentCode2 = this->currentSense2Table.findCode(channelLimit);
+      }
+    }
+
+    // codes above the ADC range (limit not reachable) disable the check
+    this->fastProtection.setThreshold(4, overVoltageCode < CalibrationTable::SIZE ? overVoltageCode : FastProtection::THRESHOLD_DISABLED, FastProtection::OVER_VOLTAGE);
+    this->fastProtection.setThreshold(1, overCurrentCode1 < CalibrationTable::SIZE ? overCurrentCode1 : FastProtection::THRESHOLD_DISABLED, FastProtection::OVER_CURRENT);
+    this->fastProtection.setThreshold(2, overCurrentCode2 < CalibrationTable::SIZE ? overCurrentCode2 : FastProtection::THRESHOLD_DISABLED, FastProtection::OVER_CURRENT);
+
+    this->fastProtection.setArmed(this->protectionState == OK);
+  }
+
+  /** Thermistor temperature (in Celsius) from the measured voltage (in millivolts) */
+  float thermistorTemperature(float tempMilliVolts) {
+    // keep the thermistor resistance finite
+    tempMilliVolts = constrain(tempMilliVolts, 1.0, 3299.0);
+
+    // RT = R1 / (Vin / Vout - 1) = 10 kOhm / (3.3V / Vin - 1)
+    float rTherm = 10000.0 / (3300.0 / tempMilliVolts - 1.0);
+    float rThermLog = log(rTherm);
+
+    float tempK = 1 / (0.001129148 + (0.000234125 + (0.0000000876741 * rThermLog * rThermLog)) * rThermLog);
+    float tempC = tempK - 273.15;
+
+    return tempC;
+  }
+
   /** Adjust Load Current to maintain the set Power */
-  void adjustLoadCurrentForPower() {
-    float voltage = this->getLoadVoltage();
+  void adjustLoadCurrentForPower(const Measurement &measurement) {
+    float voltage = measurement.voltage;
     if (voltage > 0.0) {
       float setCurrent = this->power / voltage;
       this->setCurrent(setCurrent, false);
@@ -538,14 +949,14 @@ private:
   }
 
   /** Adjust Load Current to maintain the set Resistance */
-  void adjustLoadCurrentForResistance() {
-    float voltage = this->getLoadVoltage();
+  void adjustLoadCurrentForResistance(const Measurement &measurement) {
+    float voltage = measurement.voltage;
     float setCurrent = voltage / this->resistance;
     this->setCurrent(setCurrent, false);
   }
 
   /** Check protections */
-  void checkProtections() {
+  void checkProtections(const Measurement &measurement) {
     if (this->protectionState != OK) {
       // already tripped or disabled
       return;
@@ -553,7 +964,7 @@ private:
 
     // over temperature
     if (this->overTempC > 0.0) {
-      float temperature = this->getTemperature();
+      float temperature = measurement.temperature;
       if (temperature >= this->overTempC) {
         tripped(TRIPPED_OVER_TEMPERATURE);
         return;
@@ -562,7 +973,7 @@ private:
 
     // over voltage
     if (this->overVoltageV > 0.0) {
-      float voltage = this->getLoadVoltage();
+      float voltage = measurement.voltage;
       if (voltage >= this->overVoltageV) {
         tripped(TRIPPED_OVER_VOLTAGE);
         return;
@@ -571,7 +982,7 @@ private:
 
     // over current
     if (this->overCurrentA > 0.0) {
-      float current = this->getLoadCurrent();
+      float current = measurement.current;
       if (current >= this->overCurrentA) {
         tripped(TRIPPED_OVER_CURRENT);
         return;
@@ -580,9 +991,7 @@ private:
 
     // over power
     if (this->overPowerW > 0.0) {
-      float voltage = this->getLoadVoltage();
-      float current = this->getLoadCurrent();
-      float power = voltage * current;
+      float power = measurement.power;
       if (power >= this->overPowerW) {
         tripped(TRIPPED_OVER_POWER);
         return;
@@ -605,12 +1014,12 @@ private:
   }
 
   /** Auto enable / disable */
-  void handleAutoEnableDisable() {
+  void handleAutoEnableDisable(const Measurement &measurement) {
     if (!this->autoEnableDisableOnPower) {
       return;
     }
 
-    float voltage = this->getLoadVoltage();
+    float voltage = measurement.voltage;
 
     // enable load when power is connected (>=1.0V)
     if (!this->enabled && (voltage >= 1.0)) {
@@ -14,11 +14,19 @@
 #include "fan.h"
 #include "load.h"
 #include "web.h"
+#include "telemetry.h"
 #include "wifi.h"
 #include "ota.h"
 #include "srv.h"
 #include "hw.h"
 #include "shaper.h"
+#include "dynamic.h"
+#include "capture.h"
+#include "sequencer.h"
+#include "control.h"
+#include "commands.h"
+#include "scpiport.h"
+#include "stream.h"
 
 /* Pin Configuration */
 
@@ -79,21 +87,41 @@ const uint8_t ADC_PINS[] = {
   VOLTAGE_SENSE_PIN_1, CURRENT_SENSE_PIN_1, CURRENT_SENSE_PIN_2, TEMP_SENSE_PIN, VOLTAGE_SENSE_PIN_2
 };
 
-DAC dac(NR_DAC_PINS, DAC_PINS, 8);
+DAC dac(NR_DAC_PINS, DAC_PINS, HardwareValues::DAC_NR_PRESETS);
 
 ADC adc(NR_ADC_PINS, ADC_PINS);
 
 Fan fan(FAN_PIN, 255);
 
-Load load(dac, adc, fan, LOAD_PWR_EN_PIN);
+FastProtection fastProtection(dac, LOAD_PWR_EN_PIN, HardwareValues::DAC_PRESET_ZERO);
 
-Shaper shaper(load, 256);
+Load load(dac, adc, fan, fastProtection, LOAD_PWR_EN_PIN);
+
+Shaper shaper(load, dac, SHAPER_MAX_STEPS);
+
+DynamicLoad dynamicLoad(load, dac);
+
+Sequencer sequencer(load);
+
+Capture capture(adc.samples, load);
+
+CommandQueue commands;
+
+EventLog events;
+
+ControlLoop controlLoop(adc, load, shaper, dynamicLoad, sequencer, capture, events, commands);
 
 Wireless wifi;
 
-Service srv(dac, adc);
+Service srv(dac, adc, controlLoop);
+
+Telemetry telemetry(load);
+
+WebServer webServer(80, load, adc.samples, shaper, dynamicLoad, sequencer, capture, telemetry, events, commands, srv);
+
+ScpiPort scpiPort(load, commands);
 
-WebServer webServer(80, load, shaper, srv);
+SampleStream sampleStream(adc.samples);
 
 OTA ota;
 
@@ -101,26 +129,24 @@ OTA ota;
 
 volatile uint8_t restartRequest = 0;
 bool progMode = false;
+bool loadReady = false;
 
 // Global mutex
 portMUX_TYPE mutex = portMUX_INITIALIZER_UNLOCKED;
 
-/** Control loop task (priority=2) */
+/** Control loop task (priority=4, woken up by the ADC on each new frame) */
 void controlLoopTask(void *pvParameters) {
   Serial.println("Control loop task started.");
 
   // begin ADC readings
-  adc.begin();
+  controlLoop.begin();
 
   while (true) {
-    for (uint64_t idx = 0; idx < 10000; idx++) {
-      load.handle();
-      shaper.handle();
+    // wait for the next ADC frame and process it
+    controlLoop.handle();
 
-      // GPIO.out_w1tc = ((uint32_t) 1 << LED_PIN);
-      // GPIO.out_w1tc = ((uint32_t) 1 << LED_PIN);
-      // GPIO.out_w1ts = ((uint32_t) 1 << LED_PIN);
-    }
+    // GPIO.out_w1tc = ((uint32_t) 1 << LED_PIN);
+    // GPIO.out_w1ts = ((uint32_t) 1 << LED_PIN);
 
     if (restartRequest > 0) {
       taskENTER_CRITICAL(&mutex);
@@ -142,33 +168,26 @@ void controlLoopTask(void *pvParameters) {
       taskEXIT_CRITICAL(&mutex);
       return;
     }
-
-    // TODO: why was a 1s delay here?
-    //vTaskDelay(50 / portTICK_PERIOD_MS);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-
-    // let other tasks run
-    taskYIELD();
   }
 }
 
-/** Critical control loop task (priority=10) */
-void criticalControlLoopTask(void *pvParameters) {
-  Serial.println("Critical control loop task started.");
+/** Sample stream task (priority=2, polls the sample buffer every tick) */
+void sampleStreamTask(void *pvParameters) {
+  Serial.println("Sample stream task started.");
 
   while (true) {
-    // note: this will only run on request
+    // send the new frames (while the port is open)
+    sampleStream.handle();
 
-    // sleep for now
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    vTaskDelay(1);
   }
 }
 
 /** Control loop task handle */
 TaskHandle_t controlLoopTaskHandle;
 
-/** Critical control loop task handle */
-TaskHandle_t criticalControlLoopTaskHandle;
+/** Sample stream task handle */
+TaskHandle_t sampleStreamTaskHandle;
 
 void setup() {
   HardwareValues::init();
@@ -185,6 +204,9 @@ void setup() {
 
   fan.set(0.00);
 
+  // build the ADC calibration lookup tables
+  loadReady = load.begin();
+
   for (auto nr = 0; nr < NR_DAC_PINS; nr++) {
     pinMode(DAC_PINS[nr], OUTPUT);
   }
@@ -216,19 +238,18 @@ void setup() {
   // start WiFi
   wifi.begin();
 
-  // Initialize LittleFS
+  // Initialize LittleFS (optional: the web UI is embedded into the firmware)
   if (!LittleFS.begin()) {
-    Serial.println("Failed to mount LittleFS");
-    return;
-  }
-
-  Serial.println("Content:");
-  File dir = LittleFS.open("/");
-  File file = dir.openNextFile();
-  char buf[1024];
-  while (file) {
-     Serial.println(file.name());
-     file = dir.openNextFile();
+    Serial.println("Failed to mount LittleFS, continuing without it");
+
+  } else {
+    Serial.println("Content:");
+    File dir = LittleFS.open("/");
+    File file = dir.openNextFile();
+    while (file) {
+       Serial.println(file.name());
+       file = dir.openNextFile();
+    }
   }
 
   // start the web server
@@ -239,20 +260,27 @@ void setup() {
     return;
   }
 
+  if (!loadReady) {
+    // no lookup tables => no control loop (the load stays off)
+    Serial.println("Load initialization FAILED, control loop not started!");
+    return;
+  }
+
   // create control loop task
-  Serial.println("Creating control loop and critical control loop tasks...");
+  Serial.println("Creating control loop task...");
 
   // wrap task creation in a critical section
   taskENTER_CRITICAL(&mutex);
 
-  // create control loop task
-  auto retval = xTaskCreate(
+  // create control loop task (pinned to the core not running WiFi / AsyncTCP)
+  auto retval = xTaskCreatePinnedToCore(
       controlLoopTask,        // Task function
       "ControlLoopTask",      // Name of the task
-      2048,                   // Stack size
+      4096,                   // Stack size
       NULL,                   // Task parameter
-      1,                      // Priority (higher than loop()'s priority 1)
-      &controlLoopTaskHandle  // Task handle
+      4,                      // Priority (higher than loop()'s priority 1)
+      &controlLoopTaskHandle, // Task handle
+      CONTROL_LOOP_CORE       // Core
   );
 
   if (retval != pdPASS) {
@@ -260,21 +288,6 @@ void setup() {
     return;
   }
 
-  // create critical control loop task
-  retval = xTaskCreate(
-      criticalControlLoopTask,        // Task function
-      "CriticalControlLoopTask",      // Name of the task
-      2048,                           // Stack size
-      NULL,                           // Task parameter
-      5,                              // Priority (higher than loop()'s priority 1)
-      &criticalControlLoopTaskHandle  // Task handle
-  );
-
-  if (retval != pdPASS) {
-    Serial.println("Creation of critical control loop task FAILED!");
-    return;
-  }
-
   // end of critical section
   taskEXIT_CRITICAL(&mutex);
 
@@ -282,6 +295,34 @@ void setup() {
     TinyUSBDevice.begin(0);
   }
 
+  // SCPI interface (second CDC port)
+  scpiPort.begin();
+
+  // raw sample stream (third CDC port)
+  sampleStream.begin();
+
+  if (TinyUSBDevice.mounted()) {
+    // re-enumerate, to make the new interfaces visible
+    TinyUSBDevice.detach();
+    delay(10);
+    TinyUSBDevice.attach();
+  }
+
+  // create sample stream task (below the control loop task, above loop())
+  retval = xTaskCreatePinnedToCore(
+      sampleStreamTask,        // Task function
+      "SampleStreamTask",      // Name of the task
+      4096,                    // Stack size
+      NULL,                    // Task parameter
+      2,                       // Priority (higher than loop()'s priority 1)
+      &sampleStreamTaskHandle, // Task handle
+      STREAM_CORE              // Core
+  );
+
+  if (retval != pdPASS) {
+    Serial.println("Creation of sample stream task FAILED!");
+  }
+
 }
 
 void loop() {
@@ -289,4 +330,14 @@ void loop() {
     ota.handle();
   }
 
+  // push the telemetry messages (rate limited per client)
+  telemetry.handle();
+
+  // answer the event waits (matching event or timeout)
+  webServer.handle();
+
+  // execute the SCPI commands (USB)
+  scpiPort.handle();
+
+  delay(1);
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef MEASUREMENTS_H
+#define MEASUREMENTS_H
+
+#include <Arduino.h>
+#include "load.h"
+
+/**
+ * Combined measurements packed format (GET /api/measurements, little endian, 64 bytes):
+ *
+ *   uint16_t version             1
+ *   uint16_t size                64
+ *   uint32_t seq                 ADC frame sequence number
+ *   uint64_t timestampMicros     ADC frame timestamp
+ *   float    voltage, voltage1, voltage2              (in volts)
+ *   float    current, current1, current2              (in amps)
+ *   float    power                                    (in watts)
+ *   float    temperature                              (in celsius)
+ *   float    setCurrent, setPower, setResistance      (set points)
+ *   uint8_t  enabled
+ *   uint8_t  mode                (Load::Mode)
+ *   uint8_t  powerState          (Load::PowerState)
+ *   uint8_t  protectionState     (Load::ProtectState)
+ *
+ * The JSON and CBOR formats contain the same fields (by name, enums as strings).
+ */
+const uint16_t MEASUREMENTS_VERSION = 1;
+
+struct __attribute__((packed)) MeasurementsPacket {
+  uint16_t version;
+  uint16_t size;
+  uint32_t seq;
+  uint64_t timestampMicros;
+  float voltage;
+  float voltage1;
+  float voltage2;
+  float current;
+  float current1;
+  float current2;
+  float power;
+  float temperature;
+  float setCurrent;
+  float setPower;
+  float setResistance;
+  uint8_t enabled;
+  uint8_t mode;
+  uint8_t powerState;
+  uint8_t protectionState;
+
+  /** Pack a (consistent) state snapshot */
+  static MeasurementsPacket of(const Load::State &state) {
+    const Load::Measurement &measurement = state.measurement;
+
+    MeasurementsPacket packet;
+    packet.version = MEASUREMENTS_VERSION;
+    packet.size = sizeof(MeasurementsPacket);
+    packet.seq = measurement.seq;
+    packet.timestampMicros = measurement.timestampMicros;
+    packet.voltage = measurement.voltage;
+    packet.voltage1 = measurement.voltage1;
+    packet.voltage2 = measurement.voltage2;
+    packet.current = measurement.current;
+    packet.current1 = measurement.current1;
+    packet.current2 = measurement.current2;
+    packet.power = measurement.power;
+    packet.temperature = measurement.temperature;
+    packet.setCurrent = state.setCurrent;
+    packet.setPower = state.setPower;
+    packet.setResistance = state.setResistance;
+    packet.enabled = state.enabled;
+    packet.mode = state.mode;
+    packet.powerState = state.powerState;
+    packet.protectionState = state.protectionState;
+    return packet;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <Arduino.h>
+#include "load.h"
+#include "hw.h"
+
+/** Max number of compiled instructions (steps, LOOP / END) */
+const uint8_t PROGRAM_MAX_INSTRUCTIONS = 64;
+
+/** Max number of global abort conditions */
+const uint8_t PROGRAM_MAX_ABORTS = 4;
+
+/** Max loop nesting */
+const uint8_t PROGRAM_MAX_LOOP_DEPTH = 4;
+
+/** Max source line length */
+const uint8_t PROGRAM_MAX_LINE = 96;
+
+/** Condition on a measured value (ex. "V < 3.0") */
+struct ProgramCondition {
+
+  enum Quantity : uint8_t {
+    NONE,
+    VOLTAGE,
+    CURRENT,
+    POWER,
+    TEMPERATURE
+  };
+
+  Quantity quantity;
+  bool greater;     // true: value > threshold, false: value < threshold
+  float threshold;
+};
+
+/** Compiled instruction (fixed size) */
+struct ProgramInstruction {
+
+  enum Op : uint8_t {
+    STEP,
+    LOOP,
+    END
+  };
+
+  Op op;
+  Load::Mode mode;          // STEP: operating mode
+  uint16_t arg;             // LOOP: repeat count (0 = forever), END: index of the LOOP
+  float value;              // STEP: set point (A / W / ohm)
+  uint32_t durationMs;      // STEP: max duration (0 = no time limit)
+  ProgramCondition until;   // STEP: exit condition (optional)
+};
+
+/** Compiled program */
+struct Program {
+  ProgramInstruction instructions[PROGRAM_MAX_INSTRUCTIONS];
+  uint8_t nrInstructions;
+  ProgramCondition aborts[PROGRAM_MAX_ABORTS];
+  uint8_t nrAborts;
+};
+
+/**
+ * Streaming sequencer program compiler.
+ *
+ * Compiles a line based text program, chunk by chunk (lines may be split between chunks),
+ * into fixed size instructions. Everything is validated, so the sequencer does not need
+ * to check anything at run time.
+ *
+ * Syntax (one statement per line, case insensitive, '#' starts a comment):
+ *
+ *   CC|CP|CR <value> [FOR <duration>] [UNTIL <V|I|P|T> <|> <threshold>]
+ *   LOOP [<count>]            (no count = forever)
+ *   END
+ *   ABORT <V|I|P|T> <|> <threshold>
+ *
+ *   duration: <number>[ms|s|m|h], ex. "500ms", "10m" (default: seconds)
+ *
+ * Example:
+ *
+ *   ABORT T > 60
+ *   LOOP 5
+ *     CC 2.0 UNTIL V < 3.0
+ *     CC 0.5 FOR 10m
+ *   END
+ */
+class ProgramCompiler {
+
+public:
+
+  enum Error {
+    NONE,
+    SYNTAX,
+    INVALID_VALUE,
+    LINE_TOO_LONG,
+    TOO_MANY_INSTRUCTIONS,
+    TOO_MANY_ABORTS,
+    UNBALANCED_LOOP,
+    EMPTY_LOOP,
+    EMPTY
+  };
+
+  /** Start compiling a new program into the given destination */
+  void begin(Program *program) {
+    this->program = program;
+    this->program->nrInstructions = 0;
+    this->program->nrAborts = 0;
+
+    this->lineLen = 0;
+    this->lineNr = 0;
+    this->loopDepth = 0;
+    this->error = NONE;
+  }
+
+  /** Compile the next chunk. Returns false on error. */
+  bool feed(const uint8_t *data, size_t len) {
+    for (size_t idx = 0; (idx < len) && (this->error == NONE); idx++) {
+      char c = data[idx];
+      if (c == '\n') {
+        this->compileLine();
+        continue;
+      }
+
+      if (this->lineLen >= PROGRAM_MAX_LINE) {
+        this->lineNr++;
+        this->error = LINE_TOO_LONG;
+        break;
+      }
+
+      this->line[this->lineLen++] = c;
+    }
+
+    return this->error == NONE;
+  }
+
+  /** Finish compiling. Returns false if the program is invalid. */
+  bool end() {
+    if ((this->error == NONE) && (this->lineLen > 0)) {
+      // last line without a new line
+      this->compileLine();
+    }
+
+    if ((this->error == NONE) && (this->loopDepth > 0)) {
+      this->error = UNBALANCED_LOOP;
+    }
+
+    if ((this->error == NONE) && (this->program->nrInstructions == 0)) {
+      this->error = EMPTY;
+    }
+
+    return this->error == NONE;
+  }
+
+  Error getError() {
+    return this->error;
+  }
+
+  /** Line of the error (1-based) */
+  uint16_t getLineNr() {
+    return this->lineNr;
+  }
+
+private:
+  Program *program = NULL;
+
+  char line[PROGRAM_MAX_LINE + 1];
+  uint8_t lineLen = 0;
+  uint16_t lineNr = 0;
+
+  /** Tokens of the line (every character may be followed by a separator) */
+  char tokenBuffer[2 * PROGRAM_MAX_LINE + 1];
+
+  /** Open loops: index of the LOOP instruction and number of steps in the body */
+  uint8_t loopIdx[PROGRAM_MAX_LOOP_DEPTH];
+  uint8_t loopSteps[PROGRAM_MAX_LOOP_DEPTH];
+  uint8_t loopDepth = 0;
+
+  Error error = NONE;
+
+  /** Max number of tokens of a statement */
+  static const uint8_t MAX_TOKENS = 12;
+
+  /** Compile the buffered line */
+  void compileLine() {
+    this->line[this->lineLen] = '\0';
+    this->lineLen = 0;
+    this->lineNr++;
+
+    // comment
+    char *comment = strchr(this->line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+
+    char *tokens[MAX_TOKENS];
+    uint8_t nrTokens = this->tokenize(this->line, tokens);
+    if (nrTokens == 0) {
+      // empty line
+      return;
+    }
+
+    if (nrTokens > MAX_TOKENS) {
+      this->error = SYNTAX;
+      return;
+    }
+
+    if ((strcmp(tokens[0], "CC") == 0) || (strcmp(tokens[0], "CP") == 0) || (strcmp(tokens[0], "CR") == 0)) {
+      this->compileStep(tokens, nrTokens);
+
+    } else if (strcmp(tokens[0], "LOOP") == 0) {
+      this->compileLoop(tokens, nrTokens);
+
+    } else if ((strcmp(tokens[0], "END") == 0) && (nrTokens == 1)) {
+      this->compileEnd();
+
+    } else if (strcmp(tokens[0], "ABORT") == 0) {
+      if (this->program->nrAborts >= PROGRAM_MAX_ABORTS) {
+        this->error = TOO_MANY_ABORTS;
+        return;
+      }
+
+      if ((nrTokens != 4) || !this->parseCondition(tokens + 1, this->program->aborts[this->program->nrAborts])) {
+        this->error = SYNTAX;
+        return;
+      }
+      this->program->nrAborts++;
+
+    } else {
+      this->error = SYNTAX;
+    }
+  }
+
+  /** CC|CP|CR <value> [FOR <duration>] [UNTIL <condition>] */
+  void compileStep(char **tokens, uint8_t nrTokens) {
+    ProgramInstruction instruction = {};
+    instruction.op = ProgramInstruction::STEP;
+    instruction.until.quantity = ProgramCondition::NONE;
+
+    float maxValue = 0.0;
+    if (tokens[0][1] == 'C') {
+      instruction.mode = Load::CONSTANT_CURRENT;
+      maxValue = HardwareValues::MAX_TOTAL_CURRENT;
+    } else if (tokens[0][1] == 'P') {
+      instruction.mode = Load::CONSTANT_POWER;
+      maxValue = HardwareValues::MAX_TOTAL_POWER;
+    } else {
+      instruction.mode = Load::CONSTANT_RESISTANCE;
+    }
+
+    if ((nrTokens < 2) || !this->parseFloat(tokens[1], instruction.value)) {
+      this->error = SYNTAX;
+      return;
+    }
+
+    bool validValue = instruction.mode == Load::CONSTANT_RESISTANCE
+        ? instruction.value >= HardwareValues::MIN_TOTAL_RESISTANCE
+        : (instruction.value >= 0.0) && (instruction.value <= maxValue);
+    if (!validValue) {
+      this->error = INVALID_VALUE;
+      return;
+    }
+
+    uint8_t idx = 2;
+    while (idx < nrTokens) {
+      if ((strcmp(tokens[idx], "FOR") == 0) && (idx + 1 < nrTokens) && (instruction.durationMs == 0)) {
+        if (!this->parseDuration(tokens[idx + 1], instruction.durationMs)) {
+          this->error = INVALID_VALUE;
+          return;
+        }
+        idx += 2;
+
+      } else if ((strcmp(tokens[idx], "UNTIL") == 0) && (idx + 3 < nrTokens) && (instruction.until.quantity == ProgramCondition::NONE)) {
+        if (!this->parseCondition(tokens + idx + 1, instruction.until)) {
+          this->error = SYNTAX;
+          return;
+        }
+        idx += 4;
+
+      } else {
+        this->error = SYNTAX;
+        return;
+      }
+    }
+
+    if (this->append(instruction) && (this->loopDepth > 0)) {
+      this->loopSteps[this->loopDepth - 1]++;
+    }
+  }
+
+  /** LOOP [<count>] */
+  void compileLoop(char **tokens, uint8_t nrTokens) {
+    if (this->loopDepth >= PROGRAM_MAX_LOOP_DEPTH) {
+      this->error = UNBALANCED_LOOP;
+      return;
+    }
+
+    ProgramInstruction instruction = {};
+    instruction.op = ProgramInstruction::LOOP;
+
+    if (nrTokens == 2) {
+      char *end;
+      long count = strtol(tokens[1], &end, 10);
+      if ((*end != '\0') || (count < 1) || (count > 0xFFFF)) {
+        this->error = INVALID_VALUE;
+        return;
+      }
+      instruction.arg = count;
+
+    } else if (nrTokens != 1) {
+      this->error = SYNTAX;
+      return;
+    }
+
+    uint8_t idx = this->program->nrInstructions;
+    if (this->append(instruction)) {
+      this->loopIdx[this->loopDepth] = idx;
+      this->loopSteps[this->loopDepth] = 0;
+      this->loopDepth++;
+    }
+  }
+
+  /** END (of loop) */
+  void compileEnd() {
+    if (this->loopDepth == 0) {
+      this->error = UNBALANCED_LOOP;
+      return;
+    }
+
+    this->loopDepth--;
+    if (this->loopSteps[this->loopDepth] == 0) {
+      // would spin without ever applying a step
+      this->error = EMPTY_LOOP;
+      return;
+    }
+
+    ProgramInstruction instruction = {};
+    instruction.op = ProgramInstruction::END;
+    instruction.arg = this->loopIdx[this->loopDepth];
+    if (this->append(instruction) && (this->loopDepth > 0)) {
+      // the steps of the inner loop count for the outer one
+      this->loopSteps[this->loopDepth - 1] += this->loopSteps[this->loopDepth];
+    }
+  }
+
+  /** Append a compiled instruction */
+  bool append(const ProgramInstruction &instruction) {
+    if (this->program->nrInstructions >= PROGRAM_MAX_INSTRUCTIONS) {
+      this->error = TOO_MANY_INSTRUCTIONS;
+      return false;
+    }
+
+    this->program->instructions[this->program->nrInstructions++] = instruction;
+    return true;
+  }
+
+  /** <V|I|P|T> <|> <threshold> (3 tokens) */
+  bool parseCondition(char **tokens, ProgramCondition &condition) {
+    if (strcmp(tokens[0], "V") == 0) {
+      condition.quantity = ProgramCondition::VOLTAGE;
+    } else if (strcmp(tokens[0], "I") == 0) {
+      condition.quantity = ProgramCondition::CURRENT;
+    } else if (strcmp(tokens[0], "P") == 0) {
+      condition.quantity = ProgramCondition::POWER;
+    } else if (strcmp(tokens[0], "T") == 0) {
+      condition.quantity = ProgramCondition::TEMPERATURE;
+    } else {
+      return false;
+    }
+
+    if ((strcmp(tokens[1], "<") != 0) && (strcmp(tokens[1], ">") != 0)) {
+      return false;
+    }
+    condition.greater = tokens[1][0] == '>';
+
+    return this->parseFloat(tokens[2], condition.threshold);
+  }
+
+  /** <number>[ms|s|m|h] */
+  bool parseDuration(const char *token, uint32_t &durationMs) {
+    char *unit;
+    float value = strtof(token, &unit);
+    if ((unit == token) || (value <= 0.0)) {
+      return false;
+    }
+
+    float multiplier;
+    if ((*unit == '\0') || (strcmp(unit, "S") == 0)) {
+      multiplier = 1000.0;
+    } else if (strcmp(unit, "MS") == 0) {
+      multiplier = 1.0;
+    } else if (strcmp(unit, "M") == 0) {
+      multiplier = 60000.0;
+    } else if (strcmp(unit, "H") == 0) {
+      multiplier = 3600000.0;
+    } else {
+      return false;
+    }
+
+    float ms = value * multiplier + 0.5;
+    if ((ms < 1.0) || (ms > 4000000000.0)) {
+      return false;
+    }
+
+    durationMs = ms;
+    return true;
+  }
+
+  bool parseFloat(const char *token, float &value) {
+    char *end;
+    value = strtof(token, &end);
+    return (end != token) && (*end == '\0');
+  }
+
+  /**
+   * Split a line into upper case tokens (copied to the token buffer). Whitespace separated,
+   * '<' and '>' are tokens on their own. Returns the number of tokens (MAX_TOKENS + 1 if too many).
+   */
+  uint8_t tokenize(const char *str, char **tokens) {
+    uint8_t nrTokens = 0;
+    char *out = this->tokenBuffer;
+    bool inToken = false;
+
+    for (const char *p = str; *p != '\0'; p++) {
+      bool comparison = (*p == '<') || (*p == '>');
+      if (isspace(*p) || comparison) {
+        if (inToken) {
+          *out++ = '\0';
+          inToken = false;
+        }
+        if (!comparison) {
+          continue;
+        }
+      }
+
+      if (!inToken) {
+        if (nrTokens >= MAX_TOKENS) {
+          return MAX_TOKENS + 1;
+        }
+        tokens[nrTokens++] = out;
+        inToken = true;
+      }
+
+      *out++ = toupper(*p);
+      if (comparison) {
+        *out++ = '\0';
+        inToken = false;
+      }
+    }
+
+    if (inToken) {
+      *out = '\0';
+    }
+
+    return nrTokens;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef PROTECT_H
+#define PROTECT_H
+
+#include <Arduino.h>
+#include "hal/gpio_hal.h"
+#include "esp_timer.h"
+#include "dac.h"
+#include "samples.h"
+
+/**
+ * Fast over-voltage / over-current protection, executed in the continuous ADC interrupt.
+ *
+ * Compares the raw ADC codes of each frame against precomputed thresholds. On a trip it
+ * immediately writes the zero current DAC preset and drops the power enable pin. The rest of
+ * the state bookkeeping is done by the control loop (woken up by the same interrupt).
+ *
+ * The control loop writes the non-zero DAC values and the power enable pin through setDac()
+ * and enablePower(), in the same critical section as the trip, so a trip can not be undone
+ * by a write in progress.
+ */
+class FastProtection {
+
+public:
+
+  enum Trip {
+    NONE,
+    OVER_VOLTAGE,
+    OVER_CURRENT
+  };
+
+  /** Threshold value of a disabled channel (above any 12-bit ADC code) */
+  static const uint16_t THRESHOLD_DISABLED = 0xFFFF;
+
+  /**
+   * Instantiates the fast protection.
+   *
+   * The zero current DAC preset is prepared by begin().
+   */
+  FastProtection(DAC &dac, const uint8_t pwrEnPin, const uint16_t zeroPreset)
+    : dac(dac), pwrEnPin(pwrEnPin), zeroPreset(zeroPreset) {
+
+      for (uint8_t chan = 0; chan < SAMPLE_MAX_CHANNELS; chan++) {
+        this->thresholds[chan] = THRESHOLD_DISABLED;
+        this->trips[chan] = NONE;
+      }
+  }
+
+  /** Prepare the zero current DAC preset */
+  void begin() {
+    this->dac.preparePreset(this->zeroPreset, 0);
+  }
+
+  /** Set the trip threshold of an ADC channel (raw ADC code, THRESHOLD_DISABLED to disable) */
+  void setThreshold(uint8_t chan, uint16_t code, Trip trip) {
+    if (chan >= SAMPLE_MAX_CHANNELS) return;
+
+    this->trips[chan] = trip;
+    this->thresholds[chan] = code;
+  }
+
+  /** Enable / disable the fast protection */
+  void setArmed(bool armed) {
+    this->armed = armed;
+  }
+
+  /**
+   * Check the raw ADC codes of a frame (called from the continuous ADC interrupt).
+   *
+   * Returns true if the protection tripped on this frame.
+   */
+  bool ARDUINO_ISR_ATTR check(const uint16_t *values, uint8_t nrValues, uint64_t frameTimestampMicros) {
+    bool tripped = false;
+
+    taskENTER_CRITICAL_ISR(&this->lock);
+    if (this->armed && (this->trip == NONE)) {
+      for (uint8_t chan = 0; chan < nrValues; chan++) {
+        if (values[chan] >= this->thresholds[chan]) {
+          // cut the load current first
+          this->dac.setPreset(this->zeroPreset);
+          if (this->pwrEnPin <= 31) {
+            GPIO.out_w1tc = ((uint32_t) 1 << this->pwrEnPin);
+          } else {
+            GPIO.out1_w1tc.val = ((uint32_t) 1 << (this->pwrEnPin - 32));
+          }
+
+          uint64_t now = esp_timer_get_time();
+          this->tripTimestampMicros = now;
+          this->tripLatencyMicros = now - frameTimestampMicros;
+          this->trip = this->trips[chan];
+          tripped = true;
+          break;
+        }
+      }
+    }
+    taskEXIT_CRITICAL_ISR(&this->lock);
+
+    return tripped;
+  }
+
+  /** Set the DAC output, unless tripped (control loop). Returns false if not written. */
+  bool setDac(uint16_t value) {
+    taskENTER_CRITICAL(&this->lock);
+    bool tripped = this->trip != NONE;
+    if (!tripped) {
+      this->dac.set(value);
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return !tripped;
+  }
+
+  /** Apply a prepared DAC preset, unless tripped (control loop). Returns false if not written. */
+  bool setDacPreset(uint16_t preset) {
+    taskENTER_CRITICAL(&this->lock);
+    bool tripped = this->trip != NONE;
+    if (!tripped) {
+      this->dac.setPreset(preset);
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return !tripped;
+  }
+
+  /** Apply a prepared DAC preset, unless tripped (timer interrupts). Returns false if not written. */
+  bool ARDUINO_ISR_ATTR setDacPresetFromISR(uint16_t preset) {
+    taskENTER_CRITICAL_ISR(&this->lock);
+    bool tripped = this->trip != NONE;
+    if (!tripped) {
+      this->dac.setPreset(preset);
+    }
+    taskEXIT_CRITICAL_ISR(&this->lock);
+
+    return !tripped;
+  }
+
+  /** Set the DAC output, unless tripped (timer interrupts). Returns false if not written. */
+  bool ARDUINO_ISR_ATTR setDacFromISR(uint16_t value) {
+    taskENTER_CRITICAL_ISR(&this->lock);
+    bool tripped = this->trip != NONE;
+    if (!tripped) {
+      this->dac.set(value);
+    }
+    taskEXIT_CRITICAL_ISR(&this->lock);
+
+    return !tripped;
+  }
+
+  /** Set the power enable pin, unless tripped (control loop). Returns false if not set. */
+  bool enablePower() {
+    taskENTER_CRITICAL(&this->lock);
+    bool tripped = this->trip != NONE;
+    if (!tripped) {
+      // direct register write (digitalWrite() is not safe in a critical section)
+      if (this->pwrEnPin <= 31) {
+        GPIO.out_w1ts = ((uint32_t) 1 << this->pwrEnPin);
+      } else {
+        GPIO.out1_w1ts.val = ((uint32_t) 1 << (this->pwrEnPin - 32));
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return !tripped;
+  }
+
+  /** Is the fast protection tripped */
+  bool isTripped() {
+    return this->trip != NONE;
+  }
+
+  /** Get the trip reason */
+  Trip getTrip() {
+    return this->trip;
+  }
+
+  /** Get the time of the last trip (in microseconds) */
+  uint64_t getTripTimestampMicros() {
+    return this->tripTimestampMicros;
+  }
+
+  /** Get the latency of the last trip: end of the ADC frame to output disabled (in microseconds) */
+  uint32_t getTripLatencyMicros() {
+    return this->tripLatencyMicros;
+  }
+
+  /** Reset a tripped protection */
+  void reset() {
+    taskENTER_CRITICAL(&this->lock);
+    this->trip = NONE;
+    taskEXIT_CRITICAL(&this->lock);
+  }
+
+private:
+  DAC &dac;
+  const uint8_t pwrEnPin;
+  const uint16_t zeroPreset;
+
+  volatile bool armed = false;
+  volatile Trip trip = NONE;
+  volatile uint16_t thresholds[SAMPLE_MAX_CHANNELS];
+  Trip trips[SAMPLE_MAX_CHANNELS];
+
+  volatile uint64_t tripTimestampMicros = 0;
+  volatile uint32_t tripLatencyMicros = 0;
+
+  /** Trip vs. control loop output writes (interrupt and other core) */
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
\ No newline at end of file
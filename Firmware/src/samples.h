@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_heap_caps.h"
+
+/** Max number of ADC channels stored in a sample frame */
+const uint8_t SAMPLE_MAX_CHANNELS = 6;
+
+/**
+ * Sample buffer size (in frames, must be a power of two):
+ *   - with PSRAM: 16384 frames * 32 bytes = 512 kB, ~4s of history @ 4.1 kHz
+ *   - without PSRAM: 1024 frames * 32 bytes = 32 kB, ~250ms of history @ 4.1 kHz
+ */
+#if defined BOARD_HAS_PSRAM
+const uint32_t SAMPLE_BUFFER_SIZE = 16384;
+#else
+const uint32_t SAMPLE_BUFFER_SIZE = 1024;
+#endif
+
+/** A timestamped frame of ADC values (one value per channel) */
+struct SampleFrame {
+  uint64_t timestampMicros;
+  uint32_t seq;
+  uint16_t values[SAMPLE_MAX_CHANNELS];
+};
+
+/**
+ * Single-producer / multi-consumer ring buffer of ADC sample frames.
+ *
+ * The producer (the continuous ADC interrupt) never blocks and never waits for the
+ * consumers. Each frame slot is protected by its own version counter (seqlock, odd while
+ * being written), so consumers can detect frames that were overwritten while they were
+ * copying them. The frame sequence number identifies the frame held by the slot.
+ *
+ * Every consumer keeps its own read position in a Cursor.
+ */
+class SampleBuffer {
+
+public:
+
+  /** Read cursor of a single consumer */
+  class Cursor {
+
+  public:
+
+    /** Creates a cursor positioned at the next frame to be written. */
+    Cursor(SampleBuffer &buffer)
+      : buffer(buffer), next(buffer.head()), dropped(0) {
+    }
+
+    /** Read the next frame. Returns false if no new frame is available. */
+    bool read(SampleFrame &frame) {
+      while (true) {
+        uint32_t head = this->buffer.head();
+        if (head == this->next) {
+          // no new data
+          return false;
+        }
+
+        if (head - this->next > SAMPLE_BUFFER_SIZE - 1) {
+          // consumer was too slow, skip the overwritten frames
+          uint32_t oldest = head - (SAMPLE_BUFFER_SIZE - 1);
+          this->dropped += oldest - this->next;
+          this->next = oldest;
+        }
+
+        if (this->buffer.read(this->next, frame)) {
+          this->next++;
+          return true;
+        }
+
+        // frame overwritten while reading => retry
+      }
+    }
+
+    /** Read the latest frame, skipping older ones (not counted as dropped). */
+    bool readLatest(SampleFrame &frame) {
+      uint32_t head = this->buffer.head();
+      if (head == this->next) {
+        // no new data
+        return false;
+      }
+
+      if (!this->buffer.readLatest(frame)) {
+        return false;
+      }
+
+      this->next = frame.seq + 1;
+      return true;
+    }
+
+    /** Move the cursor to a given frame sequence number */
+    void seek(uint32_t seq) {
+      this->next = seq;
+    }
+
+    /** Number of frames available for reading */
+    uint32_t available() {
+      uint32_t avail = this->buffer.head() - this->next;
+      return avail < SAMPLE_BUFFER_SIZE ? avail : SAMPLE_BUFFER_SIZE - 1;
+    }
+
+    /** Sequence number of the next frame to be read */
+    uint32_t position() {
+      return this->next;
+    }
+
+    /** Number of frames lost because this consumer was too slow */
+    uint32_t getDropped() {
+      return this->dropped;
+    }
+
+  private:
+    SampleBuffer &buffer;
+    uint32_t next;
+    uint32_t dropped;
+  };
+
+  SampleBuffer() {
+    // prefer PSRAM (when present), fallback to internal RAM
+    this->slots = (Slot*) heap_caps_malloc_prefer(sizeof(Slot) * SAMPLE_BUFFER_SIZE, 2,
+        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (this->slots == NULL) {
+      // reported by the ADC, nothing is ever pushed
+      return;
+    }
+
+    for (uint32_t idx = 0; idx < SAMPLE_BUFFER_SIZE; idx++) {
+      this->slots[idx].version.store(0, std::memory_order_relaxed);
+      this->slots[idx].frame.seq = 0;
+    }
+  }
+
+  /** Was the buffer allocated (nothing can be pushed otherwise) */
+  bool isAllocated() {
+    return this->slots != NULL;
+  }
+
+  /** Push a new frame (producer only, safe to call from ISR). */
+  void push(const uint16_t *values, uint8_t nrValues, uint64_t timestampMicros) {
+    uint32_t seq = this->nextSeq.load(std::memory_order_relaxed);
+    Slot &slot = this->slots[seq & (SAMPLE_BUFFER_SIZE - 1)];
+
+    // mark the slot as being written (odd version)
+    uint32_t version = slot.version.load(std::memory_order_relaxed);
+    slot.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frame.timestampMicros = timestampMicros;
+    slot.frame.seq = seq;
+    for (uint8_t chan = 0; chan < nrValues && chan < SAMPLE_MAX_CHANNELS; chan++) {
+      slot.frame.values[chan] = values[chan];
+    }
+
+    // publish the frame (even version)
+    slot.version.store(version + 2, std::memory_order_release);
+    this->nextSeq.store(seq + 1, std::memory_order_release);
+  }
+
+  /** Sequence number of the next frame to be written (equals the total number of frames written). */
+  uint32_t head() {
+    return this->nextSeq.load(std::memory_order_acquire);
+  }
+
+  /** Read a given frame. Returns false if the frame is not (or no longer) available. */
+  bool read(uint32_t seq, SampleFrame &frame) {
+    if ((int32_t) (this->head() - seq) <= 0) {
+      // not yet written
+      return false;
+    }
+
+    Slot &slot = this->slots[seq & (SAMPLE_BUFFER_SIZE - 1)];
+
+    uint32_t version = slot.version.load(std::memory_order_acquire);
+    if ((version & 1) != 0) {
+      // being written
+      return false;
+    }
+
+    frame = slot.frame;
+
+    // check that the frame was not overwritten while copying, and that it is the requested one
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (slot.version.load(std::memory_order_relaxed) == version) && (frame.seq == seq);
+  }
+
+  /** Read the latest frame. Returns false if no frame was written yet. */
+  bool readLatest(SampleFrame &frame) {
+    while (true) {
+      uint32_t head = this->head();
+      if (head == 0) {
+        return false;
+      }
+
+      if (this->read(head - 1, frame)) {
+        return true;
+      }
+
+      // overwritten while reading (the producer wrapped around) => retry
+    }
+  }
+
+private:
+
+  struct Slot {
+    /** Incremented before and after each write (odd: being written) */
+    std::atomic<uint32_t> version;
+    SampleFrame frame;
+  };
+
+  Slot *slots;
+  std::atomic<uint32_t> nextSeq { 0 };
+};
+
+#endif
\ No newline at end of file
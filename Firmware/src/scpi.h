@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef SCPI_H
+#define SCPI_H
+
+#include <Arduino.h>
+#include "body.h"
+#include "fmt.h"
+
+/** Max. length of a command line (longer lines are dropped) */
+const size_t SCPI_MAX_LINE_LENGTH = 128;
+
+/** Max. number of header nodes of a command (incl. the ones inherited from the previous command) */
+const uint8_t SCPI_MAX_NODES = 4;
+
+/** Max. length of the response line */
+const size_t SCPI_MAX_RESPONSE_LENGTH = 256;
+
+/** Error queue size */
+const uint8_t SCPI_ERROR_QUEUE_SIZE = 8;
+
+/**
+ * A parsed SCPI command: header nodes and parameter (views of the command line).
+ *
+ * Headers are matched against patterns like "MEASure:VOLTage?", "INPut[:STATe]" or "*IDN?"
+ * (short or long form of each node, optional nodes in brackets, case insensitive).
+ */
+struct ScpiCommand {
+
+  /** Common command (*IDN?, *RST, ...) */
+  bool common;
+
+  /** Query (header ends with '?') */
+  bool query;
+
+  uint8_t nrNodes;
+  BodyField nodes[SCPI_MAX_NODES];
+
+  /** Parameter (empty if none) */
+  BodyField parameter;
+
+  /** Header matches the pattern */
+  bool matches(const char *pattern) const {
+    size_t len = strlen(pattern);
+    bool patternQuery = (len > 0) && (pattern[len - 1] == '?');
+    bool patternCommon = pattern[0] == '*';
+    if ((patternQuery != this->query) || (patternCommon != this->common)) {
+      return false;
+    }
+
+    const char *start = pattern + (patternCommon ? 1 : 0);
+    return this->matchNodes(start, pattern + len - (patternQuery ? 1 : 0), 0);
+  }
+
+  /** Field (node or character data parameter) matches the mnemonic, in short or long form ("VOLTage") */
+  static bool matchMnemonic(const BodyField &field, const char *mnemonic, size_t len) {
+    char shortForm[16];
+    char longForm[16];
+    if (len >= sizeof(longForm)) {
+      return false;
+    }
+
+    size_t shortLen = 0;
+    for (size_t idx = 0; idx < len; idx++) {
+      if (!islower((unsigned char) mnemonic[idx])) {
+        shortForm[shortLen++] = mnemonic[idx];
+      }
+      longForm[idx] = mnemonic[idx];
+    }
+    shortForm[shortLen] = '\0';
+    longForm[len] = '\0';
+
+    return field.equals(shortForm) || field.equals(longForm);
+  }
+
+  /** Parameter matches the character data mnemonic ("ON", "CURRent") */
+  bool isParameter(const char *mnemonic) const {
+    return matchMnemonic(this->parameter, mnemonic, strlen(mnemonic));
+  }
+
+private:
+
+  bool matchNodes(const char *pattern, const char *end, uint8_t nodeIdx) const {
+    if (pattern >= end) {
+      return nodeIdx == this->nrNodes;
+    }
+
+    bool optional = *pattern == '[';
+    const char *mnemonic = pattern + (optional ? 1 : 0);
+    mnemonic += (mnemonic < end) && (*mnemonic == ':') ? 1 : 0;
+
+    const char *mnemonicEnd = mnemonic;
+    while ((mnemonicEnd < end) && (*mnemonicEnd != ':') && (*mnemonicEnd != '[') && (*mnemonicEnd != ']')) {
+      mnemonicEnd++;
+    }
+
+    const char *next = mnemonicEnd;
+    while ((next < end) && ((*next == ':') || (*next == ']'))) {
+      next++;
+    }
+
+    if (optional && this->matchNodes(next, end, nodeIdx)) {
+      // optional node omitted
+      return true;
+    }
+
+    return (nodeIdx < this->nrNodes)
+      && matchMnemonic(this->nodes[nodeIdx], mnemonic, mnemonicEnd - mnemonic)
+      && this->matchNodes(next, end, nodeIdx + 1);
+  }
+};
+
+/** Response line of the queries (responses of the chained queries separated by ';') */
+class ScpiResponse {
+
+public:
+
+  /** Start the response of the next query */
+  void next() {
+    if (this->len > 0) {
+      this->add(";");
+    }
+  }
+
+  void add(const char *str) {
+    this->append(str, strlen(str));
+  }
+
+  void add(uint32_t value) {
+    char buffer[20];
+    this->append(buffer, fmtUint64(buffer, value));
+  }
+
+  void add(int32_t value) {
+    char buffer[20];
+    this->append(buffer, fmtInt64(buffer, value));
+  }
+
+  void add(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+      // SCPI not-a-number
+      this->add("9.91E+37");
+      return;
+    }
+
+    char buffer[28];
+    this->append(buffer, fmtFloat(buffer, value, decimals));
+  }
+
+  void clear() {
+    this->len = 0;
+    this->overflowed = false;
+  }
+
+  /** Drop the content after the given length (response of a failed query) */
+  void truncate(size_t len) {
+    this->len = min(len, this->len);
+  }
+
+  const char* data() const {
+    return this->buffer;
+  }
+
+  size_t length() const {
+    return this->len;
+  }
+
+  bool isOverflowed() const {
+    return this->overflowed;
+  }
+
+private:
+  char buffer[SCPI_MAX_RESPONSE_LENGTH];
+  size_t len = 0;
+  bool overflowed = false;
+
+  void append(const char *str, size_t strLen) {
+    if (this->len + strLen > sizeof(this->buffer)) {
+      this->overflowed = true;
+      return;
+    }
+
+    memcpy(this->buffer + this->len, str, strLen);
+    this->len += strLen;
+  }
+};
+
+/**
+ * Incremental SCPI command line parser (no allocations, no hardware dependencies).
+ *
+ * The received characters are collected into a line buffer, until the '\n' terminator.
+ * The commands of the line (chained with ';') are parsed in place and passed to the handler:
+ *
+ *   int16_t handler.execute(const ScpiCommand &command, ScpiResponse &response)
+ *
+ * returning an error code (NO_ERROR on success). Following the SCPI-99 rules, a chained
+ * command without a leading ':' inherits the header path of the previous one
+ * ("MEAS:VOLT?;CURR?" = "MEAS:VOLT?;:MEAS:CURR?"). Errors are collected in the error queue.
+ */
+class ScpiParser {
+
+public:
+
+  /** Error codes (SCPI-99, chapter 21.8) */
+  enum Error : int16_t {
+    NO_ERROR = 0,
+    COMMAND_ERROR = -100,
+    SYNTAX_ERROR = -102,
+    DATA_TYPE_ERROR = -104,
+    PARAMETER_NOT_ALLOWED = -108,
+    MISSING_PARAMETER = -109,
+    UNDEFINED_HEADER = -113,
+    EXECUTION_ERROR = -200,
+    DATA_OUT_OF_RANGE = -222,
+    QUEUE_OVERFLOW = -350,
+    INPUT_BUFFER_OVERRUN = -363,
+    QUERY_ERROR = -400
+  };
+
+  /** Error message */
+  static const char* toErrorStr(int16_t error) {
+    const char* errorStr = "Unknown error";
+    switch (error) {
+      case NO_ERROR:
+        errorStr = "No error";
+        break;
+      case COMMAND_ERROR:
+        errorStr = "Command error";
+        break;
+      case SYNTAX_ERROR:
+        errorStr = "Syntax error";
+        break;
+      case DATA_TYPE_ERROR:
+        errorStr = "Data type error";
+        break;
+      case PARAMETER_NOT_ALLOWED:
+        errorStr = "Parameter not allowed";
+        break;
+      case MISSING_PARAMETER:
+        errorStr = "Missing parameter";
+        break;
+      case UNDEFINED_HEADER:
+        errorStr = "Undefined header";
+        break;
+      case EXECUTION_ERROR:
+        errorStr = "Execution error";
+        break;
+      case DATA_OUT_OF_RANGE:
+        errorStr = "Data out of range";
+        break;
+      case QUEUE_OVERFLOW:
+        errorStr = "Queue overflow";
+        break;
+      case INPUT_BUFFER_OVERRUN:
+        errorStr = "Input buffer overrun";
+        break;
+      case QUERY_ERROR:
+        errorStr = "Query error";
+        break;
+    }
+    return errorStr;
+  }
+
+  /** Feed a received character. Returns true when a command line is complete (to be executed). */
+  bool feed(char c) {
+    if (c == '\n') {
+      if (this->overrun) {
+        // line too long => dropped
+        this->overrun = false;
+        this->len = 0;
+        this->pushError(INPUT_BUFFER_OVERRUN);
+        return false;
+      }
+      return true;
+    }
+
+    if ((c == '\r') || this->overrun) {
+      return false;
+    }
+
+    if (this->len >= sizeof(this->line)) {
+      this->overrun = true;
+      return false;
+    }
+
+    this->line[this->len++] = c;
+    return false;
+  }
+
+  /** Execute the completed command line. The response line (if any) is available through getResponse(). */
+  template<typename Handler>
+  void execute(Handler &handler) {
+    this->response.clear();
+    this->nrPathNodes = 0;
+
+    const char *p = this->line;
+    const char *end = this->line + this->len;
+    while (p < end) {
+      const char *separator = (const char*) memchr(p, ';', end - p);
+      const char *commandEnd = separator != NULL ? separator : end;
+
+      ScpiCommand command;
+      int16_t error = this->parse(p, commandEnd, command);
+      if (error != NO_ERROR) {
+        // the rest of the line is ignored
+        this->pushError(error);
+        break;
+      }
+
+      if (command.nrNodes > 0) {
+        size_t responseLen = this->response.length();
+        if (command.query) {
+          this->response.next();
+        }
+
+        error = handler.execute(command, this->response);
+        if (error != NO_ERROR) {
+          this->response.truncate(responseLen);
+          this->pushError(error);
+        }
+      }
+
+      p = commandEnd + 1;
+    }
+
+    if (this->response.isOverflowed()) {
+      this->response.clear();
+      this->pushError(QUERY_ERROR);
+    }
+
+    if (this->response.length() > 0) {
+      this->response.add("\n");
+    }
+
+    this->len = 0;
+  }
+
+  /** Response line of the last executed command line (empty if it had no queries) */
+  const ScpiResponse& getResponse() const {
+    return this->response;
+  }
+
+  /** Pop the oldest error from the error queue (NO_ERROR if empty) */
+  int16_t popError() {
+    if (this->nrErrors == 0) {
+      return NO_ERROR;
+    }
+
+    int16_t error = this->errors[0];
+    memmove(this->errors, this->errors + 1, (this->nrErrors - 1) * sizeof(int16_t));
+    this->nrErrors--;
+    return error;
+  }
+
+  /** Clear the error queue */
+  void clearErrors() {
+    this->nrErrors = 0;
+  }
+
+  /** Add an error to the error queue (the last one is replaced with QUEUE_OVERFLOW when full) */
+  void pushError(int16_t error) {
+    if (this->nrErrors >= SCPI_ERROR_QUEUE_SIZE) {
+      this->errors[SCPI_ERROR_QUEUE_SIZE - 1] = QUEUE_OVERFLOW;
+      return;
+    }
+
+    this->errors[this->nrErrors++] = error;
+  }
+
+private:
+  char line[SCPI_MAX_LINE_LENGTH];
+  size_t len = 0;
+  bool overrun = false;
+
+  /** Header path of the previous command (inherited by the next chained command) */
+  BodyField pathNodes[SCPI_MAX_NODES];
+  uint8_t nrPathNodes = 0;
+
+  ScpiResponse response;
+
+  int16_t errors[SCPI_ERROR_QUEUE_SIZE];
+  uint8_t nrErrors = 0;
+
+  /** Parse a command: [*|:]node[:node...][?] [parameter]. An empty command has no nodes. */
+  int16_t parse(const char *p, const char *end, ScpiCommand &command) {
+    command.common = false;
+    command.query = false;
+    command.nrNodes = 0;
+    command.parameter = BodyField();
+
+    while ((p < end) && isspace((unsigned char) *p)) {
+      p++;
+    }
+    if (p == end) {
+      return NO_ERROR;
+    }
+
+    command.common = *p == '*';
+    bool absolute = *p == ':';
+    p += (command.common || absolute) ? 1 : 0;
+
+    const char *headerEnd = p;
+    while ((headerEnd < end) && !isspace((unsigned char) *headerEnd)) {
+      headerEnd++;
+    }
+    command.parameter = BodyField(headerEnd, end - headerEnd);
+
+    command.query = (headerEnd > p) && (headerEnd[-1] == '?');
+    headerEnd -= command.query ? 1 : 0;
+
+    // inherited path
+    if (!command.common && !absolute) {
+      for (uint8_t idx = 0; idx < this->nrPathNodes; idx++) {
+        command.nodes[command.nrNodes++] = this->pathNodes[idx];
+      }
+    }
+
+    // nodes
+    const char *node = p;
+    while (true) {
+      const char *nodeEnd = node;
+      while ((nodeEnd < headerEnd) && (*nodeEnd != ':')) {
+        if (!isalnum((unsigned char) *nodeEnd) && (*nodeEnd != '_')) {
+          return SYNTAX_ERROR;
+        }
+        nodeEnd++;
+      }
+
+      if ((nodeEnd == node) || !isalpha((unsigned char) *node)) {
+        return SYNTAX_ERROR;
+      }
+      if (command.nrNodes >= SCPI_MAX_NODES) {
+        return UNDEFINED_HEADER;
+      }
+      command.nodes[command.nrNodes++] = BodyField(node, nodeEnd - node);
+
+      if (nodeEnd == headerEnd) {
+        break;
+      }
+      node = nodeEnd + 1;
+    }
+
+    if (command.common && (command.nrNodes != 1)) {
+      return SYNTAX_ERROR;
+    }
+
+    // path of the next chained command (common commands do not change it)
+    if (!command.common) {
+      this->nrPathNodes = command.nrNodes - 1;
+      for (uint8_t idx = 0; idx < this->nrPathNodes; idx++) {
+        this->pathNodes[idx] = command.nodes[idx];
+      }
+    }
+
+    return NO_ERROR;
+  }
+};
+
+#endif
\ No newline at end of file
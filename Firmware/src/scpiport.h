@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef SCPIPORT_H
+#define SCPIPORT_H
+
+#include <Arduino.h>
+#include <Adafruit_TinyUSB.h>
+#include "scpi.h"
+#include "load.h"
+#include "commands.h"
+
+/** *IDN? fields (the serial number is the MAC address) */
+const char SCPI_IDN_MANUFACTURER[] = "bluetiger9";
+const char SCPI_IDN_MODEL[] = "SmartElectronicLoad";
+const char SCPI_IDN_FIRMWARE[] = __DATE__;
+
+/** Max number of settings of a command line being applied by the control loop */
+const uint8_t SCPI_MAX_PENDING = 8;
+
+/**
+ * SCPI command interface on a (second) USB CDC port, handled from the loop() task.
+ *
+ * Commands (short or long form, chained with ';', terminated by '\n'):
+ *
+ *   *IDN?  *RST  *CLS  *OPC?
+ *   [SOURce:]CURRent <A> | ?                [SOURce:]POWer <W> | ?
+ *   [SOURce:]RESistance <Ohm> | ?           [SOURce:]MODE CURRent|POWer|RESistance | ?
+ *   INPut[:STATe] ON|OFF|1|0 | ?
+ *   MEASure:VOLTage?  MEASure:CURRent?  MEASure:POWer?  MEASure:TEMPerature?
+ *   PROTection:CLEar  PROTection:STATe?
+ *   PROTection:TEMPerature <C> | ?          PROTection:CURRent <A> | ?
+ *   PROTection:VOLTage <V> | ?              PROTection:POWer <W> | ?
+ *   SYSTem:ERRor?
+ *
+ * The settings are posted to the control loop (through the command queue) without waiting.
+ * The response of a line is sent, and the next line is executed, once all of its settings
+ * were applied (failures are reported through the error queue). The queries read the latest
+ * state snapshot (the settings of a line are visible to the queries of the next line).
+ */
+class ScpiPort {
+
+public:
+
+  ScpiPort(Load &load, CommandQueue &commands)
+    : load(load), commands(commands) {
+  }
+
+  /** Start the USB CDC interface (must be re-enumerated if the USB device is already mounted) */
+  void begin() {
+    this->cdc.setStringDescriptor("SCPI");
+    this->cdc.begin(115200);
+  }
+
+  /** Execute the received commands, send the responses (loop() task, does not block) */
+  void handle() {
+    if (this->nrPending > 0) {
+      if (!this->pollPending()) {
+        // settings of the previous line not applied yet
+        return;
+      }
+      this->sendResponse();
+    }
+
+    while (this->cdc.available() > 0) {
+      if (!this->parser.feed(this->cdc.read())) {
+        continue;
+      }
+
+      this->parser.execute(*this);
+      this->pendingStartMs = millis();
+
+      if (!this->pollPending()) {
+        // the response is sent once the settings are applied
+        return;
+      }
+      this->sendResponse();
+    }
+  }
+
+  /** Execute a command (called by the parser) */
+  int16_t execute(const ScpiCommand &command, ScpiResponse &response) {
+    Load::State state = this->load.getState();
+    const Load::Measurement &measurement = state.measurement;
+
+    // common commands
+    if (command.matches("*IDN?")) {
+      char serial[13];
+      uint64_t mac = ESP.getEfuseMac();
+      for (uint8_t idx = 0; idx < 12; idx++) {
+        serial[idx] = "0123456789ABCDEF"[(mac >> (44 - idx * 4)) & 0xF];
+      }
+      serial[12] = '\0';
+
+      response.add(SCPI_IDN_MANUFACTURER);
+      response.add(",");
+      response.add(SCPI_IDN_MODEL);
+      response.add(",");
+      response.add(serial);
+      response.add(",");
+      response.add(SCPI_IDN_FIRMWARE);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("*RST")) {
+      return this->reset();
+
+    } else if (command.matches("*CLS")) {
+      this->parser.clearErrors();
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("*OPC?")) {
+      // the response line is sent once the settings of the line are applied
+      response.add((uint32_t) 1);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("SYSTem:ERRor[:NEXT]?")) {
+      int16_t error = this->parser.popError();
+      response.add((int32_t) error);
+      response.add(",\"");
+      response.add(ScpiParser::toErrorStr(error));
+      response.add("\"");
+      return ScpiParser::NO_ERROR;
+    }
+
+    // set points
+    if (command.matches("[SOURce:]CURRent")) {
+      return this->submitFloat(command, Command::SET_CURRENT);
+    } else if (command.matches("[SOURce:]CURRent?")) {
+      response.add(state.setCurrent, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("[SOURce:]POWer")) {
+      return this->submitFloat(command, Command::SET_POWER);
+    } else if (command.matches("[SOURce:]POWer?")) {
+      response.add(state.setPower, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("[SOURce:]RESistance")) {
+      return this->submitFloat(command, Command::SET_RESISTANCE);
+    } else if (command.matches("[SOURce:]RESistance?")) {
+      response.add(state.setResistance, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("[SOURce:]MODE")) {
+      Load::Mode mode;
+      if (command.isParameter("CURRent") || command.isParameter("CC")) {
+        mode = Load::CONSTANT_CURRENT;
+      } else if (command.isParameter("POWer") || command.isParameter("CP")) {
+        mode = Load::CONSTANT_POWER;
+      } else if (command.isParameter("RESistance") || command.isParameter("CR")) {
+        mode = Load::CONSTANT_RESISTANCE;
+      } else {
+        return command.parameter.isEmpty() ? ScpiParser::MISSING_PARAMETER : ScpiParser::DATA_TYPE_ERROR;
+      }
+      return this->submit(Command::SET_MODE, 0.0, mode);
+    } else if (command.matches("[SOURce:]MODE?")) {
+      response.add(toModeStr(state.mode));
+      return ScpiParser::NO_ERROR;
+    }
+
+    // input (load enable)
+    if (command.matches("INPut[:STATe]")) {
+      bool enabled;
+      if (command.isParameter("ON") || command.isParameter("1")) {
+        enabled = true;
+      } else if (command.isParameter("OFF") || command.isParameter("0")) {
+        enabled = false;
+      } else {
+        return command.parameter.isEmpty() ? ScpiParser::MISSING_PARAMETER : ScpiParser::DATA_TYPE_ERROR;
+      }
+      return this->submit(Command::SET_ENABLED, 0.0, enabled);
+    } else if (command.matches("INPut[:STATe]?")) {
+      response.add((uint32_t) state.enabled);
+      return ScpiParser::NO_ERROR;
+    }
+
+    // measurements
+    if (command.matches("MEASure:VOLTage?")) {
+      response.add(measurement.voltage, 3);
+      return ScpiParser::NO_ERROR;
+    } else if (command.matches("MEASure:CURRent?")) {
+      response.add(measurement.current, 3);
+      return ScpiParser::NO_ERROR;
+    } else if (command.matches("MEASure:POWer?")) {
+      response.add(measurement.power, 3);
+      return ScpiParser::NO_ERROR;
+    } else if (command.matches("MEASure:TEMPerature?")) {
+      response.add(measurement.temperature, 2);
+      return ScpiParser::NO_ERROR;
+    }
+
+    // protections
+    if (command.matches("PROTection:CLEar")) {
+      return this->submit(Command::RESET_PROTECTIONS);
+    } else if (command.matches("PROTection:STATe?")) {
+      response.add(toProtectionStateStr(state.protectionState));
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("PROTection:TEMPerature")) {
+      return this->submitFloat(command, Command::SET_OVER_TEMPERATURE_LIMIT);
+    } else if (command.matches("PROTection:TEMPerature?")) {
+      response.add(state.overTemperatureLimit, 2);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("PROTection:CURRent")) {
+      return this->submitFloat(command, Command::SET_OVER_CURRENT_LIMIT);
+    } else if (command.matches("PROTection:CURRent?")) {
+      response.add(state.overCurrentLimit, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("PROTection:VOLTage")) {
+      return this->submitFloat(command, Command::SET_OVER_VOLTAGE_LIMIT);
+    } else if (command.matches("PROTection:VOLTage?")) {
+      response.add(state.overVoltageLimit, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("PROTection:POWer")) {
+      return this->submitFloat(command, Command::SET_OVER_POWER_LIMIT);
+    } else if (command.matches("PROTection:POWer?")) {
+      response.add(state.overPowerLimit, 3);
+      return ScpiParser::NO_ERROR;
+    }
+
+    return ScpiParser::UNDEFINED_HEADER;
+  }
+
+  /**
+   * Settings restored by *RST (one batch, applied in one control loop tick): load disabled,
+   * constant current mode, zero set current. The mode change also resets the set power /
+   * resistance (a SET_POWER would be rejected in constant current mode).
+   */
+  static void resetSettings(CommandBatch &batch) {
+    batch = {};
+    batch.nrCommands = 3;
+    batch.commands[0].type = Command::SET_ENABLED;
+    batch.commands[0].param = false;
+    batch.commands[1].type = Command::SET_MODE;
+    batch.commands[1].param = Load::CONSTANT_CURRENT;
+    batch.commands[2].type = Command::SET_CURRENT;
+    batch.commands[2].value = 0.0;
+  }
+
+private:
+  Load &load;
+  CommandQueue &commands;
+
+  Adafruit_USBD_CDC cdc;
+  ScpiParser parser;
+
+  /** Settings restored by *RST, and the token of its command until completed (-1: none, kept after a timeout) */
+  CommandBatch resetBatch;
+  int8_t resetToken = -1;
+
+  /** Tokens of the settings of the current line, not applied yet */
+  uint8_t pendingTokens[SCPI_MAX_PENDING];
+  uint8_t nrPending = 0;
+  uint32_t pendingStartMs = 0;
+
+  /** Post a command to the control loop (completion checked by pollPending()) */
+  int16_t submit(Command::Type type, float value = 0.0, uint32_t param = 0, const void *data = NULL) {
+    if (this->nrPending >= SCPI_MAX_PENDING) {
+      return ScpiParser::EXECUTION_ERROR;
+    }
+
+    int8_t token = this->commands.post(type, value, param, data);
+    if (token < 0) {
+      return ScpiParser::EXECUTION_ERROR;
+    }
+
+    this->pendingTokens[this->nrPending++] = token;
+    return ScpiParser::NO_ERROR;
+  }
+
+  /**
+   * Check the settings of the current line: failed ones are added to the error queue, pending
+   * ones time out after COMMAND_TIMEOUT_MS. Returns true once none is pending.
+   */
+  bool pollPending() {
+    bool timeout = millis() - this->pendingStartMs >= COMMAND_TIMEOUT_MS;
+
+    uint8_t nrRemaining = 0;
+    for (uint8_t idx = 0; idx < this->nrPending; idx++) {
+      uint8_t token = this->pendingTokens[idx];
+
+      bool result;
+      if (this->commands.poll(token, result)) {
+        if (token == this->resetToken) {
+          this->resetToken = -1;
+        }
+        if (!result) {
+          this->parser.pushError(ScpiParser::EXECUTION_ERROR);
+        }
+
+      } else if (timeout) {
+        if (token != this->resetToken) {
+          this->commands.abandon(token);
+        }
+        // (the reset batch stays owned by its command, checked by the next *RST)
+        this->parser.pushError(ScpiParser::EXECUTION_ERROR);
+
+      } else {
+        this->pendingTokens[nrRemaining++] = token;
+      }
+    }
+
+    this->nrPending = nrRemaining;
+    return nrRemaining == 0;
+  }
+
+  /** Send the response line of the last executed line (if any) */
+  void sendResponse() {
+    const ScpiResponse &response = this->parser.getResponse();
+    if (response.length() > 0) {
+      this->cdc.write((const uint8_t*) response.data(), response.length());
+      this->cdc.flush();
+    }
+  }
+
+  /** Submit a command with a numeric parameter */
+  int16_t submitFloat(const ScpiCommand &command, Command::Type type) {
+    float value;
+    if (command.parameter.isEmpty()) {
+      return ScpiParser::MISSING_PARAMETER;
+    }
+    if (!command.parameter.toFloat(value)) {
+      return ScpiParser::DATA_TYPE_ERROR;
+    }
+
+    return this->submit(type, value);
+  }
+
+  /** Reset: stop the shaper / dynamic load / sequencer, disable the load, constant current mode with zero set points */
+  int16_t reset() {
+    if (this->resetToken >= 0) {
+      for (uint8_t idx = 0; idx < this->nrPending; idx++) {
+        if (this->pendingTokens[idx] == this->resetToken) {
+          // reset batch of this line still queued
+          return ScpiParser::EXECUTION_ERROR;
+        }
+      }
+
+      bool result;
+      if (!this->commands.poll(this->resetToken, result)) {
+        // the timed out reset batch is still queued (owns the settings)
+        return ScpiParser::EXECUTION_ERROR;
+      }
+      this->resetToken = -1;
+    }
+
+    // (applied in order: the stops first, so the batch is not rejected while one of them is active)
+    int16_t error = this->submit(Command::SEQUENCER_STOP);
+    if (error == ScpiParser::NO_ERROR) {
+      error = this->submit(Command::DYNAMIC_STOP);
+    }
+    if (error == ScpiParser::NO_ERROR) {
+      error = this->submit(Command::SHAPER_STOP);
+    }
+    if (error != ScpiParser::NO_ERROR) {
+      return error;
+    }
+
+    resetSettings(this->resetBatch);
+    error = this->submit(Command::BATCH, 0.0, 0, &this->resetBatch);
+    if (error == ScpiParser::NO_ERROR) {
+      this->resetToken = this->pendingTokens[this->nrPending - 1];
+    }
+
+    return error;
+  }
+
+  /** Operating mode (short form) */
+  static const char* toModeStr(Load::Mode mode) {
+    const char* modeStr = "";
+    switch (mode) {
+      case Load::CONSTANT_CURRENT:
+        modeStr = "CURR";
+        break;
+      case Load::CONSTANT_POWER:
+        modeStr = "POW";
+        break;
+      case Load::CONSTANT_RESISTANCE:
+        modeStr = "RES";
+        break;
+    }
+    return modeStr;
+  }
+
+  /** Protection state (short form) */
+  static const char* toProtectionStateStr(Load::ProtectState protectionState) {
+    const char* protectionStateStr = "";
+    switch (protectionState) {
+      case Load::OK:
+        protectionStateStr = "OK";
+        break;
+      case Load::OK_DISABLED:
+        protectionStateStr = "DIS";
+        break;
+      case Load::TRIPPED_OVER_TEMPERATURE:
+        protectionStateStr = "OTEM";
+        break;
+      case Load::TRIPPED_OVER_VOLTAGE:
+        protectionStateStr = "OVOL";
+        break;
+      case Load::TRIPPED_OVER_CURRENT:
+        protectionStateStr = "OCUR";
+        break;
+      case Load::TRIPPED_OVER_POWER:
+        protectionStateStr = "OPOW";
+        break;
+    }
+    return protectionStateStr;
+  }
+};
+
+#endif
\ No newline at end of file
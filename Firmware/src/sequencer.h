@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <Arduino.h>
+#include "load.h"
+#include "program.h"
+#include "snapshot.h"
+
+/** Number of consecutive frames a condition must hold (filters out the ADC noise) */
+const uint8_t SEQUENCER_CONDITION_FRAMES = 4;
+
+/**
+ * List-mode sequencer: runs a compiled step program (see program.h) on the device.
+ *
+ * Evaluated by the control loop on every tick, at constant cost: the abort conditions,
+ * the exit condition and the duration of the current step. On a step change the LOOP / END
+ * instructions are executed until the next step (loop bodies always contain a step).
+ *
+ * Follows the lifecycle of the Shaper, and it's mutually exclusive with the Shaper and
+ * the dynamic load (checked by the control loop).
+ */
+class Sequencer {
+
+public:
+
+  enum State {
+    IDLE,
+    WAITING_POWER,
+    RUNNING,
+    FINISHED,
+    ABORTED
+  };
+
+  /** Reason of the last stop */
+  enum StopReason {
+    NO_STOP,
+    COMPLETED,
+    STOPPED,
+    ABORT_CONDITION,
+    PROTECTION,
+    SET_POINT_REJECTED
+  };
+
+  /** Consistent status (published by the control loop once per tick) */
+  struct Status {
+    State state;
+    StopReason stopReason;
+    uint8_t abortIdx;
+    uint8_t position;
+    uint8_t nrInstructions;
+    uint32_t stepCount;
+    uint32_t stepElapsedMs;
+  };
+
+  Sequencer(Load &load)
+    : load(load) {
+  }
+
+  /** Is the sequencer currently active */
+  bool isActive() {
+    return this->state != IDLE;
+  }
+
+  /** Get the sequencer state */
+  State getState() {
+    return this->state;
+  }
+
+  /** Reason of the last stop */
+  StopReason getStopReason() {
+    return this->stopReason;
+  }
+
+  /** Index of the triggered abort condition (valid for ABORT_CONDITION) */
+  uint8_t getAbortIdx() {
+    return this->abortIdx;
+  }
+
+  /** Index of the current instruction */
+  uint8_t getPosition() {
+    return this->pc;
+  }
+
+  /** Number of steps applied since the start */
+  uint32_t getStepCount() {
+    return this->stepCount;
+  }
+
+  /** Time spent in the current step (in milliseconds) */
+  uint32_t getStepElapsedMs() {
+    return this->state == RUNNING ? millis() - this->stepStartMs : 0;
+  }
+
+  /** Get the loaded program */
+  const Program& getProgram() {
+    return this->program;
+  }
+
+  /** Get a consistent copy of the latest published status (lock-free, any task) */
+  Status getStatus() {
+    Status status = {};
+    this->status.read(status);
+    return status;
+  }
+
+  /** Load a compiled program. Not allowed while active. */
+  bool setProgram(const Program &program) {
+    if (this->isActive() || (program.nrInstructions == 0)) {
+      return false;
+    }
+
+    this->program = program;
+    return true;
+  }
+
+  /** Start the program (enables the load) */
+  bool start() {
+    if (this->isActive() || (this->program.nrInstructions == 0) || this->load.isTripped()) {
+      return false;
+    }
+
+    // the first step is applied once the power stage is ready
+    if (!this->load.setEnabled(true)) {
+      return false;
+    }
+    this->load.setHoldEnabled(true);
+
+    this->stopReason = NO_STOP;
+    this->state = WAITING_POWER;
+    this->handle();
+
+    return true;
+  }
+
+  /** Stop the program (the set point is reset) */
+  void stop() {
+    if (this->state == RUNNING) {
+      this->stopReason = STOPPED;
+      this->state = ABORTED;
+    } else if (this->state == WAITING_POWER) {
+      this->load.setHoldEnabled(false);
+      this->stopReason = STOPPED;
+      this->state = IDLE;
+    }
+  }
+
+  /** Handle the program (start when the power stage is ready, evaluate the current step, cleanup when ended) */
+  void handle() {
+    switch (this->state) {
+      case WAITING_POWER:
+        if (this->load.isTripped() || !this->load.isEnabled()) {
+          // load disabled while waiting
+          this->load.setHoldEnabled(false);
+          this->stopReason = PROTECTION;
+          this->state = IDLE;
+
+        } else if (this->load.isPowerReady()) {
+          this->startProgram();
+        }
+        break;
+
+      case RUNNING:
+        this->tick();
+        break;
+
+      default:
+        break;
+    }
+
+    if ((this->state == FINISHED) || (this->state == ABORTED)) {
+      // end of program
+      this->finish();
+    }
+
+    this->publishStatus();
+  }
+
+private:
+  Load &load;
+
+  Program program = {};
+
+  volatile State state = IDLE;
+  volatile StopReason stopReason = NO_STOP;
+  uint8_t abortIdx = 0;
+
+  /** Current instruction (always a step while running) */
+  volatile uint8_t pc = 0;
+  uint32_t stepStartMs = 0;
+  uint32_t stepCount = 0;
+
+  /** Remaining iterations of the open loops (0 = forever) */
+  uint16_t loopCounters[PROGRAM_MAX_LOOP_DEPTH];
+  uint8_t loopDepth = 0;
+
+  /** Consecutive frames the conditions held */
+  uint8_t untilFrames = 0;
+  uint8_t abortFrames[PROGRAM_MAX_ABORTS];
+
+  /** Status seen by the other tasks */
+  Snapshot<Status> status;
+
+  /** Publish the current status */
+  void publishStatus() {
+    Status status;
+    status.state = this->state;
+    status.stopReason = this->stopReason;
+    status.abortIdx = this->abortIdx;
+    status.position = this->pc;
+    status.nrInstructions = this->program.nrInstructions;
+    status.stepCount = this->stepCount;
+    status.stepElapsedMs = this->getStepElapsedMs();
+
+    this->status.publish(status);
+  }
+
+  /** Start from the first step */
+  void startProgram() {
+    this->loopDepth = 0;
+    this->stepCount = 0;
+    memset(this->abortFrames, 0, sizeof(this->abortFrames));
+
+    this->state = RUNNING;
+    this->enter(0);
+  }
+
+  /** Evaluate the current step */
+  void tick() {
+    if (this->load.isTripped() || !this->load.isEnabled()) {
+      // protection tripped / load disabled => stop (the power stage may still be enabling)
+      this->stopReason = PROTECTION;
+      this->state = ABORTED;
+      return;
+    }
+
+    Load::Measurement measurement = this->load.getMeasurement();
+
+    for (uint8_t idx = 0; idx < this->program.nrAborts; idx++) {
+      if (this->holds(this->program.aborts[idx], measurement, this->abortFrames[idx])) {
+        this->abortIdx = idx;
+        this->stopReason = ABORT_CONDITION;
+        this->state = ABORTED;
+        return;
+      }
+    }
+
+    const ProgramInstruction &step = this->program.instructions[this->pc];
+    bool timeout = (step.durationMs > 0) && (millis() - this->stepStartMs >= step.durationMs);
+    bool exit = (step.until.quantity != ProgramCondition::NONE) && this->holds(step.until, measurement, this->untilFrames);
+    if (timeout || exit) {
+      this->enter(this->pc + 1);
+    }
+  }
+
+  /** Continue from the given instruction: execute the LOOP / END instructions, apply the next step */
+  void enter(uint8_t idx) {
+    while (idx < this->program.nrInstructions) {
+      const ProgramInstruction &instruction = this->program.instructions[idx];
+
+      switch (instruction.op) {
+        case ProgramInstruction::LOOP:
+          this->loopCounters[this->loopDepth++] = instruction.arg;
+          idx++;
+          break;
+
+        case ProgramInstruction::END: {
+          uint16_t &counter = this->loopCounters[this->loopDepth - 1];
+          if ((counter == 0) || (--counter > 0)) {
+            // next iteration
+            idx = instruction.arg + 1;
+          } else {
+            this->loopDepth--;
+            idx++;
+          }
+          break;
+        }
+
+        case ProgramInstruction::STEP:
+          this->applyStep(idx);
+          return;
+      }
+    }
+
+    // end of program
+    this->stopReason = COMPLETED;
+    this->state = FINISHED;
+  }
+
+  /** Apply a step (mode and set point) */
+  void applyStep(uint8_t idx) {
+    const ProgramInstruction &step = this->program.instructions[idx];
+
+    // (a mode change resets the set points)
+    bool success = (step.mode == this->load.getMode()) || this->load.setMode(step.mode);
+    if (step.mode == Load::CONSTANT_CURRENT) {
+      success = success && this->load.setCurrent(step.value);
+    } else if (step.mode == Load::CONSTANT_POWER) {
+      success = success && this->load.setPower(step.value);
+    } else {
+      success = success && this->load.setResistance(step.value);
+    }
+
+    if (!success) {
+      this->stopReason = SET_POINT_REJECTED;
+      this->state = ABORTED;
+      return;
+    }
+
+    this->pc = idx;
+    this->stepStartMs = millis();
+    this->stepCount++;
+    this->untilFrames = 0;
+  }
+
+  /** Check a condition (must hold for SEQUENCER_CONDITION_FRAMES consecutive frames) */
+  bool holds(const ProgramCondition &condition, const Load::Measurement &measurement, uint8_t &frames) {
+    float value;
+    switch (condition.quantity) {
+      case ProgramCondition::VOLTAGE:
+        value = measurement.voltage;
+        break;
+      case ProgramCondition::CURRENT:
+        value = measurement.current;
+        break;
+      case ProgramCondition::POWER:
+        value = measurement.power;
+        break;
+      case ProgramCondition::TEMPERATURE:
+        value = measurement.temperature;
+        break;
+      default:
+        return false;
+    }
+
+    bool met = condition.greater ? value > condition.threshold : value < condition.threshold;
+    frames = met ? min(frames + 1, (int) SEQUENCER_CONDITION_FRAMES) : 0;
+
+    return frames >= SEQUENCER_CONDITION_FRAMES;
+  }
+
+  /** End of program: reset the set point (abort conditions also disable the load) */
+  void finish() {
+    this->load.setHoldEnabled(false);
+
+    if (this->load.getMode() == Load::CONSTANT_POWER) {
+      this->load.setPower(0.0);
+
+    } else if (this->load.getMode() == Load::CONSTANT_RESISTANCE) {
+      this->load.setResistance(10000000.0);
+
+    } else {
+      this->load.setCurrent(0.0);
+    }
+
+    if (this->stopReason == ABORT_CONDITION) {
+      this->load.setEnabled(false);
+    }
+
+    this->state = IDLE;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,9 @@
+#include "shaper.h"
+
+/** Shaper timer alarm interrupt handler */
+bool ARDUINO_ISR_ATTR shaperAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userData) {
+  ((Shaper *) userData)->handleAlarm(edata);
+
+  // no task woken
+  return false;
+}
\ No newline at end of file
@@ -8,82 +8,648 @@
 #ifndef SHAPER_H
 #define SHAPER_H
 
+#include "driver/gptimer.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "load.h"
+#include "dac.h"
+#include "hw.h"
+#include "stats.h"
+#include "waveform.h"
+#include "generator.h"
+#include "capture.h"
+#include "snapshot.h"
 
-/** Generate custom current (/power /resistance) shapes. */
+/** Shaper timer resolution: 1 MHz (1 tick = 1 us) */
+const uint32_t SHAPER_TIMER_RESOLUTION_HZ = 1000000;
+
+/** Min step duration (in microseconds) */
+const uint32_t SHAPER_MIN_STEP_MICROS = 10;
+
+/**
+ * Max number of steps (8 bytes each):
+ *   - with PSRAM: 131072 steps = 1 MB
+ *   - without PSRAM: 1024 steps = 8 kB
+ */
+#if defined BOARD_HAS_PSRAM
+const uint32_t SHAPER_MAX_STEPS = 131072;
+#else
+const uint32_t SHAPER_MAX_STEPS = 1024;
+#endif
+
+/** Generator tick in constant current mode (timer ISR, in microseconds) */
+const uint32_t SHAPER_GENERATOR_TICK_MICROS = 50;
+
+/** Max generator frequency: constant current mode (timer ISR) and power / resistance modes (control loop) */
+const float SHAPER_GENERATOR_MAX_FREQ_CC = 10000.0;
+const float SHAPER_GENERATOR_MAX_FREQ = 500.0;
+
+/** Min generator set power (in watts, well below one DAC step): 0 W would auto-disable the load */
+const float SHAPER_GENERATOR_MIN_POWER = 0.000001;
+
+/** Shaper timer alarm callback (called from ISR) */
+bool ARDUINO_ISR_ATTR shaperAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userData);
+
+/**
+ * Generate custom current shapes.
+ *
+ * The steps are converted to DAC codes when the shape is loaded (or uploaded in the binary
+ * waveform format, see waveform.h). The playback runs from a hardware timer (gptimer)
+ * alarm ISR: at each step boundary the precomputed DAC preset of the step is applied, the
+ * next alarm is scheduled at an absolute time, and the preset of the following step is
+ * prepared (ping-pong between two presets).
+ *
+ * The control loop only starts the timer (when the power stage is ready) and does the
+ * bookkeeping once the shape ended.
+ *
+ * Alternatively a parametric generator (square, triangle, sine, ...) can be used instead
+ * of the step table. It is evaluated on the fly: from a periodic timer ISR in constant
+ * current mode, and at the control loop tick in constant power / resistance mode.
+ */
 class Shaper {
 
 public:
 
+  /** Shape step (set current in amps) */
   struct Entry {
     float value;
-    uint64_t durationMicros;
+    uint32_t durationMicros;
   };
 
-  Shaper(Load &load, const uint16_t maxEntries)
-    : load(load), maxEntries(maxEntries), nrEntries(0) {
+  /** Parametric generator settings */
+  struct GeneratorConfig {
+    Generator::Type type;
+    Load::Mode mode;
+    float amplitude;    // peak to peak (in amps / watts / ohms)
+    float offset;       // min value (in amps / watts / ohms)
+    float frequencyHz;
+    float duty;         // PWM duty cycle (0.0 - 1.0)
+    uint16_t stairs;    // staircase levels
+    uint32_t repeat;    // number of periods (0 = forever)
+  };
 
-      this->entries = new Entry[maxEntries];
+  enum Source {
+    TABLE,
+    GENERATOR
+  };
+
+  enum State {
+    IDLE,
+    WAITING_POWER,
+    RUNNING,
+    FINISHED,
+    ABORTED
+  };
+
+  /** Consistent status (published by the control loop once per tick) */
+  struct Status {
+    State state;
+  };
+
+  /** Edge timing error: actual vs programmed edge time (in microseconds) */
+  Histogram edgeErrors = Histogram(1);
+
+  Shaper(Load &load, DAC &dac, const uint32_t maxSteps)
+    : load(load), dac(dac), maxSteps(maxSteps), nrSteps(0) {
+
+      // prefer PSRAM (when present), fallback to internal RAM
+      this->steps = (WaveformStep*) heap_caps_malloc_prefer(sizeof(WaveformStep) * maxSteps, 2,
+          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+
+  /** Initialize the playback timer (the alarm interrupt is allocated on the calling core) */
+  bool begin() {
+    if (this->steps == NULL) {
+      // waveform tables can not be loaded (see beginUpload()), the generators still work
+      Serial.println("Shaper step table allocation ERROR!");
+    }
+
+    gptimer_config_t timerConfig = {};
+    timerConfig.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    timerConfig.direction = GPTIMER_COUNT_UP;
+    timerConfig.resolution_hz = SHAPER_TIMER_RESOLUTION_HZ;
+    if (gptimer_new_timer(&timerConfig, &this->timer) != ESP_OK) {
+      Serial.println("Shaper timer setup ERROR!");
+      return false;
+    }
+
+    gptimer_event_callbacks_t callbacks = {};
+    callbacks.on_alarm = &shaperAlarm;
+    if ((gptimer_register_event_callbacks(this->timer, &callbacks, this) != ESP_OK) || (gptimer_enable(this->timer) != ESP_OK)) {
+      Serial.println("Shaper timer setup ERROR!");
+      return false;
+    }
+
+    return true;
+  }
+
+  /** Set the capture triggered by the output edges (optional) */
+  void setCapture(Capture *capture) {
+    this->capture = capture;
+  }
+
+  /** How the last shape ended: FINISHED or ABORTED (IDLE if none yet) */
+  State getLastEndState() {
+    return this->lastEndState;
   }
 
   /** Is the shaper currently active */
   bool isActive() {
-    return this->active;
+    return this->state != IDLE;
+  }
+
+  /** Get the shaper state */
+  State getState() {
+    return this->state;
+  }
+
+  /** Get the source of the shape */
+  Source getSource() {
+    return this->source;
+  }
+
+  /** Get a consistent copy of the latest published status (lock-free, any task) */
+  Status getStatus() {
+    Status status = {};
+    this->status.read(status);
+    return status;
   }
 
-  /** Handle shape generation */
+  /** Handle shape generation (start when the power stage is ready, generator tick, cleanup when ended) */
   void handle() {
-    if (!this->active) {
-      return;
+    switch (this->state) {
+      case WAITING_POWER:
+        if (this->load.isTripped() || !this->load.isEnabled()) {
+          // load disabled while waiting
+          this->lastEndState = ABORTED;
+          this->state = IDLE;
+
+        } else if (this->load.isPowerReady()) {
+          this->startPlayback();
+        }
+        break;
+
+      case RUNNING:
+        if ((this->source == GENERATOR) && (this->generatorConfig.mode != Load::CONSTANT_CURRENT)) {
+          this->handleGeneratorTick();
+        }
+        break;
+
+      default:
+        break;
     }
 
-    uint64_t now = micros();
-    if (this->lastChangeMicros == 0) {
-      // first entry
-      float current = this->entries[this->currentIdx].value;
-      this->load.setCurrent(current);
-      this->lastChangeMicros = micros();
-      return;
+    if ((this->state == FINISHED) || (this->state == ABORTED)) {
+      // end of shape
+      this->finish();
     }
 
-    if (now - this->lastChangeMicros >= this->entries[this->currentIdx].durationMicros) {
-      // move to next entry
-      this->currentIdx++;
-      if (this->currentIdx >= this->nrEntries) {
-        // end of shape
-        this->load.setCurrent(0.0);
-        this->active = false;
-        return;
+    this->publishStatus();
+  }
+
+  /** Load a shape (converted to DAC codes). Not allowed while the shaper is active. */
+  bool setShape(const Entry *entries, uint32_t nrEntries) {
+    if ((nrEntries == 0) || (nrEntries > this->maxSteps)) {
+      return false;
+    }
+
+    for (uint32_t idx = 0; idx < nrEntries; idx++) {
+      if ((entries[idx].value < 0.0) || (entries[idx].value > HardwareValues::MAX_TOTAL_CURRENT)
+          || (entries[idx].durationMicros < SHAPER_MIN_STEP_MICROS)) {
+        // invalid step
+        return false;
       }
+    }
 
-      // set load value
-      float current = this->entries[this->currentIdx].value;
-      this->load.setCurrent(current);
+    if (!this->beginUpload()) {
+      return false;
+    }
 
-      this->lastChangeMicros = now;
+    for (uint32_t idx = 0; idx < nrEntries; idx++) {
+      this->steps[idx].dacValue = entries[idx].value * HardwareValues::currentSetDacMultiplier;
+      this->steps[idx].durationTicks = (uint64_t) entries[idx].durationMicros * SHAPER_TIMER_RESOLUTION_HZ / 1000000;
+    }
+
+    return this->endUpload(nrEntries);
+  }
+
+  /** Use a parametric generator instead of the step table. Not allowed while the shaper is active. */
+  bool setGenerator(const GeneratorConfig &config) {
+    if ((config.amplitude < 0.0) || (config.offset < 0.0)) {
+      return false;
+    }
+
+    float maxValue = config.offset + config.amplitude;
+    switch (config.mode) {
+      case Load::CONSTANT_CURRENT:
+        if ((maxValue > HardwareValues::MAX_TOTAL_CURRENT) || (config.frequencyHz > SHAPER_GENERATOR_MAX_FREQ_CC)) {
+          return false;
+        }
+        break;
+
+      case Load::CONSTANT_POWER:
+        if ((maxValue > HardwareValues::MAX_TOTAL_POWER) || (config.frequencyHz > SHAPER_GENERATOR_MAX_FREQ)) {
+          return false;
+        }
+        break;
+
+      case Load::CONSTANT_RESISTANCE:
+        if ((config.offset < HardwareValues::MIN_TOTAL_RESISTANCE) || (config.frequencyHz > SHAPER_GENERATOR_MAX_FREQ)) {
+          return false;
+        }
+        break;
+
+      default:
+        return false;
+    }
+
+    if (!this->claim()) {
+      return false;
+    }
+
+    if (!this->generator.configure(config.type, config.frequencyHz, config.duty, config.stairs, config.repeat)) {
+      this->uploading = false;
+      return false;
+    }
+
+    // constant current mode: precomputed DAC scaling (integer math in the ISR)
+    this->generatorDacOffset = config.offset * HardwareValues::currentSetDacMultiplier;
+    this->generatorDacSpan = config.amplitude * HardwareValues::currentSetDacMultiplier;
+    this->generatorConfig = config;
+
+    taskENTER_CRITICAL(&this->lock);
+    this->source = GENERATOR;
+    this->uploading = false;
+    taskEXIT_CRITICAL(&this->lock);
+
+    return true;
+  }
+
+  /** Start the loaded shape / generator (the load must be in the mode of the shape, enables the load) */
+  bool start() {
+    if ((this->timer == NULL) || this->load.isTripped()) {
+      return false;
+    }
+
+    // claim the shape (no upload can begin from now on)
+    taskENTER_CRITICAL(&this->lock);
+    bool idle = !this->isActive() && !this->uploading;
+    if (idle) {
+      this->state = WAITING_POWER;
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    if (!idle) {
+      return false;
+    }
+
+    bool valid = true;
+    if ((this->source == TABLE) && ((this->nrSteps == 0) || (this->load.getMode() != Load::CONSTANT_CURRENT))) {
+      valid = false;
+    }
+
+    if ((this->source == GENERATOR) && (this->load.getMode() != this->generatorConfig.mode)) {
+      valid = false;
+    }
+
+    if (valid && (this->source == GENERATOR) && (this->generatorConfig.mode != Load::CONSTANT_CURRENT)) {
+      // first set point (a zero set power / current would disable the load while waiting)
+      this->generator.reset();
+      this->applyGeneratorValue();
+    }
+
+    // the timer is started once the power stage is ready
+    if (!valid || !this->load.setEnabled(true)) {
+      this->state = IDLE;
+      return false;
+    }
+
+    this->handle();
+
+    return true;
+  }
+
+  /** Stop the shape (the current is set to zero) */
+  void stop() {
+    if (this->state == RUNNING) {
+      this->state = ABORTED;
+    } else if (this->state == WAITING_POWER) {
+      this->lastEndState = ABORTED;
+      this->state = IDLE;
     }
   }
 
   /** Generate a current pulse */
   bool pulse(float current, uint32_t durationMicros) {
-    this->entries[0].value = 0.0;
-    this->entries[0].durationMicros = 0;
-    this->currentIdx = 0;
-    this->nrEntries = 1;
-    this->lastChangeMicros = 0;
-    this->active = true;
+    Entry entry = { current, durationMicros };
+    return this->setShape(&entry, 1) && this->start();
+  }
+
+  /**
+   * Start a waveform upload (the loaded shape is discarded, any task). Not allowed while the
+   * shaper is active, another upload is in progress, or the step table could not be allocated.
+   *
+   * Until endUpload() the step table belongs to the uploader (see getSteps()).
+   */
+  bool beginUpload() {
+    if ((this->steps == NULL) || !this->claim()) {
+      return false;
+    }
+
+    this->nrSteps = 0;
     return true;
   }
 
+  /** Finish a waveform upload (any task, nrSteps: number of valid steps written, 0 on failure) */
+  bool endUpload(uint32_t nrSteps) {
+    if (nrSteps > this->maxSteps) {
+      nrSteps = 0;
+    }
+
+    taskENTER_CRITICAL(&this->lock);
+    bool uploading = this->uploading;
+    if (uploading) {
+      this->nrSteps = nrSteps;
+      this->source = TABLE;
+      this->uploading = false;
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return uploading && (nrSteps > 0);
+  }
+
+  /** Step table (written by the uploader between beginUpload() and endUpload()) */
+  WaveformStep *getSteps() {
+    return this->steps;
+  }
+
+  /** Max number of steps */
+  uint32_t getMaxSteps() {
+    return this->maxSteps;
+  }
+
+  /** Number of steps of the loaded shape */
+  uint32_t getNrSteps() {
+    return this->nrSteps;
+  }
+
+  /** Reset the edge timing statistics */
+  void resetStats() {
+    this->edgeErrors.reset();
+  }
+
+  /** Handle a step boundary / generator tick (called from the timer alarm ISR) */
+  void ARDUINO_ISR_ATTR handleAlarm(const gptimer_alarm_event_data_t *edata) {
+    if (this->state != RUNNING) {
+      return;
+    }
+
+    if (this->load.isTripped() || !this->load.isPowerReady()) {
+      // protection tripped / load disabled => stop
+      this->dac.setPreset(HardwareValues::DAC_PRESET_ZERO);
+      this->state = ABORTED;
+      return;
+    }
+
+    if (this->source == GENERATOR) {
+      this->handleGeneratorAlarm();
+    } else {
+      this->handleTableAlarm(edata);
+    }
+  }
+
 private:
+
   Load &load;
-  Entry *entries;
-  uint16_t nrEntries;
-  const uint16_t maxEntries;
+  DAC &dac;
+  const uint32_t maxSteps;
+  WaveformStep *steps;
+  volatile uint32_t nrSteps;
+
+  /** Shape being written (upload in progress, from the web server or setShape() / setGenerator()) */
+  volatile bool uploading = false;
+
+  /** Protects the shape ownership (upload vs. start, from different tasks) */
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  /** Claim the shape for writing (released by clearing uploading). Not while active, or already claimed. */
+  bool claim() {
+    taskENTER_CRITICAL(&this->lock);
+    bool idle = !this->isActive() && !this->uploading;
+    if (idle) {
+      this->uploading = true;
+    }
+    taskEXIT_CRITICAL(&this->lock);
 
-  bool active = false;
-  uint16_t currentIdx = 0;
-  uint64_t lastChangeMicros = 0;
+    return idle;
+  }
+
+  gptimer_handle_t timer = NULL;
+  bool timerRunning = false;
+
+  volatile Source source = TABLE;
+  volatile State state = IDLE;
+
+  /** How the last shape ended (FINISHED / ABORTED) */
+  State lastEndState = IDLE;
+  volatile uint32_t currentIdx = 0;
+  uint64_t alarmCount = 0;
+  uint16_t nextPreset = HardwareValues::DAC_PRESET_SHAPER_A;
+
+  Capture *capture = NULL;
+
+  Generator generator;
+  GeneratorConfig generatorConfig = {};
+  uint32_t generatorDacOffset = 0;
+  uint32_t generatorDacSpan = 0;
+  uint64_t generatorTickMicros = 0;
+
+  /** Status seen by the other tasks */
+  Snapshot<Status> status;
+
+  /** Publish the current status */
+  void publishStatus() {
+    Status status;
+    status.state = this->state;
+
+    this->status.publish(status);
+  }
+
+  /** Step table: apply the next step */
+  void ARDUINO_ISR_ATTR handleTableAlarm(const gptimer_alarm_event_data_t *edata) {
+    this->currentIdx++;
+    if (this->currentIdx >= this->nrSteps) {
+      // end of shape
+      this->dac.setPreset(HardwareValues::DAC_PRESET_ZERO);
+      this->state = FINISHED;
+      return;
+    }
+
+    // apply the step (prepared in advance)
+    if (!this->load.setDacPresetFromISR(this->nextPreset)) {
+      // tripped since the check in handleAlarm()
+      this->state = ABORTED;
+      return;
+    }
+    this->triggerCapture();
+
+    uint64_t now = 0;
+    gptimer_get_raw_count(this->timer, &now);
+    this->edgeErrors.add(now - edata->alarm_value);
+
+    // schedule the next edge (absolute time, no accumulated drift)
+    this->alarmCount += this->steps[this->currentIdx].durationTicks;
+    gptimer_alarm_config_t alarmConfig = {};
+    alarmConfig.alarm_count = this->alarmCount;
+    gptimer_set_alarm_action(this->timer, &alarmConfig);
+
+    // prepare the following step
+    this->nextPreset = (this->nextPreset == HardwareValues::DAC_PRESET_SHAPER_A) ? HardwareValues::DAC_PRESET_SHAPER_B : HardwareValues::DAC_PRESET_SHAPER_A;
+    if (this->currentIdx + 1 < this->nrSteps) {
+      this->dac.preparePreset(this->nextPreset, this->steps[this->currentIdx + 1].dacValue);
+    }
+  }
+
+  /** Output edge: trigger the capture (table steps and the start of the generator only) */
+  void ARDUINO_ISR_ATTR triggerCapture() {
+    if (this->capture != NULL) {
+      this->capture->trigger(Capture::OUTPUT_EDGE);
+    }
+  }
+
+  /** Generator (constant current mode): periodic tick */
+  void ARDUINO_ISR_ATTR handleGeneratorAlarm() {
+    if (!this->generator.advance(SHAPER_GENERATOR_TICK_MICROS)) {
+      // all periods generated
+      this->dac.setPreset(HardwareValues::DAC_PRESET_ZERO);
+      this->state = FINISHED;
+      return;
+    }
+
+    if (!this->load.setDacFromISR(this->generatorDacValue())) {
+      // tripped since the check in handleAlarm()
+      this->state = ABORTED;
+      return;
+    }
+
+    // auto-reload => the count is the time since the alarm
+    uint64_t now = 0;
+    gptimer_get_raw_count(this->timer, &now);
+    this->edgeErrors.add(now);
+  }
+
+  /** Generator (constant current mode): DAC value of the current sample */
+  uint16_t ARDUINO_ISR_ATTR generatorDacValue() {
+    return this->generatorDacOffset + ((this->generatorDacSpan * this->generator.sample()) >> 16);
+  }
+
+  /** Generator (constant power / resistance mode): control loop tick */
+  void handleGeneratorTick() {
+    if (this->load.isTripped() || !this->load.isEnabled()) {
+      // protection tripped / load disabled => stop (the power stage may still be enabling)
+      this->state = ABORTED;
+      return;
+    }
+
+    uint64_t now = esp_timer_get_time();
+    uint32_t elapsedMicros = now - this->generatorTickMicros;
+    this->generatorTickMicros = now;
+
+    if (!this->generator.advance(elapsedMicros)) {
+      // all periods generated
+      this->state = FINISHED;
+      return;
+    }
+
+    this->applyGeneratorValue();
+  }
+
+  /** Generator (constant power / resistance mode): apply the current sample */
+  void applyGeneratorValue() {
+    float value = this->generatorConfig.offset + this->generatorConfig.amplitude * this->generator.sample() / Generator::SAMPLE_MAX;
+    if (this->generatorConfig.mode == Load::CONSTANT_POWER) {
+      this->load.setPower(value > SHAPER_GENERATOR_MIN_POWER ? value : SHAPER_GENERATOR_MIN_POWER);
+    } else {
+      this->load.setResistance(value);
+    }
+  }
+
+  /** Start the playback (first step / sample applied immediately) */
+  void startPlayback() {
+    this->generator.reset();
+
+    if (this->source == GENERATOR) {
+      if (this->generatorConfig.mode != Load::CONSTANT_CURRENT) {
+        // evaluated by the control loop
+        this->generatorTickMicros = esp_timer_get_time();
+        this->state = RUNNING;
+        this->applyGeneratorValue();
+        this->triggerCapture();
+        return;
+      }
+
+      // periodic timer tick
+      gptimer_set_raw_count(this->timer, 0);
+      gptimer_alarm_config_t alarmConfig = {};
+      alarmConfig.alarm_count = (uint64_t) SHAPER_GENERATOR_TICK_MICROS * SHAPER_TIMER_RESOLUTION_HZ / 1000000;
+      alarmConfig.reload_count = 0;
+      alarmConfig.flags.auto_reload_on_alarm = true;
+      gptimer_set_alarm_action(this->timer, &alarmConfig);
+
+      if (!this->load.setDac(this->generatorDacValue())) {
+        // tripped (cleaned up by handle())
+        this->state = ABORTED;
+        return;
+      }
+      this->state = RUNNING;
+      this->triggerCapture();
+      this->timerRunning = gptimer_start(this->timer) == ESP_OK;
+      return;
+    }
+
+    this->currentIdx = 0;
+    this->dac.preparePreset(HardwareValues::DAC_PRESET_SHAPER_A, this->steps[0].dacValue);
+    if (this->nrSteps > 1) {
+      this->dac.preparePreset(HardwareValues::DAC_PRESET_SHAPER_B, this->steps[1].dacValue);
+    }
+    this->nextPreset = HardwareValues::DAC_PRESET_SHAPER_B;
+
+    gptimer_set_raw_count(this->timer, 0);
+    this->alarmCount = this->steps[0].durationTicks;
+    gptimer_alarm_config_t alarmConfig = {};
+    alarmConfig.alarm_count = this->alarmCount;
+    gptimer_set_alarm_action(this->timer, &alarmConfig);
+
+    if (!this->load.setDacPreset(HardwareValues::DAC_PRESET_SHAPER_A)) {
+      // tripped (cleaned up by handle())
+      this->state = ABORTED;
+      return;
+    }
+    this->state = RUNNING;
+    this->triggerCapture();
+    this->timerRunning = gptimer_start(this->timer) == ESP_OK;
+  }
+
+  /** End of shape: stop the timer, reset the set point */
+  void finish() {
+    if (this->timerRunning) {
+      gptimer_stop(this->timer);
+      this->timerRunning = false;
+    }
+
+    if ((this->source == GENERATOR) && (this->generatorConfig.mode == Load::CONSTANT_POWER)) {
+      this->load.setPower(0.0);
+
+    } else if ((this->source == GENERATOR) && (this->generatorConfig.mode == Load::CONSTANT_RESISTANCE)) {
+      this->load.setResistance(10000000.0);
+
+    } else {
+      this->load.setCurrent(0.0);
+    }
+
+    this->lastEndState = this->state;
+    this->state = IDLE;
+  }
 };
 
 #endif
\ No newline at end of file
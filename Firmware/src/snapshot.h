@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Versioned snapshot of a value, published by a single writer (seqlock, double buffered).
+ *
+ * The writer always fills the slot not referenced by the latest version, so it never
+ * waits for the readers. Readers take a consistent copy without locking, and retry only
+ * if the writer got around to reusing their slot while they were copying it. Because the
+ * latest slot is never written in place, a reader preempting the writer (single core)
+ * does not spin.
+ */
+template<typename T>
+class Snapshot {
+
+public:
+
+  Snapshot() {
+    for (uint8_t idx = 0; idx < 2; idx++) {
+      this->slots[idx].guard.store(0, std::memory_order_relaxed);
+      this->slots[idx].version = 0;
+    }
+  }
+
+  /** Publish a new value (single writer only) */
+  void publish(const T &value) {
+    uint32_t version = this->nextVersion();
+    Slot &slot = this->slots[version & 1];
+
+    // mark the slot as being written (odd guard)
+    uint32_t guard = slot.guard.load(std::memory_order_relaxed);
+    slot.guard.store(guard + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.value = value;
+    slot.version = version;
+
+    slot.guard.store(guard + 2, std::memory_order_release);
+    this->latest.store(version, std::memory_order_release);
+  }
+
+  /** Take a copy of the latest value. Returns the version of the copy (0 if nothing was published yet). */
+  uint32_t read(T &value) const {
+    while (true) {
+      uint32_t version = this->latest.load(std::memory_order_acquire);
+      if (version == 0) {
+        // nothing published yet
+        return 0;
+      }
+
+      const Slot &slot = this->slots[version & 1];
+      uint32_t guard = slot.guard.load(std::memory_order_acquire);
+      if ((guard & 1) != 0) {
+        // slot being reused => retry with the newer version
+        continue;
+      }
+
+      value = slot.value;
+      uint32_t slotVersion = slot.version;
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      if ((slot.guard.load(std::memory_order_relaxed) == guard) && (slotVersion == version)) {
+        return version;
+      }
+
+      // overwritten while copying (or already reused) => retry
+    }
+  }
+
+  /** Version of the latest published value (incremented on each publish, 0 is skipped on wrap around) */
+  uint32_t getVersion() const {
+    return this->latest.load(std::memory_order_acquire);
+  }
+
+  /** Version of the next published value (writer only) */
+  uint32_t nextVersion() const {
+    uint32_t version = this->latest.load(std::memory_order_relaxed) + 1;
+    if (version == 0) {
+      // wrapped around (0: nothing published, 2 keeps the slots alternating)
+      version = 2;
+    }
+    return version;
+  }
+
+private:
+
+  struct Slot {
+    /** Odd while the slot is being written */
+    std::atomic<uint32_t> guard;
+    uint32_t version;
+    T value;
+  };
+
+  Slot slots[2];
+  std::atomic<uint32_t> latest { 0 };
+};
+
+#endif
\ No newline at end of file
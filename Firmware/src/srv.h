@@ -9,6 +9,8 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 #include "dac.h"
+#include "adc.h"
+#include "control.h"
 
 extern volatile uint8_t restartRequest;
 
@@ -20,8 +22,8 @@ public:
   /**
    * Instantiates the Web Server.
    */
-  Service(DAC &dac, ADC &adc)
-    : dac(dac), adc(adc) {
+  Service(DAC &dac, ADC &adc, ControlLoop &controlLoop)
+    : dac(dac), adc(adc), controlLoop(controlLoop) {
   }
 
   void dacSet(uint16_t value) {
@@ -42,6 +44,16 @@ public:
     }
   }
 
+  /** Continuous ADC DMA frame decode statistics (in CPU cycles) */
+  RunningStats& getAdcDecodeStats() {
+    return adc.decodeCycles;
+  }
+
+  /** Control loop wakeup latency / jitter statistics */
+  ControlLoop& getControlLoop() {
+    return controlLoop;
+  }
+
   void progModeRestart() {
     Serial.println("Requesting programming mode restart...");
     restartRequest = 2;
@@ -55,6 +67,7 @@ public:
 private:
   DAC& dac;
   ADC& adc;
+  ControlLoop& controlLoop;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <Arduino.h>
+
+/**
+ * Min / max / average statistics of a measured quantity (ex. CPU cycles).
+ *
+ * Updated from a single context (can be an ISR). Readers on other cores may see
+ * slightly inconsistent values, which is acceptable for diagnostics.
+ */
+class RunningStats {
+
+public:
+
+  /** Add a new value */
+  void add(uint32_t value) {
+    if ((this->count == 0) || (value < this->min)) {
+      this->min = value;
+    }
+    if (value > this->max) {
+      this->max = value;
+    }
+    this->sum += value;
+    this->count++;
+  }
+
+  /** Reset the statistics */
+  void reset() {
+    this->count = 0;
+    this->sum = 0;
+    this->min = 0;
+    this->max = 0;
+  }
+
+  uint32_t getCount() {
+    return this->count;
+  }
+
+  uint32_t getMin() {
+    return this->min;
+  }
+
+  uint32_t getMax() {
+    return this->max;
+  }
+
+  float getAvg() {
+    uint32_t count = this->count;
+    return count > 0 ? (float) this->sum / count : 0.0;
+  }
+
+private:
+  volatile uint32_t count = 0;
+  volatile uint64_t sum = 0;
+  volatile uint32_t min = 0;
+  volatile uint32_t max = 0;
+};
+
+/**
+ * Histogram with fixed width buckets (the last bucket collects all the larger values).
+ *
+ * Updated from a single context, same consistency rules as RunningStats.
+ */
+class Histogram {
+
+public:
+
+  static const uint8_t NR_BUCKETS = 16;
+
+  Histogram(const uint32_t bucketWidth)
+    : bucketWidth(bucketWidth) {
+  }
+
+  /** Add a new value */
+  void add(uint32_t value) {
+    uint32_t idx = value / this->bucketWidth;
+    if (idx >= NR_BUCKETS) {
+      idx = NR_BUCKETS - 1;
+    }
+    this->buckets[idx]++;
+    this->stats.add(value);
+  }
+
+  /** Reset the histogram */
+  void reset() {
+    for (uint8_t idx = 0; idx < NR_BUCKETS; idx++) {
+      this->buckets[idx] = 0;
+    }
+    this->stats.reset();
+  }
+
+  uint32_t getBucketWidth() {
+    return this->bucketWidth;
+  }
+
+  uint32_t getBucket(uint8_t idx) {
+    return this->buckets[idx];
+  }
+
+  RunningStats& getStats() {
+    return this->stats;
+  }
+
+  /** Format the histogram as a JSON object. Returns the number of characters written. */
+  size_t toJson(char *buffer, size_t size) {
+    size_t len = snprintf(buffer, size, "{ \"bucketWidth\": %u, \"min\": %u, \"max\": %u, \"avg\": %.1f, \"count\": %u, \"buckets\": [",
+        (unsigned int) this->bucketWidth, (unsigned int) this->stats.getMin(), (unsigned int) this->stats.getMax(),
+        this->stats.getAvg(), (unsigned int) this->stats.getCount());
+
+    for (uint8_t idx = 0; (idx < NR_BUCKETS) && (len < size); idx++) {
+      len += snprintf(buffer + len, size - len, idx == 0 ? "%u" : ", %u", (unsigned int) this->buckets[idx]);
+    }
+
+    if (len < size) {
+      len += snprintf(buffer + len, size - len, "] }");
+    }
+
+    return len < size ? len : size - 1;
+  }
+
+private:
+  const uint32_t bucketWidth;
+  volatile uint32_t buckets[NR_BUCKETS] = { 0 };
+  RunningStats stats;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <Arduino.h>
+#include <Adafruit_TinyUSB.h>
+#include "samples.h"
+
+/**
+ * Raw sample stream packet format (little endian, receiver: tools/stream_receiver.cpp):
+ *
+ *   header (20 bytes):
+ *     uint32_t magic             "STRM"
+ *     uint16_t version           1
+ *     uint16_t recordSize        24
+ *     uint32_t packetSeq         packet sequence number (from 0, since the port was opened)
+ *     uint32_t dropped           frames dropped by the device so far (stream too slow)
+ *     uint16_t nrRecords         STREAM_RECORDS_PER_PACKET
+ *     uint16_t reserved
+ *
+ *   records (24 bytes each):
+ *     uint32_t seq               ADC frame sequence number (a gap means lost frames)
+ *     uint64_t timestampMicros
+ *     uint16_t values[6]         raw ADC codes
+ */
+const uint32_t STREAM_MAGIC = 0x4D525453; // "STRM"
+const uint16_t STREAM_VERSION = 1;
+
+/** Frames per packet (~4ms @ 4.1 kHz) */
+const uint16_t STREAM_RECORDS_PER_PACKET = 16;
+
+/** Sample stream task core (together with WiFi / AsyncTCP, away from the control loop on the S3) */
+const BaseType_t STREAM_CORE = 0;
+
+/**
+ * Raw ADC sample stream on a (third) USB CDC port.
+ *
+ * Streams every frame of the sample buffer at the full continuous ADC rate, while the port
+ * is open on the host (DTR set). The frames are read through the stream's own cursor, and
+ * written only as much as fits into the CDC transmit buffer (never blocks). If the host does
+ * not keep up, the overwritten frames are skipped and counted as dropped.
+ */
+class SampleStream {
+
+public:
+
+  struct __attribute__((packed)) Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t packetSeq;
+    uint32_t dropped;
+    uint16_t nrRecords;
+    uint16_t reserved;
+  };
+
+  struct __attribute__((packed)) Record {
+    uint32_t seq;
+    uint64_t timestampMicros;
+    uint16_t values[SAMPLE_MAX_CHANNELS];
+  };
+
+  SampleStream(SampleBuffer &samples)
+    : samples(samples), cursor(samples) {
+  }
+
+  /** Start the USB CDC interface (must be re-enumerated if the USB device is already mounted) */
+  void begin() {
+    this->cdc.setStringDescriptor("Sample Stream");
+    this->cdc.begin(115200);
+  }
+
+  /** Send the new frames (sample stream task) */
+  void handle() {
+    if (!this->cdc.dtr()) {
+      // port closed
+      this->streaming = false;
+      return;
+    }
+
+    if (!this->streaming) {
+      // port opened => start with the next frame
+      this->cursor.seek(this->samples.head());
+      this->droppedBase = this->cursor.getDropped();
+      this->packetSeq = 0;
+      this->pendingLen = 0;
+      this->pendingIdx = 0;
+      this->streaming = true;
+    }
+
+    bool written = false;
+    while (true) {
+      if ((this->pendingIdx == this->pendingLen) && !this->formatPacket()) {
+        break;
+      }
+
+      size_t space = this->cdc.availableForWrite();
+      if (space == 0) {
+        break;
+      }
+
+      size_t len = min(space, (size_t) (this->pendingLen - this->pendingIdx));
+      len = this->cdc.write(this->pending + this->pendingIdx, len);
+      this->pendingIdx += len;
+      written = true;
+    }
+
+    if (written) {
+      this->cdc.flush();
+    }
+  }
+
+private:
+  SampleBuffer &samples;
+  SampleBuffer::Cursor cursor;
+
+  Adafruit_USBD_CDC cdc;
+
+  bool streaming = false;
+  uint32_t packetSeq = 0;
+  uint32_t droppedBase = 0;
+
+  /** Formatted packet (partially sent) */
+  uint8_t pending[sizeof(Header) + STREAM_RECORDS_PER_PACKET * sizeof(Record)];
+  size_t pendingLen = 0;
+  size_t pendingIdx = 0;
+
+  /** Format the next packet. Returns false if there are not enough new frames yet. */
+  bool formatPacket() {
+    if (this->cursor.available() < STREAM_RECORDS_PER_PACKET) {
+      return false;
+    }
+
+    for (uint16_t idx = 0; idx < STREAM_RECORDS_PER_PACKET; idx++) {
+      SampleFrame frame;
+      if (!this->cursor.read(frame)) {
+        return false;
+      }
+
+      Record record;
+      record.seq = frame.seq;
+      record.timestampMicros = frame.timestampMicros;
+      memcpy(record.values, frame.values, sizeof(record.values));
+      memcpy(this->pending + sizeof(Header) + idx * sizeof(Record), &record, sizeof(record));
+    }
+
+    // header after the records (the dropped count includes the frames skipped while reading them)
+    Header header;
+    header.magic = STREAM_MAGIC;
+    header.version = STREAM_VERSION;
+    header.recordSize = sizeof(Record);
+    header.packetSeq = this->packetSeq++;
+    header.dropped = this->cursor.getDropped() - this->droppedBase;
+    header.nrRecords = STREAM_RECORDS_PER_PACKET;
+    header.reserved = 0;
+    memcpy(this->pending, &header, sizeof(header));
+
+    this->pendingLen = sizeof(this->pending);
+    this->pendingIdx = 0;
+    return true;
+  }
+};
+
+#endif
\ No newline at end of file
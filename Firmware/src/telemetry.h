@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+#include <ESPAsyncWebServer.h>
+#include "load.h"
+
+/** Max number of telemetry clients */
+const uint8_t TELEMETRY_MAX_CLIENTS = 4;
+
+/** Telemetry rate limits (in Hz) */
+const uint8_t TELEMETRY_MIN_RATE_HZ = 1;
+const uint8_t TELEMETRY_MAX_RATE_HZ = 100;
+const uint8_t TELEMETRY_DEFAULT_RATE_HZ = 10;
+
+/** Per client queue size (messages, the oldest is dropped when full) */
+const uint8_t TELEMETRY_QUEUE_SIZE = 16;
+
+/** Max messages handed over to the WebSocket client at once (the rest waits in our queue) */
+const uint8_t TELEMETRY_MAX_IN_FLIGHT = 2;
+
+/**
+ * Telemetry message formats (binary WebSocket messages, little endian):
+ *
+ *   measurement (32 bytes):
+ *     uint8_t  type                 1
+ *     uint8_t  reserved[3]
+ *     uint32_t seq                  ADC frame sequence number
+ *     uint64_t timestampMicros      (since boot)
+ *     float    voltage, current, power, temperature
+ *
+ *   state delta (2 + 5 * N bytes):
+ *     uint8_t  type                 2
+ *     uint8_t  nrFields
+ *     N x { uint8_t field, float value }   changed fields only (all on the first message,
+ *                                          and after a dropped state message)
+ *
+ * Client messages (text): "rate <hz>" (1 - 100 Hz, default 10 Hz)
+ */
+const uint8_t TELEMETRY_MSG_MEASUREMENT = 1;
+const uint8_t TELEMETRY_MSG_STATE = 2;
+
+/** Serialized message, shared by all the client queues (reference counted) */
+typedef std::shared_ptr<std::vector<uint8_t>> TelemetryBuffer;
+
+/**
+ * Push based telemetry over WebSocket (/ws), with multi-client fan-out.
+ *
+ * Every message is serialized once into a shared buffer, and queued for the clients
+ * (measurements at the rate of each client, state deltas on every change). Each client
+ * has its own bounded queue: when a client is too slow its oldest messages are dropped
+ * (and counted), so it never delays the other clients or the control loop.
+ *
+ * Runs in the loop() task (not in the AsyncTCP task or the control loop).
+ */
+class Telemetry {
+
+public:
+
+  /** State fields (state delta messages) */
+  enum Field : uint8_t {
+    ENABLED,
+    MODE,
+    POWER_STATE,
+    PROTECTION_STATE,
+    SET_CURRENT,
+    SET_POWER,
+    SET_RESISTANCE,
+    FAN_SPEED,
+    OVER_TEMPERATURE_LIMIT,
+    OVER_CURRENT_LIMIT,
+    OVER_VOLTAGE_LIMIT,
+    OVER_POWER_LIMIT,
+    NR_FIELDS
+  };
+
+  struct __attribute__((packed)) MeasurementMessage {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t seq;
+    uint64_t timestampMicros;
+    float voltage;
+    float current;
+    float power;
+    float temperature;
+  };
+
+  struct __attribute__((packed)) StateField {
+    uint8_t field;
+    float value;
+  };
+
+  /** Client statistics */
+  struct ClientStats {
+    uint32_t id;
+    uint8_t rateHz;
+    uint8_t queued;
+    uint32_t sentMessages;
+    uint32_t droppedMessages;
+    uint32_t connectedMs;
+  };
+
+  Telemetry(Load &load)
+    : ws("/ws"), load(load) {
+
+      this->ws.onEvent([this](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+        this->handleEvent(client, type, arg, data, len);
+      });
+  }
+
+  /** WebSocket handler (to be added to the web server) */
+  AsyncWebSocket& getHandler() {
+    return this->ws;
+  }
+
+  /** Client statistics (any task, best effort). Returns the number of clients. */
+  uint8_t getClientStats(ClientStats *stats, uint8_t maxClients) {
+    uint8_t nrClients = 0;
+    uint32_t now = millis();
+
+    for (uint8_t idx = 0; (idx < TELEMETRY_MAX_CLIENTS) && (nrClients < maxClients); idx++) {
+      Client &client = this->clients[idx];
+      if ((client.id == 0) || (client.queueOwner != client.id)) {
+        continue;
+      }
+
+      ClientStats &clientStats = stats[nrClients++];
+      clientStats.id = client.id;
+      clientStats.rateHz = client.rateHz;
+      clientStats.queued = client.queueLen;
+      clientStats.sentMessages = client.sentMessages;
+      clientStats.droppedMessages = client.droppedMessages;
+      clientStats.connectedMs = now - client.connectedMs;
+    }
+
+    return nrClients;
+  }
+
+  /** Queue and send the messages (called from loop()) */
+  void handle() {
+    uint32_t now = millis();
+    if (now - this->lastCleanupMs >= 1000) {
+      this->ws.cleanupClients(TELEMETRY_MAX_CLIENTS);
+      this->lastCleanupMs = now;
+    }
+
+    Load::State state = this->load.getState();
+
+    // serialized once, shared by the clients
+    TelemetryBuffer measurementBuffer;
+    TelemetryBuffer stateDeltaBuffer = this->serializeStateDelta(state);
+    TelemetryBuffer fullStateBuffer;
+
+    for (uint8_t idx = 0; idx < TELEMETRY_MAX_CLIENTS; idx++) {
+      Client &client = this->clients[idx];
+
+      taskENTER_CRITICAL(&this->lock);
+      uint32_t id = client.id;
+      uint8_t rateHz = client.rateHz;
+      taskEXIT_CRITICAL(&this->lock);
+
+      if (id == 0) {
+        if (client.queueOwner != 0) {
+          // disconnected
+          this->resetQueue(client, 0);
+        }
+        continue;
+      }
+
+      // (the rate of a free slot is 0)
+      uint32_t periodMs = 1000 / rateHz;
+
+      if (client.queueOwner != id) {
+        // new client: starts with the full state
+        this->resetQueue(client, id);
+        client.connectedMs = now;
+        client.resync = true;
+      }
+
+      if (client.resync) {
+        if (!fullStateBuffer) {
+          fullStateBuffer = this->serializeFullState();
+        }
+        this->enqueue(client, fullStateBuffer);
+        client.resync = false;
+
+      } else if (stateDeltaBuffer) {
+        this->enqueue(client, stateDeltaBuffer);
+      }
+
+      if (now - client.lastMeasurementMs >= periodMs) {
+        if (!measurementBuffer) {
+          measurementBuffer = this->serializeMeasurement(state.measurement);
+        }
+        this->enqueue(client, measurementBuffer);
+        client.lastMeasurementMs = now;
+      }
+
+      this->flush(client);
+    }
+  }
+
+private:
+  AsyncWebSocket ws;
+  Load &load;
+
+  /** Per client settings, queue and statistics */
+  struct Client {
+    uint32_t id;            // set / cleared by the WebSocket events
+    uint8_t rateHz;
+
+    uint32_t queueOwner;    // id of the client owning the queue (loop() task only from here on)
+    TelemetryBuffer queue[TELEMETRY_QUEUE_SIZE];
+    uint8_t queueHead;
+    uint8_t queueLen;
+    bool resync;
+    uint32_t lastMeasurementMs;
+    uint32_t connectedMs;
+
+    uint32_t sentMessages;
+    uint32_t droppedMessages;
+  };
+
+  Client clients[TELEMETRY_MAX_CLIENTS] = {};
+
+  /** Protects the client ids / settings (AsyncTCP task vs loop() task) */
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+  /** Last state sent to the clients (state deltas) */
+  float lastFields[NR_FIELDS];
+  bool lastFieldsValid = false;
+
+  uint32_t lastCleanupMs = 0;
+
+  /** Queue a message (the oldest one is dropped if full) */
+  void enqueue(Client &client, const TelemetryBuffer &buffer) {
+    if (client.queueLen >= TELEMETRY_QUEUE_SIZE) {
+      TelemetryBuffer &oldest = client.queue[client.queueHead];
+      if ((*oldest)[0] == TELEMETRY_MSG_STATE) {
+        // a state delta is lost => send the full state next time
+        client.resync = true;
+      }
+
+      oldest.reset();
+      client.queueHead = (client.queueHead + 1) % TELEMETRY_QUEUE_SIZE;
+      client.queueLen--;
+      client.droppedMessages++;
+    }
+
+    client.queue[(client.queueHead + client.queueLen) % TELEMETRY_QUEUE_SIZE] = buffer;
+    client.queueLen++;
+  }
+
+  /** Hand over the queued messages to the WebSocket client (while it can take them) */
+  void flush(Client &client) {
+    AsyncWebSocketClient *wsClient = this->ws.client(client.queueOwner);
+    if (wsClient == NULL) {
+      return;
+    }
+
+    while ((client.queueLen > 0) && (wsClient->queueLen() < TELEMETRY_MAX_IN_FLIGHT)) {
+      TelemetryBuffer &buffer = client.queue[client.queueHead];
+      if (!wsClient->binary(buffer)) {
+        break;
+      }
+
+      buffer.reset();
+      client.queueHead = (client.queueHead + 1) % TELEMETRY_QUEUE_SIZE;
+      client.queueLen--;
+      client.sentMessages++;
+    }
+  }
+
+  /** Clear the queue and the statistics of a client slot */
+  void resetQueue(Client &client, uint32_t owner) {
+    for (uint8_t idx = 0; idx < TELEMETRY_QUEUE_SIZE; idx++) {
+      client.queue[idx].reset();
+    }
+    client.queueHead = 0;
+    client.queueLen = 0;
+    client.lastMeasurementMs = 0;
+    client.sentMessages = 0;
+    client.droppedMessages = 0;
+    client.queueOwner = owner;
+  }
+
+  TelemetryBuffer serializeMeasurement(const Load::Measurement &measurement) {
+    MeasurementMessage message = {};
+    message.type = TELEMETRY_MSG_MEASUREMENT;
+    message.seq = measurement.seq;
+    message.timestampMicros = measurement.timestampMicros;
+    message.voltage = measurement.voltage;
+    message.current = measurement.current;
+    message.power = measurement.power;
+    message.temperature = measurement.temperature;
+
+    const uint8_t *data = (const uint8_t *) &message;
+    return std::make_shared<std::vector<uint8_t>>(data, data + sizeof(message));
+  }
+
+  /** State fields changed since the last call (empty if no change) */
+  TelemetryBuffer serializeStateDelta(const Load::State &state) {
+    float fields[NR_FIELDS];
+    fields[ENABLED] = state.enabled;
+    fields[MODE] = state.mode;
+    fields[POWER_STATE] = state.powerState;
+    fields[PROTECTION_STATE] = state.protectionState;
+    fields[SET_CURRENT] = state.setCurrent;
+    fields[SET_POWER] = state.setPower;
+    fields[SET_RESISTANCE] = state.setResistance;
+    fields[FAN_SPEED] = state.fanSpeed;
+    fields[OVER_TEMPERATURE_LIMIT] = state.overTemperatureLimit;
+    fields[OVER_CURRENT_LIMIT] = state.overCurrentLimit;
+    fields[OVER_VOLTAGE_LIMIT] = state.overVoltageLimit;
+    fields[OVER_POWER_LIMIT] = state.overPowerLimit;
+
+    bool changed[NR_FIELDS];
+    uint8_t nrChanged = 0;
+    for (uint8_t field = 0; field < NR_FIELDS; field++) {
+      changed[field] = !this->lastFieldsValid || (fields[field] != this->lastFields[field]);
+      if (changed[field]) {
+        nrChanged++;
+      }
+      this->lastFields[field] = fields[field];
+    }
+    this->lastFieldsValid = true;
+
+    if (nrChanged == 0) {
+      return TelemetryBuffer();
+    }
+
+    return this->serializeState(fields, changed, nrChanged);
+  }
+
+  /** All the state fields (new clients, after a dropped state delta) */
+  TelemetryBuffer serializeFullState() {
+    bool changed[NR_FIELDS];
+    for (uint8_t field = 0; field < NR_FIELDS; field++) {
+      changed[field] = true;
+    }
+
+    return this->serializeState(this->lastFields, changed, NR_FIELDS);
+  }
+
+  TelemetryBuffer serializeState(const float *fields, const bool *included, uint8_t nrIncluded) {
+    TelemetryBuffer buffer = std::make_shared<std::vector<uint8_t>>(2 + nrIncluded * sizeof(StateField));
+    uint8_t *data = buffer->data();
+    data[0] = TELEMETRY_MSG_STATE;
+    data[1] = nrIncluded;
+
+    StateField *stateFields = (StateField *) (data + 2);
+    for (uint8_t field = 0; field < NR_FIELDS; field++) {
+      if (included[field]) {
+        stateFields->field = field;
+        stateFields->value = fields[field];
+        stateFields++;
+      }
+    }
+
+    return buffer;
+  }
+
+  /** WebSocket events (AsyncTCP task) */
+  void handleEvent(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    switch (type) {
+      case WS_EVT_CONNECT:
+        if (!this->addClient(client->id())) {
+          client->close();
+        }
+        break;
+
+      case WS_EVT_DISCONNECT:
+        this->removeClient(client->id());
+        break;
+
+      case WS_EVT_DATA: {
+        AwsFrameInfo *info = (AwsFrameInfo *) arg;
+        if (info->final && (info->index == 0) && (info->len == len) && (info->opcode == WS_TEXT)) {
+          this->handleMessage(client->id(), (const char *) data, len);
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  /** Client message: "rate <hz>" */
+  void handleMessage(uint32_t id, const char *data, size_t len) {
+    char message[16];
+    if ((len < 6) || (len >= sizeof(message))) {
+      return;
+    }
+
+    memcpy(message, data, len);
+    message[len] = '\0';
+    if (strncmp(message, "rate ", 5) != 0) {
+      return;
+    }
+
+    int rateHz = atoi(message + 5);
+    if ((rateHz < TELEMETRY_MIN_RATE_HZ) || (rateHz > TELEMETRY_MAX_RATE_HZ)) {
+      return;
+    }
+
+    taskENTER_CRITICAL(&this->lock);
+    for (uint8_t idx = 0; idx < TELEMETRY_MAX_CLIENTS; idx++) {
+      if (this->clients[idx].id == id) {
+        this->clients[idx].rateHz = rateHz;
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+  }
+
+  bool addClient(uint32_t id) {
+    bool added = false;
+
+    taskENTER_CRITICAL(&this->lock);
+    for (uint8_t idx = 0; idx < TELEMETRY_MAX_CLIENTS; idx++) {
+      // (the slot is free once the loop() task released the queue of the previous client)
+      if ((this->clients[idx].id == 0) && (this->clients[idx].queueOwner == 0)) {
+        this->clients[idx].id = id;
+        this->clients[idx].rateHz = TELEMETRY_DEFAULT_RATE_HZ;
+        added = true;
+        break;
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+
+    return added;
+  }
+
+  void removeClient(uint32_t id) {
+    taskENTER_CRITICAL(&this->lock);
+    for (uint8_t idx = 0; idx < TELEMETRY_MAX_CLIENTS; idx++) {
+      if (this->clients[idx].id == id) {
+        this->clients[idx].id = 0;
+      }
+    }
+    taskEXIT_CRITICAL(&this->lock);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <Arduino.h>
+
+/**
+ * Binary waveform format (little endian):
+ *
+ *   header (16 bytes):
+ *     uint32_t magic        "SHWF"
+ *     uint16_t version      1
+ *     uint16_t flags        reserved, 0
+ *     uint32_t nrSteps
+ *     uint32_t timeBaseHz   unit of the durations: 1 / timeBaseHz seconds (ex. 1000000 = us)
+ *
+ *   steps (6 bytes each):
+ *     int16_t  codeDelta    DAC code, relative to the previous step (the first to 0)
+ *     uint32_t duration     step duration in time base units
+ */
+const uint32_t WAVEFORM_MAGIC = 0x46574853; // "SHWF"
+const uint16_t WAVEFORM_VERSION = 1;
+const uint8_t WAVEFORM_HEADER_SIZE = 16;
+const uint8_t WAVEFORM_STEP_SIZE = 6;
+
+/** Decoded waveform step (playback ready) */
+struct WaveformStep {
+  uint16_t dacValue;
+  uint32_t durationTicks;
+};
+
+/**
+ * Streaming waveform decoder.
+ *
+ * Decodes the binary format chunk by chunk (records may be split between chunks), and
+ * writes the steps straight into the destination table. Every step is validated, so the
+ * playback does not need to check anything.
+ */
+class WaveformDecoder {
+
+public:
+
+  enum Error {
+    NONE,
+    INVALID_HEADER,
+    TOO_MANY_STEPS,
+    INVALID_STEP,
+    TRUNCATED
+  };
+
+  /**
+   * Start decoding a new waveform.
+   *
+   * steps / maxSteps: destination table, maxDacValue: highest allowed DAC code,
+   * timerHz / minTicks: playback timer resolution and min step duration (in timer ticks).
+   */
+  void begin(WaveformStep *steps, uint32_t maxSteps, uint16_t maxDacValue, uint32_t timerHz, uint32_t minTicks) {
+    this->steps = steps;
+    this->maxSteps = maxSteps;
+    this->maxDacValue = maxDacValue;
+    this->timerHz = timerHz;
+    this->minTicks = minTicks;
+
+    this->headerDone = false;
+    this->nrSteps = 0;
+    this->decodedSteps = 0;
+    this->lastDacValue = 0;
+    this->pendingLen = 0;
+    this->error = NONE;
+  }
+
+  /** Decode the next chunk. Returns false on error. */
+  bool feed(const uint8_t *data, size_t len) {
+    while ((len > 0) && (this->error == NONE)) {
+      uint8_t recordSize = this->headerDone ? WAVEFORM_STEP_SIZE : WAVEFORM_HEADER_SIZE;
+
+      if ((this->pendingLen == 0) && (len >= recordSize)) {
+        // whole record available in the chunk
+        this->decodeRecord(data);
+        data += recordSize;
+        len -= recordSize;
+        continue;
+      }
+
+      // record split between chunks
+      size_t copyLen = min((size_t) (recordSize - this->pendingLen), len);
+      memcpy(this->pending + this->pendingLen, data, copyLen);
+      this->pendingLen += copyLen;
+      data += copyLen;
+      len -= copyLen;
+
+      if (this->pendingLen == recordSize) {
+        this->decodeRecord(this->pending);
+        this->pendingLen = 0;
+      }
+    }
+
+    return this->error == NONE;
+  }
+
+  /** Finish decoding. Returns false if the waveform is invalid or incomplete. */
+  bool end() {
+    if ((this->error == NONE) && (!this->headerDone || (this->decodedSteps != this->nrSteps) || (this->pendingLen > 0))) {
+      this->error = TRUNCATED;
+    }
+
+    return this->error == NONE;
+  }
+
+  /** Number of decoded steps */
+  uint32_t getNrSteps() {
+    return this->decodedSteps;
+  }
+
+  Error getError() {
+    return this->error;
+  }
+
+private:
+  WaveformStep *steps = NULL;
+  uint32_t maxSteps = 0;
+  uint16_t maxDacValue = 0;
+  uint32_t timerHz = 0;
+  uint32_t minTicks = 0;
+
+  bool headerDone = false;
+  uint32_t nrSteps = 0;
+  uint32_t timeBaseHz = 0;
+  uint32_t decodedSteps = 0;
+  uint16_t lastDacValue = 0;
+
+  /** Partial record (split between chunks) */
+  uint8_t pending[WAVEFORM_HEADER_SIZE];
+  uint8_t pendingLen = 0;
+
+  Error error = NONE;
+
+  static uint16_t readU16(const uint8_t *data) {
+    return (uint16_t) data[0] | ((uint16_t) data[1] << 8);
+  }
+
+  static uint32_t readU32(const uint8_t *data) {
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+  }
+
+  /** Decode a complete header / step record */
+  void decodeRecord(const uint8_t *data) {
+    if (!this->headerDone) {
+      this->decodeHeader(data);
+    } else {
+      this->decodeStep(data);
+    }
+  }
+
+  void decodeHeader(const uint8_t *data) {
+    if ((readU32(data) != WAVEFORM_MAGIC) || (readU16(data + 4) != WAVEFORM_VERSION)) {
+      this->error = INVALID_HEADER;
+      return;
+    }
+
+    this->nrSteps = readU32(data + 8);
+    this->timeBaseHz = readU32(data + 12);
+    if ((this->nrSteps == 0) || (this->timeBaseHz == 0)) {
+      this->error = INVALID_HEADER;
+      return;
+    }
+
+    if (this->nrSteps > this->maxSteps) {
+      this->error = TOO_MANY_STEPS;
+      return;
+    }
+
+    this->headerDone = true;
+  }
+
+  void decodeStep(const uint8_t *data) {
+    if (this->decodedSteps >= this->nrSteps) {
+      // more data than declared in the header
+      this->error = TOO_MANY_STEPS;
+      return;
+    }
+
+    int32_t dacValue = (int32_t) this->lastDacValue + (int16_t) readU16(data);
+    uint64_t ticks = (uint64_t) readU32(data + 2) * this->timerHz / this->timeBaseHz;
+    if ((dacValue < 0) || (dacValue > this->maxDacValue) || (ticks < this->minTicks) || (ticks > 0xFFFFFFFF)) {
+      this->error = INVALID_STEP;
+      return;
+    }
+
+    WaveformStep &step = this->steps[this->decodedSteps++];
+    step.dacValue = dacValue;
+    step.durationTicks = ticks;
+    this->lastDacValue = dacValue;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -10,10 +10,24 @@
 #include <WiFi.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <LittleFS.h>
 #include "load.h"
 #include "shaper.h"
+#include "dynamic.h"
+#include "capture.h"
+#include "sequencer.h"
+#include "program.h"
+#include "telemetry.h"
+#include "history.h"
+#include "eventwait.h"
 #include "srv.h"
+#include "json.h"
+#include "cbor.h"
+#include "measurements.h"
+#include "body.h"
+#include "commands.h"
+#include "cmdwait.h"
+#include "waveform.h"
+#include "static_assets.h"
 
 /** Web / HTTP Server */
 class WebServer {
@@ -21,8 +35,9 @@ class WebServer {
 public:
 
   /**Instantiates the Web Server. */
-  WebServer(const uint16_t port, Load& load, Shaper &shaper, Service &srv)
-    : server(AsyncWebServer(port)), load(load), shaper(shaper), srv(srv) {
+  WebServer(const uint16_t port, Load& load, SampleBuffer &samples, Shaper &shaper, DynamicLoad &dynamicLoad, Sequencer &sequencer, Capture &capture, Telemetry &telemetry, EventLog &events, CommandQueue &commands, Service &srv)
+    : server(AsyncWebServer(port)), load(load), samples(samples), shaper(shaper), dynamicLoad(dynamicLoad), sequencer(sequencer), capture(capture), telemetry(telemetry), events(events), commands(commands), srv(srv),
+      eventWaiters(events, jsonPool), commandWaiters(commands) {
 
       DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
       DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, PUT");
@@ -87,6 +102,121 @@ public:
         this->handleApiShaperPulse(request, data, len, index, total);
       });
 
+      // Shaper binary waveform upload (streamed)
+      this->server.on("/api/shaper/waveform", HTTP_POST, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiShaperWaveform(request, data, len, index, total);
+      });
+
+      // Shaper parametric generator
+      this->server.on("/api/shaper/generator", HTTP_PUT, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiShaperGenerator(request, data, len, index, total);
+      });
+
+      // Shaper start
+      this->server.on("/api/shaper/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiShaperStart(request, true);
+      });
+
+      // Shaper stop
+      this->server.on("/api/shaper/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiShaperStart(request, false);
+      });
+
+      // Shaper edge timing statistics
+      this->server.on("/api/shaper/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiShaperStats(request);
+      });
+
+      // Shaper edge timing statistics reset
+      this->server.on("/api/shaper/stats/reset", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiShaperStatsReset(request);
+      });
+
+      // Dynamic load settings get
+      this->server.on("/api/dynamic", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetDynamic(request);
+      });
+
+      // Dynamic load settings set
+      this->server.on("/api/dynamic", HTTP_PUT, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiSetDynamic(request, data, len, index, total);
+      });
+
+      // Dynamic load start
+      this->server.on("/api/dynamic/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiDynamicStart(request, true);
+      });
+
+      // Dynamic load stop
+      this->server.on("/api/dynamic/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiDynamicStart(request, false);
+      });
+
+      // Sequencer state get
+      this->server.on("/api/sequencer", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetSequencer(request);
+      });
+
+      // Sequencer program upload (text, compiled while streamed)
+      this->server.on("/api/sequencer/program", HTTP_POST, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiSequencerProgram(request, data, len, index, total);
+      });
+
+      // Sequencer start
+      this->server.on("/api/sequencer/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiSequencerStart(request, true);
+      });
+
+      // Sequencer stop
+      this->server.on("/api/sequencer/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiSequencerStart(request, false);
+      });
+
+      // Capture state get
+      this->server.on("/api/capture", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetCapture(request);
+      });
+
+      // Capture arm
+      this->server.on("/api/capture/arm", HTTP_POST, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiCaptureArm(request, data, len, index, total);
+      });
+
+      // Capture disarm
+      this->server.on("/api/capture/disarm", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiCaptureCommand(request, Command::CAPTURE_DISARM);
+      });
+
+      // Capture trigger
+      this->server.on("/api/capture/trigger", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiCaptureCommand(request, Command::CAPTURE_TRIGGER);
+      });
+
+      // Captured data get (binary)
+      this->server.on("/api/capture/data", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetCaptureData(request);
+      });
+
+      // Sample history export (chunked)
+      this->server.on("/api/samples", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetSamples(request);
+      });
+
+      // Batch of settings (applied together)
+      this->server.on("/api/batch", HTTP_POST, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiBatch(request, data, len, index, total);
+      });
+
+      // Wait for an event (long-poll)
+      this->server.on("/api/events/wait", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiEventsWait(request);
+      });
+
+      // Combined measurements get (JSON, CBOR or packed)
+      this->server.on("/api/measurements", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetMeasurements(request);
+      });
+
       // State get
       this->server.on("/api/state", HTTP_GET, [this](AsyncWebServerRequest *request) {
         this->handleApiGetState(request);
@@ -142,6 +272,24 @@ public:
         this->handleApiSetPowerAutoDetectDelay(request, data, len, index, total);
       });
 
+      // Set power enable settle time
+      this->server.on("/api/power/settle-time/enable", HTTP_PUT, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiSetPowerSettleTime(request, true, data, len, index, total);
+      });
+
+      // Set power disable settle time
+      this->server.on("/api/power/settle-time/disable", HTTP_PUT, [this](AsyncWebServerRequest *request) {}, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        this->handleApiSetPowerSettleTime(request, false, data, len, index, total);
+      });
+
+      /** Telemetry (WebSocket) **/
+      this->server.addHandler(&this->telemetry.getHandler());
+
+      // Telemetry client statistics
+      this->server.on("/api/telemetry/clients", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiGetTelemetryClients(request);
+      });
+
       /** Service / Test API Handler **/
 
       // DAC set
@@ -154,6 +302,21 @@ public:
         this->handleApiSrvDacSwipe(request);
       });
 
+      // ADC decode statistics
+      this->server.on("/api/srv/adc/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiSrvAdcStats(request);
+      });
+
+      // Control loop statistics
+      this->server.on("/api/srv/control-loop/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        this->handleApiSrvControlLoopStats(request);
+      });
+
+      // Control loop statistics reset
+      this->server.on("/api/srv/control-loop/stats/reset", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        this->handleApiSrvControlLoopStatsReset(request);
+      });
+
       // OTA restart
       this->server.on("/api/srv/ota/restart", HTTP_POST, [this](AsyncWebServerRequest *request) {
         this->handleApiSrvOtaRestart(request);
@@ -169,21 +332,14 @@ public:
         this->handleCors(request);
       });
 
-      /** Static Content */
-      this->server.on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        this->handleGetPreloadedStaticFile(request, "text/html", this->contentIndexHtml);
-      });
-
-      this->server.on("/style.css", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        this->handleGetPreloadedStaticFile(request, "text/css", this->contentStyleCss);
-      });
-
-      this->server.on("/load.js", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        this->handleGetPreloadedStaticFile(request, "text/javascript", this->contentLoadJs);
-      });
-
+      /** Static Content (gzipped, embedded into the firmware by scripts/embed_assets.py) */
       // note: normal static file service does not works because of the continuous ADC
-      // this->server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
+      for (size_t idx = 0; idx < NR_STATIC_ASSETS; idx++) {
+        const StaticAsset *asset = &STATIC_ASSETS[idx];
+        this->server.on(asset->path, HTTP_GET, [this, asset](AsyncWebServerRequest *request) {
+          this->handleGetStaticAsset(request, *asset);
+        });
+      }
 
       /** Misc Handlers  */
 
@@ -195,280 +351,1146 @@ public:
 
   /** Start the Web Server */
   void begin() {
-    // pre-load static files (as normal static file service does not works because of the continuous ADC)
-    this->readStaticFile("/index.html", this->contentIndexHtml, 4096);
-    this->readStaticFile("/style.css", this->contentStyleCss, 4096);
-    this->readStaticFile("/load.js", this->contentLoadJs, 8192);
-
     // start the web server
     this->server.begin();
   }
 
+  /** Answer the requests waiting for events / command results (called from the loop() task) */
+  void handle() {
+    this->eventWaiters.handle();
+    this->commandWaiters.handle([this](AsyncWebServerRequest *request, CommandWaiters::Waiter &waiter, bool success) {
+      this->sendCommandResponse(request, waiter, success);
+    });
+  }
+
 private:
   AsyncWebServer server;
   Load& load;
+  SampleBuffer& samples;
   Shaper& shaper;
+  DynamicLoad& dynamicLoad;
+  Sequencer& sequencer;
+  Capture& capture;
+  Telemetry& telemetry;
+  EventLog& events;
+  CommandQueue& commands;
   Service& srv;
 
-  char contentIndexHtml[4096];
-  char contentStyleCss[4096];
-  char contentLoadJs[8192];
+  /** Sequencer program (compiled by the web server, copied by the command: not reused while pending) */
+  Program sequencerProgram;
+  ProgramCompiler programCompiler;
+  AsyncWebServerRequest *programRequest = NULL;
+  volatile bool programPending = false;
+
+  /** JSON response buffers */
+  JsonBufferPool jsonPool;
+
+  /** Requests waiting for events */
+  EventWaiters eventWaiters;
+
+  /** Requests waiting for command results (and the data of the commands) */
+  CommandWaiters commandWaiters;
+
+  /** Waveform upload in progress */
+  WaveformDecoder waveformDecoder;
+  AsyncWebServerRequest *waveformRequest = NULL;
 
   /** Handle Voltage get request. */
   void handleApiGetVoltage(AsyncWebServerRequest *request) {
-    float loadVoltage = this->load.getLoadVoltage();
-    float loadVoltage1 = this->load.getLoadVoltage1();
-    float loadVoltage2 = this->load.getLoadVoltage2();
+    Load::Measurement measurement = this->load.getMeasurement();
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
 
-    this->sendFormattedJsonResponse(request, "{ \"voltage\": %.3f, \"voltage1\": %.3f, \"voltage2\": %.3f  }", loadVoltage, loadVoltage1, loadVoltage2);
+    JsonWriter &json = response->json();
+    json.field("voltage", measurement.voltage, 3);
+    json.field("voltage1", measurement.voltage1, 3);
+    json.field("voltage2", measurement.voltage2, 3);
+    this->sendJsonResponse(request, response);
   }
 
   /** Handle Current get request. */
   void handleApiGetCurrent(AsyncWebServerRequest *request) {
-    float loadCurrent1 = this->load.getLoadCurrent1();
-    float loadCurrent2 = this->load.getLoadCurrent2();
-    float totalCurrent = loadCurrent1 + loadCurrent2;
+    Load::Measurement measurement = this->load.getMeasurement();
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
 
-    this->sendFormattedJsonResponse(request, "{ \"current\": %.3f, \"current1\" : %.3f, \"current2\": %.3f }", totalCurrent, loadCurrent1, loadCurrent2);
+    JsonWriter &json = response->json();
+    json.field("current", measurement.current, 3);
+    json.field("current1", measurement.current1, 3);
+    json.field("current2", measurement.current2, 3);
+    this->sendJsonResponse(request, response);
   }
 
   /** Handle Temperature get request. */
   void handleApiGetTemperature(AsyncWebServerRequest *request) {
-    float temp = load.getTemperature();
+    float temp = this->load.getMeasurement().temperature;
 
-    this->sendFormattedJsonResponse(request, "{ \"temperature\": %.2f }", temp);
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    response->json().field("temperature", temp, 2);
+    this->sendJsonResponse(request, response);
   }
 
   /** Handle Current set request. */
   void handleApiSetCurrent(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float current = atof(valueStr.c_str());
-
-    bool success = this->load.setCurrent(current);
+    float current;
+    if (!this->readBody(request, data, len, index, total, current)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_CURRENT, current);
   }
 
   /** Handle Power set request. */
   void handleApiSetPower(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float power = atof(valueStr.c_str());
-
-    bool success = this->load.setPower(power);
+    float power;
+    if (!this->readBody(request, data, len, index, total, power)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_POWER, power);
   }
 
   /** Handle Resistance set request. */
   void handleApiSetResistance(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float resistance = atof(valueStr.c_str());
-
-    bool success = this->load.setResistance(resistance);
+    float resistance;
+    if (!this->readBody(request, data, len, index, total, resistance)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_RESISTANCE, resistance);
   }
 
   /** Handle Fan Speed set request. */
   void handleApiSetFanSpeed(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float value = atof(valueStr.c_str());
-
-    bool success = this->load.setFanSpeed(value);
+    float value;
+    if (!this->readBody(request, data, len, index, total, value)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_FAN_SPEED, value);
   }
 
   /** Handle Load Enable / Disable request */
   void handleApiLoadEnable(AsyncWebServerRequest *request, bool enabled) {
-    bool success = this->load.setEnabled(enabled);
-
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_ENABLED, 0.0, enabled);
   }
 
   /** Handle Operating Mode set request. */
   void handleApiSetMode(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    valueStr.toUpperCase();
     Load::Mode mode;
-    if (valueStr == "CONSTANT_CURRENT") {
-      mode = Load::CONSTANT_CURRENT;
+    if (!parseMode(this->readBody(data, len, index, total), mode)) {
+      // invalid mode
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid mode\" }");
+      return;
+    }
 
-    } else if (valueStr == "CONSTANT_POWER") {
-      mode = Load::CONSTANT_POWER;
+    this->submitCommand(request, Command::SET_MODE, 0.0, mode);
+  }
 
-    } else if (valueStr == "CONSTANT_RESISTANCE") {
-      mode = Load::CONSTANT_RESISTANCE;
+  /** Pulse */
+  void handleApiShaperPulse(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyField fields[2];
+    float current;
+    uint32_t durationMicros;
+    if ((this->readBody(data, len, index, total).split(',', fields, 2) != 2) || !fields[0].toFloat(current) || !fields[1].toUint(durationMicros)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
+      return;
+    }
+
+    this->submitCommand(request, Command::SHAPER_PULSE, current, durationMicros);
+  }
+
+  /** Shaper binary waveform upload (decoded chunk by chunk, straight into the step table) */
+  void handleApiShaperWaveform(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (index == 0) {
+      // new upload (claims the step table, while the shaper is idle and no other upload is in progress)
+      if (!this->shaper.beginUpload()) {
+        this->sendStaticJsonResponse(request, 409, "{ \"error\": \"Shaper is busy\" }");
+        return;
+      }
+
+      uint16_t maxDacValue = min((uint16_t) (HardwareValues::MAX_TOTAL_CURRENT * HardwareValues::currentSetDacMultiplier), HardwareValues::DAC_MAX_VALUE);
+      uint32_t minTicks = (uint64_t) SHAPER_MIN_STEP_MICROS * SHAPER_TIMER_RESOLUTION_HZ / 1000000;
+      this->waveformDecoder.begin(this->shaper.getSteps(), this->shaper.getMaxSteps(), maxDacValue, SHAPER_TIMER_RESOLUTION_HZ, minTicks);
+      this->waveformRequest = request;
+
+      // client gone mid-upload => abort (the step table is released)
+      request->onDisconnect([this, request]() {
+        if (this->waveformRequest == request) {
+          this->waveformRequest = NULL;
+          this->shaper.endUpload(0);
+        }
+      });
+    }
+
+    if (request != this->waveformRequest) {
+      // rejected
+      return;
+    }
+
+    this->waveformDecoder.feed(data, len);
+    if (index + len < total) {
+      // more chunks to come
+      return;
+    }
+
+    this->waveformRequest = NULL;
+    bool success = this->waveformDecoder.end();
+    uint32_t nrSteps = success ? this->waveformDecoder.getNrSteps() : 0;
+    bool loaded = this->shaper.endUpload(nrSteps);
+
+    if (!success) {
+      const char* errorStr = "";
+      switch (this->waveformDecoder.getError()) {
+        case WaveformDecoder::INVALID_HEADER:
+          errorStr = "Invalid header";
+          break;
+        case WaveformDecoder::TOO_MANY_STEPS:
+          errorStr = "Too many steps";
+          break;
+        case WaveformDecoder::INVALID_STEP:
+          errorStr = "Invalid step";
+          break;
+        default:
+          errorStr = "Truncated waveform";
+          break;
+      }
+
+      PooledJsonResponse *response = this->beginJsonResponse(request, 400);
+      if (response != NULL) {
+        response->json().field("error", errorStr);
+        response->json().field("step", (uint32_t) this->waveformDecoder.getNrSteps());
+        this->sendJsonResponse(request, response);
+      }
+      return;
+    }
+
+    if (!loaded) {
+      this->sendStaticJsonResponse(request, 409, "{ \"error\": \"Upload aborted\" }");
+      return;
+    }
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    response->json().field("status", "OK");
+    response->json().field("steps", nrSteps);
+    this->sendJsonResponse(request, response);
+  }
+
+  /**
+   * Shaper parametric generator.
+   *
+   * Body: type,mode,amplitude,offset,frequency,repeat[,duty|stairs]
+   *   ex. "SINE,CONSTANT_CURRENT,2.0,1.0,100,0" or "PWM,CONSTANT_CURRENT,5.0,0.0,1000,10,0.25"
+   */
+  void handleApiShaperGenerator(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyField fields[7];
+    uint8_t nrFields = this->readBody(data, len, index, total).split(',', fields, 7);
+
+    if (nrFields < 6) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
+      return;
+    }
 
+    Shaper::GeneratorConfig config = {};
+    if (fields[0].equals("SQUARE")) {
+      config.type = Generator::SQUARE;
+    } else if (fields[0].equals("TRIANGLE")) {
+      config.type = Generator::TRIANGLE;
+    } else if (fields[0].equals("SINE")) {
+      config.type = Generator::SINE;
+    } else if (fields[0].equals("RAMP")) {
+      config.type = Generator::RAMP;
+    } else if (fields[0].equals("PWM")) {
+      config.type = Generator::PWM;
+    } else if (fields[0].equals("STAIRCASE")) {
+      config.type = Generator::STAIRCASE;
     } else {
-      // invalid mode
-      request->send(400, "application/json", "{ \"error\": \"Invalid mode\" }");
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid type\" }");
+      return;
+    }
+
+    if (!parseMode(fields[1], config.mode)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid mode\" }");
+      return;
+    }
+
+    uint32_t repeat;
+    uint32_t stairs = 4;
+    config.duty = 0.5;
+    bool valid = fields[2].toFloat(config.amplitude) && fields[3].toFloat(config.offset)
+        && fields[4].toFloat(config.frequencyHz) && fields[5].toUint(repeat);
+    if (valid && (nrFields > 6) && (config.type == Generator::PWM)) {
+      valid = fields[6].toFloat(config.duty);
+    } else if (valid && (nrFields > 6) && (config.type == Generator::STAIRCASE)) {
+      valid = fields[6].toUint(stairs);
+    }
+
+    if (!valid) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
       return;
     }
 
-    bool success = this->load.setMode(mode);
+    config.repeat = repeat;
+    config.stairs = stairs;
 
-    this->sendStatusResponse(request, success);
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter == NULL) {
+      return;
+    }
+
+    waiter->payload.generator = config;
+    this->submitCommand(request, waiter, CommandWaiters::STATUS, Command::SHAPER_GENERATOR, &waiter->payload.generator);
   }
 
-  /** Pulse */
-  void handleApiShaperPulse(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String currentAndDuration = this->readBody(data, len, index, total);
-    size_t separatorIdx = currentAndDuration.indexOf(',');
-    if (separatorIdx == -1) {
-      request->send(400, "application/json", "{ \"error\": \"Invalid parameters\" }");
+  /** Shaper start / stop */
+  void handleApiShaperStart(AsyncWebServerRequest *request, bool start) {
+    this->submitCommand(request, start ? Command::SHAPER_START : Command::SHAPER_STOP);
+  }
+
+  /** Dynamic load settings and state */
+  void handleApiGetDynamic(AsyncWebServerRequest *request) {
+    DynamicLoad::Status status = this->dynamicLoad.getStatus();
+
+    const char* stateStr = "";
+    switch (status.state) {
+      case DynamicLoad::IDLE:
+        stateStr = "IDLE";
+        break;
+      case DynamicLoad::WAITING_POWER:
+        stateStr = "WAITING_POWER";
+        break;
+      case DynamicLoad::RUNNING:
+        stateStr = "RUNNING";
+        break;
+      case DynamicLoad::ABORTED:
+        stateStr = "ABORTED";
+        break;
+    }
+
+    const DynamicLoad::Config &config = status.config;
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.field("state", stateStr);
+    json.key("levels");
+    json.beginArray();
+    for (uint8_t idx = 0; idx < config.nrLevels; idx++) {
+      json.beginObject();
+      json.field("current", config.levels[idx].current, 3);
+      json.field("dwellMicros", (uint32_t) config.levels[idx].dwellMicros);
+      json.endObject();
+    }
+    json.endArray();
+    this->writeHistogram(json, "edgeErrorMicros", this->dynamicLoad.edgeErrors);
+    this->sendJsonResponse(request, response);
+  }
+
+  /**
+   * Dynamic load settings.
+   *
+   * Body: A/B levels "currentA,currentB,frequency,duty" (ex. "1.0,5.0,1000,0.5"),
+   * or N levels "current:dwellMicros,current:dwellMicros,..." (ex. "1.0:500,3.0:200,5.0:300")
+   */
+  void handleApiSetDynamic(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyField body = this->readBody(data, len, index, total);
+
+    // (one extra field: too many levels are rejected, not truncated)
+    BodyField fields[DynamicLoad::MAX_LEVELS + 1];
+    uint8_t nrFields = body.split(',', fields, DynamicLoad::MAX_LEVELS + 1);
+
+    DynamicLoad::Config config = {};
+    bool valid = false;
+    if (body.indexOf(':') == -1) {
+      // A/B levels
+      float currentA, currentB, frequency, duty;
+      valid = (nrFields == 4) && fields[0].toFloat(currentA) && fields[1].toFloat(currentB) && fields[2].toFloat(frequency)
+          && fields[3].toFloat(duty) && DynamicLoad::toABConfig(currentA, currentB, frequency, duty, config);
+
+    } else {
+      // N levels
+      valid = nrFields <= DynamicLoad::MAX_LEVELS;
+      for (uint8_t idx = 0; valid && (idx < nrFields); idx++) {
+        int separatorIdx = fields[idx].indexOf(':');
+        uint32_t dwellMicros;
+        if ((separatorIdx == -1) || !fields[idx].left(separatorIdx).toFloat(config.levels[idx].current)
+            || !fields[idx].right(separatorIdx + 1).toUint(dwellMicros)) {
+          valid = false;
+          break;
+        }
+
+        config.levels[idx].dwellMicros = dwellMicros;
+      }
+      config.nrLevels = nrFields;
+    }
+
+    if (!valid) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
       return;
     }
 
-    float current = atof(currentAndDuration.substring(0, separatorIdx).c_str());
-    uint32_t durationMicros = atoi(currentAndDuration.substring(separatorIdx + 1).c_str());
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter == NULL) {
+      return;
+    }
 
-    bool success = this->shaper.pulse(current, durationMicros);
+    waiter->payload.dynamic = config;
+    this->submitCommand(request, waiter, CommandWaiters::STATUS, Command::DYNAMIC_SET, &waiter->payload.dynamic);
+  }
 
-    this->sendStatusResponse(request, success);
+  /** Dynamic load start / stop */
+  void handleApiDynamicStart(AsyncWebServerRequest *request, bool start) {
+    this->submitCommand(request, start ? Command::DYNAMIC_START : Command::DYNAMIC_STOP);
   }
 
-  /** Handle DAC set request (service/test). */
-  void handleApiSrvDacSet(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    uint16_t value = atoi(valueStr.c_str());
+  /** Sequencer program upload (compiled chunk by chunk) */
+  void handleApiSequencerProgram(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (index == 0) {
+      if (this->programPending) {
+        // the previous program is not applied yet (the buffer is still in use)
+        this->sendStaticJsonResponse(request, 409, "{ \"error\": \"Program pending\" }");
+        return;
+      }
+
+      // new upload
+      this->programCompiler.begin(&this->sequencerProgram);
+      this->programRequest = request;
+    }
 
-    this->srv.dacSet(value);
+    if (request != this->programRequest) {
+      // taken over by another upload
+      return;
+    }
 
-    this->sendStatusResponse(request, true);
+    this->programCompiler.feed(data, len);
+    if (index + len < total) {
+      // more chunks to come
+      return;
+    }
+
+    this->programRequest = NULL;
+    if (!this->programCompiler.end()) {
+      const char* errorStr = "";
+      switch (this->programCompiler.getError()) {
+        case ProgramCompiler::INVALID_VALUE:
+          errorStr = "Invalid value";
+          break;
+        case ProgramCompiler::LINE_TOO_LONG:
+          errorStr = "Line too long";
+          break;
+        case ProgramCompiler::TOO_MANY_INSTRUCTIONS:
+          errorStr = "Too many instructions";
+          break;
+        case ProgramCompiler::TOO_MANY_ABORTS:
+          errorStr = "Too many abort conditions";
+          break;
+        case ProgramCompiler::UNBALANCED_LOOP:
+          errorStr = "Unbalanced LOOP / END";
+          break;
+        case ProgramCompiler::EMPTY_LOOP:
+          errorStr = "Loop without steps";
+          break;
+        case ProgramCompiler::EMPTY:
+          errorStr = "Empty program";
+          break;
+        default:
+          errorStr = "Syntax error";
+          break;
+      }
+
+      PooledJsonResponse *response = this->beginJsonResponse(request, 400);
+      if (response != NULL) {
+        response->json().field("error", errorStr);
+        response->json().field("line", (uint32_t) this->programCompiler.getLineNr());
+        this->sendJsonResponse(request, response);
+      }
+      return;
+    }
+
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter == NULL) {
+      return;
+    }
+
+    // (cleared once the command completes, see sendCommandResponse())
+    waiter->param = this->sequencerProgram.nrInstructions;
+    this->programPending = true;
+    if (!this->submitCommand(request, waiter, CommandWaiters::PROGRAM, Command::SEQUENCER_PROGRAM, &this->sequencerProgram)) {
+      this->programPending = false;
+    }
   }
 
-  /** Handle State get request */
-  void handleApiGetState(AsyncWebServerRequest *request) {
-    bool enabled = this->load.isEnabled();
-    Load::Mode mode = this->load.getMode();
-    float setCurrent = this->load.getSetCurrent();
-    float setPower = this->load.getSetPower();
-    float setResistance = this->load.getSetResistance();
-    float fanSpeed = this->load.getFanSpeed();
+  /** Sequencer start / stop */
+  void handleApiSequencerStart(AsyncWebServerRequest *request, bool start) {
+    this->submitCommand(request, start ? Command::SEQUENCER_START : Command::SEQUENCER_STOP);
+  }
 
-    const char* modeStr = "";
-    switch (mode) {
-      case Load::CONSTANT_CURRENT:
-        modeStr = "CONSTANT_CURRENT";
+  /** Sequencer state */
+  void handleApiGetSequencer(AsyncWebServerRequest *request) {
+    Sequencer::Status status = this->sequencer.getStatus();
+
+    const char* stateStr = "";
+    switch (status.state) {
+      case Sequencer::IDLE:
+        stateStr = "IDLE";
         break;
-      case Load::CONSTANT_POWER:
-        modeStr = "CONSTANT_POWER";
+      case Sequencer::WAITING_POWER:
+        stateStr = "WAITING_POWER";
         break;
-      case Load::CONSTANT_RESISTANCE:
-        modeStr = "CONSTANT_RESISTANCE";
+      case Sequencer::RUNNING:
+        stateStr = "RUNNING";
+        break;
+      case Sequencer::FINISHED:
+        stateStr = "FINISHED";
+        break;
+      case Sequencer::ABORTED:
+        stateStr = "ABORTED";
         break;
     }
 
-    const char* protectionStateStr = "";
-    switch (this->load.getProtectState()) {
-      case Load::OK:
-        protectionStateStr = "OK";
+    const char* stopReasonStr = "";
+    switch (status.stopReason) {
+      case Sequencer::NO_STOP:
+        stopReasonStr = "NONE";
         break;
-      case Load::OK_DISABLED:
-        protectionStateStr = "OK_DISABLED";
+      case Sequencer::COMPLETED:
+        stopReasonStr = "COMPLETED";
         break;
-      case Load::TRIPPED_OVER_TEMPERATURE:
-        protectionStateStr = "TRIPPED_OVER_TEMPERATURE";
+      case Sequencer::STOPPED:
+        stopReasonStr = "STOPPED";
         break;
-      case Load::TRIPPED_OVER_VOLTAGE:
-        protectionStateStr = "TRIPPED_OVER_VOLTAGE";
+      case Sequencer::ABORT_CONDITION:
+        stopReasonStr = "ABORT_CONDITION";
         break;
-      case Load::TRIPPED_OVER_CURRENT:
-        protectionStateStr = "TRIPPED_OVER_CURRENT";
+      case Sequencer::PROTECTION:
+        stopReasonStr = "PROTECTION";
         break;
-      case Load::TRIPPED_OVER_POWER:
-        protectionStateStr = "TRIPPED_OVER_POWER";
+      case Sequencer::SET_POINT_REJECTED:
+        stopReasonStr = "SET_POINT_REJECTED";
+        break;
+    }
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.field("state", stateStr);
+    json.field("instructions", (uint32_t) status.nrInstructions);
+    json.field("position", (uint32_t) status.position);
+    json.field("steps", status.stepCount);
+    json.field("stepElapsedMs", status.stepElapsedMs);
+    json.field("stopReason", stopReasonStr);
+    json.field("abortCondition", (uint32_t) status.abortIdx);
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Capture settings and state */
+  void handleApiGetCapture(AsyncWebServerRequest *request) {
+    Capture::Status status = this->capture.getStatus();
+
+    const char* stateStr = "";
+    switch (status.state) {
+      case Capture::IDLE:
+        stateStr = "IDLE";
+        break;
+      case Capture::ARMED:
+        stateStr = "ARMED";
+        break;
+      case Capture::TRIGGERED:
+        stateStr = "TRIGGERED";
+        break;
+      case Capture::DONE:
+        stateStr = "DONE";
+        break;
+      case Capture::FAILED:
+        stateStr = "FAILED";
+        break;
+    }
+
+    const char* sourceStr = "";
+    const Capture::Config &config = status.config;
+    switch (config.source) {
+      case Capture::API:
+        sourceStr = "API";
+        break;
+      case Capture::OUTPUT_EDGE:
+        sourceStr = "EDGE";
+        break;
+      case Capture::VOLTAGE_LEVEL:
+        sourceStr = "VOLTAGE";
+        break;
+      case Capture::CURRENT_LEVEL:
+        sourceStr = "CURRENT";
+        break;
+      case Capture::PROTECTION_TRIP:
+        sourceStr = "TRIP";
         break;
     }
 
-    float overTemperatureLimit = this->load.getOverTemperatureLimit();
-    float overCurrentLimit = this->load.getOverCurrentLimit();
-    float overVoltageLimit = this->load.getOverVoltageLimit();
-    float overPowerLimit = this->load.getOverPowerLimit();
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
 
-    this->sendFormattedJsonResponse(request,
-      "{ \"enabled\": %s, \"mode\": \"%s\", \"setCurrent\": %.3f, \"setPower\": %.3f, \"setResistance\": %.3f, \"fanSpeed\": %.2f, \"protections\": { \"state\": \"%s\", \"overTemperatureLimit\": %.2f, \"overCurrentLimit\": %.3f, \"overVoltageLimit\": %.3f, \"overPowerLimit\": %.3f } }",
-      enabled ? "true" : "false", modeStr, setCurrent, setPower, setResistance, fanSpeed,
-      protectionStateStr, overTemperatureLimit, overCurrentLimit, overVoltageLimit, overPowerLimit);
+    JsonWriter &json = response->json();
+    json.field("state", stateStr);
+    json.field("source", sourceStr);
+    json.field("preFrames", (uint32_t) config.preFrames);
+    json.field("postFrames", (uint32_t) config.postFrames);
+    json.field("level", config.level, 3);
+    json.field("slope", config.slope == Capture::RISING ? "RISING" : "FALLING");
+    json.field("frames", (uint32_t) status.nrFrames);
+    json.field("maxFrames", (uint32_t) CAPTURE_MAX_FRAMES);
+    json.field("maxPreFrames", (uint32_t) CAPTURE_MAX_PRE_FRAMES);
+    this->sendJsonResponse(request, response);
+  }
+
+  /**
+   * Capture arm.
+   *
+   * Body: source,preFrames,postFrames[,level,slope]
+   *   source: API, EDGE (shaper / dynamic load output edge), VOLTAGE, CURRENT (level crossing), TRIP (protection)
+   *   ex. "EDGE,500,2000" or "VOLTAGE,1000,3000,4.5,FALLING"
+   */
+  void handleApiCaptureArm(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyField fields[5];
+    uint8_t nrFields = this->readBody(data, len, index, total).split(',', fields, 5);
+
+    if (nrFields < 3) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
+      return;
+    }
+
+    Capture::Config config = {};
+    if (fields[0].equals("API")) {
+      config.source = Capture::API;
+    } else if (fields[0].equals("EDGE")) {
+      config.source = Capture::OUTPUT_EDGE;
+    } else if (fields[0].equals("VOLTAGE")) {
+      config.source = Capture::VOLTAGE_LEVEL;
+    } else if (fields[0].equals("CURRENT")) {
+      config.source = Capture::CURRENT_LEVEL;
+    } else if (fields[0].equals("TRIP")) {
+      config.source = Capture::PROTECTION_TRIP;
+    } else {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid source\" }");
+      return;
+    }
+
+    uint32_t preFrames, postFrames;
+    config.level = 0.0;
+    if (!fields[1].toUint(preFrames) || !fields[2].toUint(postFrames) || ((nrFields > 3) && !fields[3].toFloat(config.level))) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid parameters\" }");
+      return;
+    }
+
+    config.preFrames = preFrames;
+    config.postFrames = postFrames;
+    config.slope = (nrFields > 4) && fields[4].equals("FALLING") ? Capture::FALLING : Capture::RISING;
+
+    if (((config.source == Capture::VOLTAGE_LEVEL) || (config.source == Capture::CURRENT_LEVEL)) && (nrFields < 4)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Missing level\" }");
+      return;
+    }
+
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter == NULL) {
+      return;
+    }
+
+    waiter->payload.capture = config;
+    this->submitCommand(request, waiter, CommandWaiters::STATUS, Command::CAPTURE_ARM, &waiter->payload.capture);
+  }
+
+  /** Capture disarm / trigger */
+  void handleApiCaptureCommand(AsyncWebServerRequest *request, Command::Type type) {
+    this->submitCommand(request, type);
+  }
+
+  /** Captured data: header + frames (see capture.h), streamed straight from the capture buffer */
+  void handleApiGetCaptureData(AsyncWebServerRequest *request) {
+    if (!this->capture.beginRead()) {
+      this->sendStaticJsonResponse(request, 409, "{ \"error\": \"No capture\" }");
+      return;
+    }
+
+    // re-arming is blocked until the response is gone (sent, or the client disconnected)
+    std::shared_ptr<Capture> reading(&this->capture, [](Capture *capture) {
+      capture->endRead();
+    });
+
+    Capture::Header header = this->capture.getHeader();
+    const uint8_t *frames = (const uint8_t*) this->capture.getFrames();
+    size_t framesLen = header.nrFrames * sizeof(Capture::Frame);
+
+    AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", sizeof(header) + framesLen,
+        [header, frames, reading](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t len = 0;
+      if (index < sizeof(header)) {
+        len = min(maxLen, sizeof(header) - index);
+        memcpy(buffer, ((const uint8_t*) &header) + index, len);
+        index += len;
+      }
+
+      size_t framesLen = header.nrFrames * sizeof(Capture::Frame);
+      size_t framesIdx = index - sizeof(header);
+      if ((len < maxLen) && (framesIdx < framesLen)) {
+        size_t copyLen = min(maxLen - len, framesLen - framesIdx);
+        memcpy(buffer + len, frames + framesIdx, copyLen);
+        len += copyLen;
+      }
+
+      return len;
+    });
+    response->addHeader("Content-Disposition", "attachment; filename=\"capture.bin\"");
+    request->send(response);
+  }
+
+  /**
+   * Sample history export: GET /api/samples?from=<seq>&count=<frames>&format=bin|csv
+   *
+   * from: first frame (default: the oldest available), count: number of frames (default: all),
+   * format: binary (default) or CSV (see history.h). Streamed straight from the sample buffer.
+   */
+  void handleApiGetSamples(AsyncWebServerRequest *request) {
+    uint32_t from = 0;
+    uint32_t count = 0;
+    SampleExport::Format format = SampleExport::BINARY;
+
+    if (request->hasParam("from")) {
+      from = strtoul(request->getParam("from")->value().c_str(), NULL, 10);
+    }
+
+    if (request->hasParam("count")) {
+      count = strtoul(request->getParam("count")->value().c_str(), NULL, 10);
+    }
+
+    if (request->hasParam("format")) {
+      const String &formatStr = request->getParam("format")->value();
+      if (formatStr == "csv") {
+        format = SampleExport::CSV;
+      } else if (formatStr != "bin") {
+        this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid format\" }");
+        return;
+      }
+    }
+
+    std::shared_ptr<SampleExport> sampleExport = std::make_shared<SampleExport>(this->samples, this->load, format, from, count);
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse(format == SampleExport::CSV ? "text/csv" : "application/octet-stream",
+        [sampleExport](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return sampleExport->fill(buffer, maxLen);
+    });
+    response->addHeader("X-Samples-From", String(sampleExport->getFrom()));
+    response->addHeader("X-Samples-Count", String(sampleExport->getCount()));
+    request->send(response);
+  }
+
+  /** Telemetry clients: send rate, queue and drop statistics */
+  void handleApiGetTelemetryClients(AsyncWebServerRequest *request) {
+    Telemetry::ClientStats stats[TELEMETRY_MAX_CLIENTS];
+    uint8_t nrClients = this->telemetry.getClientStats(stats, TELEMETRY_MAX_CLIENTS);
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.key("clients");
+    json.beginArray();
+    for (uint8_t idx = 0; idx < nrClients; idx++) {
+      json.beginObject();
+      json.field("id", (uint32_t) stats[idx].id);
+      json.field("rateHz", (uint32_t) stats[idx].rateHz);
+      json.field("queued", (uint32_t) stats[idx].queued);
+      json.field("sentMessages", (uint32_t) stats[idx].sentMessages);
+      json.field("droppedMessages", (uint32_t) stats[idx].droppedMessages);
+      json.field("connectedMs", (uint32_t) stats[idx].connectedMs);
+      json.endObject();
+    }
+    json.endArray();
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Shaper edge timing statistics */
+  void handleApiShaperStats(AsyncWebServerRequest *request) {
+    const char* stateStr = "";
+    switch (this->shaper.getStatus().state) {
+      case Shaper::IDLE:
+        stateStr = "IDLE";
+        break;
+      case Shaper::WAITING_POWER:
+        stateStr = "WAITING_POWER";
+        break;
+      case Shaper::RUNNING:
+        stateStr = "RUNNING";
+        break;
+      case Shaper::FINISHED:
+        stateStr = "FINISHED";
+        break;
+      case Shaper::ABORTED:
+        stateStr = "ABORTED";
+        break;
+    }
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    response->json().field("state", stateStr);
+    this->writeHistogram(response->json(), "edgeErrorMicros", this->shaper.edgeErrors);
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Shaper edge timing statistics reset */
+  void handleApiShaperStatsReset(AsyncWebServerRequest *request) {
+    this->shaper.resetStats();
+
+    this->sendStatusResponse(request, true);
+  }
+
+  /** Handle DAC set request (service/test). */
+  void handleApiSrvDacSet(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    uint32_t value;
+    if (!this->readBody(request, data, len, index, total, value)) {
+      return;
+    }
+
+    this->srv.dacSet(value);
+
+    this->sendStatusResponse(request, true);
+  }
+
+  /**
+   * Batch of settings, validated together and applied in one control loop tick (in order,
+   * all or nothing: nothing is applied if any of them is invalid).
+   *
+   * Body: operations separated by ';', "name=value" or "name"
+   *   names: enable, disable, mode, current, power, resistance, fan, over-temperature,
+   *          over-current, over-voltage, over-power, reset-protections
+   *   ex. "mode=CONSTANT_POWER;over-voltage=30;over-current=5;power=50;enable"
+   */
+  void handleApiBatch(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    BodyField body = this->readBody(data, len, index, total);
+
+    BodyField operations[CommandBatch::MAX_COMMANDS + 1];
+    uint8_t nrOperations = body.split(';', operations, CommandBatch::MAX_COMMANDS + 1);
+    if ((nrOperations > 0) && operations[nrOperations - 1].isEmpty()) {
+      // trailing separator
+      nrOperations--;
+    }
+
+    if ((nrOperations == 0) || (nrOperations > CommandBatch::MAX_COMMANDS)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid number of operations\" }");
+      return;
+    }
+
+    CommandBatch batch = {};
+    for (uint8_t idx = 0; idx < nrOperations; idx++) {
+      if (!parseBatchOperation(operations[idx], batch.commands[idx])) {
+        PooledJsonResponse *response = this->beginJsonResponse(request, 400);
+        if (response != NULL) {
+          response->json().field("error", "Invalid operation");
+          response->json().field("operation", (uint32_t) idx);
+          this->sendJsonResponse(request, response);
+        }
+        return;
+      }
+    }
+    batch.nrCommands = nrOperations;
+
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter == NULL) {
+      return;
+    }
+
+    waiter->payload.batch = batch;
+    this->submitCommand(request, waiter, CommandWaiters::BATCH, Command::BATCH, &waiter->payload.batch);
+  }
+
+  /**
+   * Wait for an event: GET /api/events/wait?mask=<types>&from=<seq>&timeout=<ms>
+   *
+   * mask: event type names separated by ',' (ex. "PROTECTION_TRIPPED,SHAPER_FINISHED"), or a bit mask
+   * (default: all), from: first event to consider (default: only new events; use "next" of the
+   * previous response to not miss any), timeout: max wait (default: 30s, max 60s).
+   * The request is held open until a matching event, or the timeout.
+   */
+  void handleApiEventsWait(AsyncWebServerRequest *request) {
+    uint32_t mask = Event::ALL;
+    uint32_t from = this->events.head();
+    uint32_t timeoutMs = EVENT_WAIT_DEFAULT_TIMEOUT_MS;
+
+    if (request->hasParam("mask")) {
+      const String &maskStr = request->getParam("mask")->value();
+      BodyField names[Event::NR_TYPES];
+      uint8_t nrNames = BodyField(maskStr.c_str(), maskStr.length()).split(',', names, Event::NR_TYPES);
+
+      if ((nrNames == 1) && names[0].toUint(mask)) {
+        mask &= Event::ALL;
+      } else {
+        mask = 0;
+        for (uint8_t idx = 0; idx < nrNames; idx++) {
+          uint32_t typeMask = 0;
+          for (uint8_t type = 0; type < Event::NR_TYPES; type++) {
+            if (names[idx].equals(EventWaiters::toTypeStr((Event::Type) type))) {
+              typeMask = 1 << type;
+            }
+          }
+          mask |= typeMask;
+
+          if (typeMask == 0) {
+            this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid event type\" }");
+            return;
+          }
+        }
+      }
+    }
+
+    if (request->hasParam("from")) {
+      from = strtoul(request->getParam("from")->value().c_str(), NULL, 10);
+    }
+
+    if (request->hasParam("timeout")) {
+      timeoutMs = min((uint32_t) strtoul(request->getParam("timeout")->value().c_str(), NULL, 10), EVENT_WAIT_MAX_TIMEOUT_MS);
+    }
+
+    if (mask == 0) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Empty mask\" }");
+      return;
+    }
+
+    if (!this->eventWaiters.wait(request, mask, from, timeoutMs)) {
+      this->sendStaticJsonResponse(request, 503, "{ \"error\": \"Too many waiters\" }");
+    }
+  }
+
+  /**
+   * Combined measurements (see measurements.h), from one consistent snapshot.
+   *
+   * Format: ?format=json|cbor|bin, or the Accept header (application/cbor, application/octet-stream).
+   * Default: JSON.
+   */
+  void handleApiGetMeasurements(AsyncWebServerRequest *request) {
+    enum { JSON, CBOR, PACKED } format = JSON;
+    if (request->hasParam("format")) {
+      const String &formatStr = request->getParam("format")->value();
+      if (formatStr == "cbor") {
+        format = CBOR;
+      } else if (formatStr == "bin") {
+        format = PACKED;
+      } else if (formatStr != "json") {
+        this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid format\" }");
+        return;
+      }
+
+    } else if (request->hasHeader("Accept")) {
+      const String &accept = request->header("Accept");
+      if (accept.indexOf("application/cbor") != -1) {
+        format = CBOR;
+      } else if (accept.indexOf("application/octet-stream") != -1) {
+        format = PACKED;
+      }
+    }
+
+    Load::State state = this->load.getState();
+    const Load::Measurement &measurement = state.measurement;
+
+    PooledJsonResponse *response = new PooledJsonResponse(this->jsonPool, 200,
+        format == JSON ? "application/json" : (format == CBOR ? "application/cbor" : "application/octet-stream"));
+    if (!response->isValid()) {
+      delete response;
+      this->sendStaticJsonResponse(request, 503, "{ \"error\": \"Busy\" }");
+      return;
+    }
+
+    if (format == PACKED) {
+      MeasurementsPacket packet = MeasurementsPacket::of(state);
+      memcpy(response->content(), &packet, sizeof(packet));
+      response->finish(sizeof(packet));
+
+    } else if (format == CBOR) {
+      CborWriter cbor(response->content(), JSON_BUFFER_SIZE);
+      cbor.beginMap();
+      cbor.field("seq", measurement.seq);
+      cbor.field("timestampMicros", measurement.timestampMicros);
+      cbor.field("voltage", measurement.voltage);
+      cbor.field("voltage1", measurement.voltage1);
+      cbor.field("voltage2", measurement.voltage2);
+      cbor.field("current", measurement.current);
+      cbor.field("current1", measurement.current1);
+      cbor.field("current2", measurement.current2);
+      cbor.field("power", measurement.power);
+      cbor.field("temperature", measurement.temperature);
+      cbor.field("setCurrent", state.setCurrent);
+      cbor.field("setPower", state.setPower);
+      cbor.field("setResistance", state.setResistance);
+      cbor.field("enabled", state.enabled);
+      cbor.field("mode", toModeStr(state.mode));
+      cbor.field("powerState", toPowerStateStr(state.powerState));
+      cbor.field("protectionState", toProtectionStateStr(state.protectionState));
+      cbor.end();
+      response->finish(cbor.length());
+
+    } else {
+      JsonWriter &json = response->json();
+      json.beginObject();
+      json.field("seq", measurement.seq);
+      json.field("timestampMicros", measurement.timestampMicros);
+      json.field("voltage", measurement.voltage, 3);
+      json.field("voltage1", measurement.voltage1, 3);
+      json.field("voltage2", measurement.voltage2, 3);
+      json.field("current", measurement.current, 3);
+      json.field("current1", measurement.current1, 3);
+      json.field("current2", measurement.current2, 3);
+      json.field("power", measurement.power, 3);
+      json.field("temperature", measurement.temperature, 2);
+      json.field("setCurrent", state.setCurrent, 3);
+      json.field("setPower", state.setPower, 3);
+      json.field("setResistance", state.setResistance, 3);
+      json.field("enabled", state.enabled);
+      json.field("mode", toModeStr(state.mode));
+      json.field("powerState", toPowerStateStr(state.powerState));
+      json.field("protectionState", toProtectionStateStr(state.protectionState));
+      json.endObject();
+      response->finish();
+    }
+
+    request->send(response);
+  }
+
+  /** Handle State get request */
+  void handleApiGetState(AsyncWebServerRequest *request) {
+    Load::State state = this->load.getState();
+
+    const char* modeStr = toModeStr(state.mode);
+    const char* protectionStateStr = toProtectionStateStr(state.protectionState);
+    const char* powerStateStr = toPowerStateStr(state.powerState);
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.field("enabled", state.enabled);
+    json.field("powerState", powerStateStr);
+    json.field("mode", modeStr);
+    json.field("setCurrent", state.setCurrent, 3);
+    json.field("setPower", state.setPower, 3);
+    json.field("setResistance", state.setResistance, 3);
+    json.field("fanSpeed", state.fanSpeed, 2);
+    json.key("protections");
+    json.beginObject();
+    json.field("state", protectionStateStr);
+    json.field("overTemperatureLimit", state.overTemperatureLimit, 2);
+    json.field("overCurrentLimit", state.overCurrentLimit, 3);
+    json.field("overVoltageLimit", state.overVoltageLimit, 3);
+    json.field("overPowerLimit", state.overPowerLimit, 3);
+    json.field("fastTripLatencyMicros", (uint32_t) state.fastTripLatencyMicros);
+    json.endObject();
+    this->sendJsonResponse(request, response);
   }
 
   /** Handle Over temperature set request */
   void handleApiSetOverTemperatureLimit(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float temp = atof(valueStr.c_str());
-
-    bool success = this->load.setOverTemperatureLimit(temp);
+    float temp;
+    if (!this->readBody(request, data, len, index, total, temp)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_OVER_TEMPERATURE_LIMIT, temp);
   }
 
   /** Handle Over current set request */
   void handleApiSetOverCurrentLimit(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float current = atof(valueStr.c_str());
-
-    bool success = this->load.setOverCurrentLimit(current);
+    float current;
+    if (!this->readBody(request, data, len, index, total, current)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_OVER_CURRENT_LIMIT, current);
   }
 
   /** Handle Over voltage set request */
   void handleApiSetOverVoltageLimit(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float voltage = atof(valueStr.c_str());
-
-    bool success = this->load.setOverVoltageLimit(voltage);
+    float voltage;
+    if (!this->readBody(request, data, len, index, total, voltage)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_OVER_VOLTAGE_LIMIT, voltage);
   }
 
   /** Handle Over power set request */
   void handleApiSetOverPowerLimit(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    float power = atof(valueStr.c_str());
-
-    bool success = this->load.setOverPowerLimit(power);
+    float power;
+    if (!this->readBody(request, data, len, index, total, power)) {
+      return;
+    }
 
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_OVER_POWER_LIMIT, power);
   }
 
   /** Handle Reset protections request */
   void handleApiResetProtections(AsyncWebServerRequest *request) {
-    bool success = this->load.resetProtections();
-
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::RESET_PROTECTIONS);
   }
 
   /** Handle Disable protections request */
   void handleApiDisableProtections(AsyncWebServerRequest *request) {
-    bool success = this->load.enableProtections(false);
-
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::ENABLE_PROTECTIONS, 0.0, false);
   }
 
   /** Handle Enable protections request */
   void handleApiEnableProtections(AsyncWebServerRequest *request) {
-    bool success = this->load.enableProtections(false);
-
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::ENABLE_PROTECTIONS, 0.0, false);
   }
 
   /** Handle power auto detection */
   void handleApiSetPowerAutoDetect(AsyncWebServerRequest *request, bool enable) {
-    bool success = this->load.setAutoEnableDisableOnPower(enable);
-
-    this->sendStatusResponse(request, success);
+    this->submitCommand(request, Command::SET_AUTO_ENABLE, 0.0, enable);
   }
 
   /** Handle power auto detection delay set request */
   void handleApiSetPowerAutoDetectDelay(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-    String valueStr = this->readBody(data, len, index, total);
-    uint32_t delayMs = atoi(valueStr.c_str());
+    uint32_t delayMs;
+    if (!this->readBody(request, data, len, index, total, delayMs)) {
+      return;
+    }
 
-    bool success = this->load.setAutoEnableDelayMs(delayMs);
+    this->submitCommand(request, Command::SET_AUTO_ENABLE_DELAY, 0.0, delayMs);
+  }
 
-    this->sendStatusResponse(request, success);
+  /** Handle power enable / disable settle time set request */
+  void handleApiSetPowerSettleTime(AsyncWebServerRequest *request, bool enable, uint8_t *data, size_t len, size_t index, size_t total) {
+    uint32_t settleMs;
+    if (!this->readBody(request, data, len, index, total, settleMs)) {
+      return;
+    }
+
+    this->submitCommand(request, enable ? Command::SET_POWER_ENABLE_SETTLE : Command::SET_POWER_DISABLE_SETTLE, 0.0, settleMs);
   }
 
   /** Handle DAC swipe request (service/test). */
@@ -478,6 +1500,55 @@ private:
     this->sendStatusResponse(request, true);
   }
 
+  /** Handle ADC decode statistics request (service/test). */
+  void handleApiSrvAdcStats(AsyncWebServerRequest *request) {
+    RunningStats &stats = this->srv.getAdcDecodeStats();
+    float cyclesPerMicro = getCpuFrequencyMhz();
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.field("frames", (uint32_t) stats.getCount());
+    json.key("decodeCycles");
+    json.beginObject();
+    json.field("min", (uint32_t) stats.getMin());
+    json.field("max", (uint32_t) stats.getMax());
+    json.field("avg", (float) stats.getAvg(), 1);
+    json.endObject();
+    json.key("decodeMicros");
+    json.beginObject();
+    json.field("min", stats.getMin() / cyclesPerMicro, 2);
+    json.field("max", stats.getMax() / cyclesPerMicro, 2);
+    json.field("avg", stats.getAvg() / cyclesPerMicro, 2);
+    json.endObject();
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Handle control loop statistics request (service/test). */
+  void handleApiSrvControlLoopStats(AsyncWebServerRequest *request) {
+    ControlLoop &controlLoop = this->srv.getControlLoop();
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    response->json().field("missedFrames", (uint32_t) controlLoop.missedFrames);
+    this->writeHistogram(response->json(), "wakeupLatencyMicros", controlLoop.wakeupLatency);
+    this->writeHistogram(response->json(), "wakeupJitterMicros", controlLoop.wakeupJitter);
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Handle control loop statistics reset request (service/test). */
+  void handleApiSrvControlLoopStatsReset(AsyncWebServerRequest *request) {
+    this->srv.getControlLoop().resetStats();
+
+    this->sendStatusResponse(request, true);
+  }
+
   /** Handle OTA restart (service/test). */
   void handleApiSrvOtaRestart(AsyncWebServerRequest *request) {
     // send response
@@ -496,9 +1567,20 @@ private:
     this->srv.restart();
   }
 
-  /** Handle pre-loaded static file request. */
-  void handleGetPreloadedStaticFile(AsyncWebServerRequest *request, const char* contentType, char* content) {
-    request->send(200, contentType, content);
+  /** Handle static file request: sent gzipped, straight from flash (304 if the cached copy is still valid). */
+  void handleGetStaticAsset(AsyncWebServerRequest *request, const StaticAsset &asset) {
+    AsyncWebServerResponse *response;
+    if (request->hasHeader("If-None-Match") && (request->header("If-None-Match").indexOf(asset.etag) != -1)) {
+      response = request->beginResponse(304);
+    } else {
+      response = request->beginResponse(200, asset.contentType, asset.data, asset.len);
+      response->addHeader("Content-Encoding", "gzip");
+    }
+
+    // always revalidated (the files change with the firmware updates)
+    response->addHeader("ETag", asset.etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
   }
 
   /** Handle CORS */
@@ -512,43 +1594,294 @@ private:
     request->send(404, "text/plain", "Not Found");
   }
 
+  /** Reserve a command waiter (its payload: the command data). Sends 503 and returns NULL if all are in use. */
+  CommandWaiters::Waiter* reserveCommand(AsyncWebServerRequest *request) {
+    CommandWaiters::Waiter *waiter = this->commandWaiters.reserve();
+    if (waiter == NULL) {
+      this->sendStaticJsonResponse(request, 503, "{ \"error\": \"Busy\" }");
+    }
+    return waiter;
+  }
+
+  /**
+   * Submit a command to the control loop, answered from the loop() task once applied (see
+   * sendCommandResponse()). Sends 503 and returns false if the command queue is full.
+   */
+  bool submitCommand(AsyncWebServerRequest *request, CommandWaiters::Waiter *waiter, CommandWaiters::Response response, Command::Type type, const void *data, float value = 0.0, uint32_t param = 0) {
+    if (!this->commandWaiters.submit(waiter, request, response, type, value, param, data)) {
+      this->sendStaticJsonResponse(request, 503, "{ \"error\": \"Busy\" }");
+      return false;
+    }
+    return true;
+  }
+
+  /** Submit a command without data, answered with the status once applied */
+  void submitCommand(AsyncWebServerRequest *request, Command::Type type, float value = 0.0, uint32_t param = 0) {
+    CommandWaiters::Waiter *waiter = this->reserveCommand(request);
+    if (waiter != NULL) {
+      this->submitCommand(request, waiter, CommandWaiters::STATUS, type, NULL, value, param);
+    }
+  }
+
+  /** Answer a command completed by the control loop (loop() task, request: NULL if already answered / disconnected) */
+  void sendCommandResponse(AsyncWebServerRequest *request, CommandWaiters::Waiter &waiter, bool success) {
+    if (waiter.response == CommandWaiters::PROGRAM) {
+      // copied by the sequencer, the buffer can be reused
+      this->programPending = false;
+    }
+
+    if (request == NULL) {
+      return;
+    }
+
+    switch (waiter.response) {
+      case CommandWaiters::STATUS:
+        this->sendStatusResponse(request, success);
+        break;
+      case CommandWaiters::BATCH:
+        this->sendBatchResponse(request, waiter.payload.batch, success);
+        break;
+      case CommandWaiters::PROGRAM:
+        this->sendProgramResponse(request, waiter.param, success);
+        break;
+    }
+  }
+
+  /** Send the result of a batch (status and the result of each command). */
+  void sendBatchResponse(AsyncWebServerRequest *request, const CommandBatch &batch, bool success) {
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    JsonWriter &json = response->json();
+    json.field("status", success ? "OK" : "FAIL");
+    json.key("results");
+    json.beginArray();
+    for (uint8_t idx = 0; idx < batch.nrCommands; idx++) {
+      const char* resultStr = "";
+      switch (batch.results[idx]) {
+        case CommandBatch::SKIPPED:
+          resultStr = "SKIPPED";
+          break;
+        case CommandBatch::OK:
+          resultStr = "OK";
+          break;
+        case CommandBatch::FAILED:
+          resultStr = "FAIL";
+          break;
+        case CommandBatch::BUSY:
+          resultStr = "BUSY";
+          break;
+      }
+      json.value(resultStr);
+    }
+    json.endArray();
+    this->sendJsonResponse(request, response);
+  }
+
+  /** Send the result of a sequencer program upload. */
+  void sendProgramResponse(AsyncWebServerRequest *request, uint32_t nrInstructions, bool success) {
+    if (!success) {
+      this->sendStaticJsonResponse(request, 409, "{ \"error\": \"Sequencer is active\" }");
+      return;
+    }
+
+    PooledJsonResponse *response = this->beginJsonResponse(request);
+    if (response == NULL) {
+      return;
+    }
+
+    response->json().field("status", "OK");
+    response->json().field("instructions", nrInstructions);
+    this->sendJsonResponse(request, response);
+  }
+
   /** Send status response. */
   void sendStatusResponse(AsyncWebServerRequest *request, bool success) {
-    this->sendFormattedJsonResponse(request, "{ \"status\": \"%s\" }", success ? "OK" : "FAIL");
+    this->sendStaticJsonResponse(request, 200, success ? "{ \"status\": \"OK\" }" : "{ \"status\": \"FAIL\" }");
   }
 
-  /** Send formatted json response. */
-  void sendFormattedJsonResponse(AsyncWebServerRequest *request, const char* format, ...) {
-    // format response string
-    char buffer[512];
-    va_list args; va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
+  /** Send a constant json response (sent straight from the given memory, no copy). */
+  void sendStaticJsonResponse(AsyncWebServerRequest *request, int code, const char *json) {
+    request->send(code, "application/json", (const uint8_t*) json, strlen(json));
+  }
 
-    // send the formatted string
-    request->send(200, "application/json", String(buffer));
+  /** Begin a json response written into a pooled buffer. Sends 503 and returns NULL if all the buffers are in use. */
+  PooledJsonResponse* beginJsonResponse(AsyncWebServerRequest *request, int code = 200) {
+    PooledJsonResponse *response = new PooledJsonResponse(this->jsonPool, code);
+    if (!response->isValid()) {
+      delete response;
+      this->sendStaticJsonResponse(request, 503, "{ \"error\": \"Busy\" }");
+      return NULL;
+    }
+
+    response->json().beginObject();
+    return response;
+  }
+
+  /** Send a pooled json response. */
+  void sendJsonResponse(AsyncWebServerRequest *request, PooledJsonResponse *response) {
+    response->json().endObject();
+    response->finish();
+    request->send(response);
   }
 
-  /** Read body from request. */
-  String readBody(uint8_t *data, size_t len, size_t index, size_t total) {
-    if ((index != 0) || (len >= 255) || (len != total)) {
-      // limit body length
-      return "";
+  /** Write a histogram (as a field) into a json response. */
+  void writeHistogram(JsonWriter &json, const char *name, Histogram &histogram) {
+    json.key(name);
+    char *tail = json.tail();
+    if (json.remaining() > 1) {
+      json.commit(histogram.toJson(tail, json.remaining()));
     }
+  }
+
+  /** Read the request body (parsed in place, not copied). */
+  BodyField readBody(uint8_t *data, size_t len, size_t index, size_t total) {
+    return BodyField::of(data, len, index, total);
+  }
 
-    String res;
-    for (int idx = 0; idx < len; ++idx) {
-      res += (char) data[idx];
+  /** Read a number body. Sends 400 and returns false if not a number. */
+  bool readBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, float &value) {
+    if (!this->readBody(data, len, index, total).toFloat(value)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid value\" }");
+      return false;
     }
-    return res;
+    return true;
   }
 
-  /** Read (pre-load) a static file from LittleFS.  */
-  void readStaticFile(const char *path, char *buffer, size_t maxLength) {
-    File file = LittleFS.open(path);
-    size_t bytes = file.readBytes(buffer, maxLength - 1);
-    Serial.printf("Read file %s size=%d\n", path, bytes);
-    buffer[bytes] = (char) 0;
+  bool readBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, uint32_t &value) {
+    if (!this->readBody(data, len, index, total).toUint(value)) {
+      this->sendStaticJsonResponse(request, 400, "{ \"error\": \"Invalid value\" }");
+      return false;
+    }
+    return true;
+  }
+
+  /** Operating mode name */
+  static const char* toModeStr(Load::Mode mode) {
+    const char* modeStr = "";
+    switch (mode) {
+      case Load::CONSTANT_CURRENT:
+        modeStr = "CONSTANT_CURRENT";
+        break;
+      case Load::CONSTANT_POWER:
+        modeStr = "CONSTANT_POWER";
+        break;
+      case Load::CONSTANT_RESISTANCE:
+        modeStr = "CONSTANT_RESISTANCE";
+        break;
+    }
+
+    return modeStr;
+  }
+
+  /** Protection state name */
+  static const char* toProtectionStateStr(Load::ProtectState protectionState) {
+    const char* protectionStateStr = "";
+    switch (protectionState) {
+      case Load::OK:
+        protectionStateStr = "OK";
+        break;
+      case Load::OK_DISABLED:
+        protectionStateStr = "OK_DISABLED";
+        break;
+      case Load::TRIPPED_OVER_TEMPERATURE:
+        protectionStateStr = "TRIPPED_OVER_TEMPERATURE";
+        break;
+      case Load::TRIPPED_OVER_VOLTAGE:
+        protectionStateStr = "TRIPPED_OVER_VOLTAGE";
+        break;
+      case Load::TRIPPED_OVER_CURRENT:
+        protectionStateStr = "TRIPPED_OVER_CURRENT";
+        break;
+      case Load::TRIPPED_OVER_POWER:
+        protectionStateStr = "TRIPPED_OVER_POWER";
+        break;
+    }
+
+    return protectionStateStr;
+  }
+
+  /** Power state name */
+  static const char* toPowerStateStr(Load::PowerState powerState) {
+    const char* powerStateStr = "";
+    switch (powerState) {
+      case Load::POWER_OFF:
+        powerStateStr = "OFF";
+        break;
+      case Load::POWER_ENABLING:
+        powerStateStr = "ENABLING";
+        break;
+      case Load::POWER_ON:
+        powerStateStr = "ON";
+        break;
+      case Load::POWER_DISABLING:
+        powerStateStr = "DISABLING";
+        break;
+    }
+
+    return powerStateStr;
+  }
+
+  /** Parse a batch operation ("name=value" or "name"). */
+  static bool parseBatchOperation(const BodyField &operation, Command &command) {
+    int separatorIdx = operation.indexOf('=');
+    BodyField name = separatorIdx == -1 ? operation : operation.left(separatorIdx);
+    BodyField value = separatorIdx == -1 ? BodyField() : operation.right(separatorIdx + 1);
+
+    command = {};
+    if (name.equals("enable") || name.equals("disable") || name.equals("reset-protections")) {
+      // no value
+      command.type = name.equals("reset-protections") ? Command::RESET_PROTECTIONS : Command::SET_ENABLED;
+      command.param = name.equals("enable");
+      return value.isEmpty();
+
+    } else if (name.equals("mode")) {
+      Load::Mode mode;
+      command.type = Command::SET_MODE;
+      if (!parseMode(value, mode)) {
+        return false;
+      }
+      command.param = mode;
+      return true;
+    }
+
+    if (name.equals("current")) {
+      command.type = Command::SET_CURRENT;
+    } else if (name.equals("power")) {
+      command.type = Command::SET_POWER;
+    } else if (name.equals("resistance")) {
+      command.type = Command::SET_RESISTANCE;
+    } else if (name.equals("fan")) {
+      command.type = Command::SET_FAN_SPEED;
+    } else if (name.equals("over-temperature")) {
+      command.type = Command::SET_OVER_TEMPERATURE_LIMIT;
+    } else if (name.equals("over-current")) {
+      command.type = Command::SET_OVER_CURRENT_LIMIT;
+    } else if (name.equals("over-voltage")) {
+      command.type = Command::SET_OVER_VOLTAGE_LIMIT;
+    } else if (name.equals("over-power")) {
+      command.type = Command::SET_OVER_POWER_LIMIT;
+    } else {
+      return false;
+    }
+
+    return value.toFloat(command.value);
+  }
+
+  /** Parse an operating mode name. */
+  static bool parseMode(const BodyField &field, Load::Mode &mode) {
+    if (field.equals("CONSTANT_CURRENT")) {
+      mode = Load::CONSTANT_CURRENT;
+    } else if (field.equals("CONSTANT_POWER")) {
+      mode = Load::CONSTANT_POWER;
+    } else if (field.equals("CONSTANT_RESISTANCE")) {
+      mode = Load::CONSTANT_RESISTANCE;
+    } else {
+      return false;
+    }
+    return true;
   }
 
 };
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ADAFRUIT_TINYUSB_H
+#define ADAFRUIT_TINYUSB_H
+
+/* TinyUSB CDC port (native unit tests: received data queued in nativeCdcInput, sent data recorded in nativeCdcOutput) */
+
+#include <string>
+#include "Arduino.h"
+
+/** Data to be received by the CDC port (appended by the tests) */
+inline std::string nativeCdcInput;
+
+/** Data sent by the CDC port */
+inline std::string nativeCdcOutput;
+
+class Adafruit_USBD_CDC {
+
+public:
+
+  void setStringDescriptor(const char *descriptor) {
+  }
+
+  void begin(uint32_t baud) {
+  }
+
+  int available() {
+    return nativeCdcInput.length();
+  }
+
+  int read() {
+    if (nativeCdcInput.empty()) {
+      return -1;
+    }
+    uint8_t c = nativeCdcInput[0];
+    nativeCdcInput.erase(0, 1);
+    return c;
+  }
+
+  size_t read(uint8_t *buffer, size_t size) {
+    size_t len = min(size, nativeCdcInput.length());
+    memcpy(buffer, nativeCdcInput.data(), len);
+    nativeCdcInput.erase(0, len);
+    return len;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) {
+    nativeCdcOutput.append((const char*) buffer, size);
+    return size;
+  }
+
+  void flush() {
+  }
+};
+
+#endif
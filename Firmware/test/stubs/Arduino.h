@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*
+ * Minimal Arduino / FreeRTOS API for the native (host) unit tests.
+ *
+ * Time is simulated (advanced by the tests and by delay() / vTaskDelay()), the GPIO output levels
+ * are recorded in nativeGpioLevels. The critical sections take one global lock, so an "ISR" running
+ * on another thread can not interleave with them, and mask the simulated interrupt raised by
+ * nativeRaiseInterrupt() (it runs when the outermost critical section ends).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define ARDUINO_ISR_ATTR
+#define IRAM_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define PI 3.1415926535897932384626433832795
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+/** Simulated time (64-bit, see esp_timer_get_time()) */
+inline std::atomic<uint64_t> nativeMicros { 0 };
+
+/** 32-bit, like on the ESP32 (wraps after ~71.6 minutes) */
+inline uint32_t micros() {
+  return (uint32_t) nativeMicros.load();
+}
+
+inline uint32_t millis() {
+  return (uint32_t) (nativeMicros.load() / 1000);
+}
+
+inline void delay(uint32_t ms) {
+  nativeMicros += (uint64_t) ms * 1000;
+  std::this_thread::yield();
+}
+
+/** Simulated GPIO output levels (one bit per pin) */
+inline std::atomic<uint64_t> nativeGpioLevels { 0 };
+
+/** Called after each GPIO register write (optional, ex. to raise an interrupt in the middle of a DAC write) */
+inline std::function<void()> nativeGpioWriteHook;
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  if (level) {
+    nativeGpioLevels.fetch_or((uint64_t) 1 << pin);
+  } else {
+    nativeGpioLevels.fetch_and(~((uint64_t) 1 << pin));
+  }
+}
+
+inline int digitalRead(uint8_t pin) {
+  return (nativeGpioLevels.load() >> pin) & 1;
+}
+
+inline void analogWrite(uint8_t pin, int value) {
+}
+
+/** Serial console (output discarded) */
+struct NativeSerial {
+  template<typename... Args> size_t print(Args...) { return 0; }
+  template<typename... Args> size_t println(Args...) { return 0; }
+  template<typename... Args> size_t printf(Args...) { return 0; }
+  void flush() {}
+};
+
+inline NativeSerial Serial;
+
+/** Chip info */
+struct NativeEsp {
+  uint64_t getEfuseMac() { return 0x0000AABBCCDDEEFF; }
+};
+
+inline NativeEsp ESP;
+
+/** FreeRTOS */
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+typedef struct {
+  uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+inline std::recursive_mutex nativeCriticalLock;
+inline uint32_t nativeCriticalDepth = 0;
+inline std::function<void()> nativePendingInterrupt;
+
+/** Raise a simulated interrupt on the current thread (runs now, or at the end of the critical section) */
+inline void nativeRaiseInterrupt(std::function<void()> isr) {
+  std::lock_guard<std::recursive_mutex> guard(nativeCriticalLock);
+  if (nativeCriticalDepth > 0) {
+    nativePendingInterrupt = isr;
+    return;
+  }
+  isr();
+}
+
+inline void nativeEnterCritical() {
+  nativeCriticalLock.lock();
+  nativeCriticalDepth++;
+}
+
+inline void nativeExitCritical() {
+  std::function<void()> isr;
+  if (--nativeCriticalDepth == 0) {
+    isr.swap(nativePendingInterrupt);
+  }
+  nativeCriticalLock.unlock();
+
+  if (isr) {
+    nativeRaiseInterrupt(isr);
+  }
+}
+
+#define taskENTER_CRITICAL(mux) nativeEnterCritical()
+#define taskEXIT_CRITICAL(mux) nativeExitCritical()
+#define taskENTER_CRITICAL_ISR(mux) nativeEnterCritical()
+#define taskEXIT_CRITICAL_ISR(mux) nativeExitCritical()
+#define portYIELD_FROM_ISR(woken)
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return (TaskHandle_t) 1;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  if (woken != NULL) {
+    *woken = pdTRUE;
+  }
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  return 1;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+#endif
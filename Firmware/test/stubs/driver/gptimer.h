@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef DRIVER_GPTIMER_H
+#define DRIVER_GPTIMER_H
+
+/* General purpose timer driver (native unit tests: no alarms, the tests call the alarm handlers directly) */
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+
+typedef struct gptimer_t *gptimer_handle_t;
+
+typedef struct {
+  uint64_t count_value;
+  uint64_t alarm_value;
+} gptimer_alarm_event_data_t;
+
+typedef bool (*gptimer_alarm_cb_t)(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userData);
+
+typedef struct {
+  gptimer_alarm_cb_t on_alarm;
+} gptimer_event_callbacks_t;
+
+typedef enum {
+  GPTIMER_CLK_SRC_DEFAULT
+} gptimer_clock_source_t;
+
+typedef enum {
+  GPTIMER_COUNT_UP
+} gptimer_count_direction_t;
+
+typedef struct {
+  gptimer_clock_source_t clk_src;
+  gptimer_count_direction_t direction;
+  uint32_t resolution_hz;
+} gptimer_config_t;
+
+typedef struct {
+  uint64_t alarm_count;
+  uint64_t reload_count;
+  struct {
+    uint32_t auto_reload_on_alarm: 1;
+  } flags;
+} gptimer_alarm_config_t;
+
+inline esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *timer) {
+  static uint8_t nativeTimer;
+  *timer = (gptimer_handle_t) &nativeTimer;
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *callbacks, void *userData) {
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_enable(gptimer_handle_t timer) {
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_start(gptimer_handle_t timer) {
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_stop(gptimer_handle_t timer) {
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value) {
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t *value) {
+  *value = 0;
+  return ESP_OK;
+}
+
+inline esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config) {
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ADC_CALI_SCHEME_H
+#define ADC_CALI_SCHEME_H
+
+/* ADC calibration (native unit tests: no calibration scheme, ideal ADC) */
+
+#include "esp_adc/adc_continuous.h"
+
+typedef struct adc_cali_scheme_t *adc_cali_handle_t;
+
+inline esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage) {
+  return ESP_FAIL;
+}
+
+#endif
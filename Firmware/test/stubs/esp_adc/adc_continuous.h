@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ADC_CONTINUOUS_H
+#define ADC_CONTINUOUS_H
+
+/* Continuous ADC driver (native unit tests: types only, the frames are fed by the tests) */
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum {
+  ADC_UNIT_1,
+  ADC_UNIT_2
+} adc_unit_t;
+
+typedef int adc_channel_t;
+
+typedef enum {
+  ADC_ATTEN_DB_0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_11
+} adc_atten_t;
+
+typedef enum {
+  ADC_BITWIDTH_DEFAULT = 0,
+  ADC_BITWIDTH_9 = 9,
+  ADC_BITWIDTH_10 = 10,
+  ADC_BITWIDTH_11 = 11,
+  ADC_BITWIDTH_12 = 12,
+  ADC_BITWIDTH_13 = 13
+} adc_bitwidth_t;
+
+typedef enum {
+  ADC_CONV_SINGLE_UNIT_1 = 1,
+  ADC_CONV_SINGLE_UNIT_2 = 2
+} adc_digi_convert_mode_t;
+
+typedef enum {
+  ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  ADC_DIGI_OUTPUT_FORMAT_TYPE2
+} adc_digi_output_format_t;
+
+#define SOC_ADC_MAX_CHANNEL_NUM 10
+#define SOC_ADC_PATT_LEN_MAX 24
+#define SOC_ADC_DIGI_MAX_BITWIDTH 12
+
+/** DMA conversion result (same layout as the IDF) */
+#if defined ESP32_S2
+#define SOC_ADC_DIGI_RESULT_BYTES 2
+typedef struct {
+  union {
+    struct {
+      uint16_t data: 12;
+      uint16_t channel: 4;
+    } type1;
+    struct {
+      uint16_t data: 11;
+      uint16_t channel: 4;
+      uint16_t unit: 1;
+    } type2;
+    uint16_t val;
+  };
+} adc_digi_output_data_t;
+#else // S3
+#define SOC_ADC_DIGI_RESULT_BYTES 4
+typedef struct {
+  union {
+    struct {
+      uint32_t data: 12;
+      uint32_t reserved12: 1;
+      uint32_t channel: 4;
+      uint32_t unit: 1;
+      uint32_t reserved17_31: 14;
+    } type2;
+    uint32_t val;
+  };
+} adc_digi_output_data_t;
+#endif
+
+typedef struct adc_continuous_ctx_t *adc_continuous_handle_t;
+
+typedef struct {
+  uint8_t *conv_frame_buffer;
+  uint32_t size;
+} adc_continuous_evt_data_t;
+
+typedef bool (*adc_continuous_callback_t)(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *userData);
+
+typedef struct {
+  adc_continuous_callback_t on_conv_done;
+  adc_continuous_callback_t on_pool_ovf;
+} adc_continuous_evt_cbs_t;
+
+typedef struct {
+  uint32_t max_store_buf_size;
+  uint32_t conv_frame_size;
+} adc_continuous_handle_cfg_t;
+
+typedef struct {
+  uint8_t atten;
+  uint8_t channel;
+  uint8_t unit;
+  uint8_t bit_width;
+} adc_digi_pattern_config_t;
+
+typedef struct {
+  uint32_t pattern_num;
+  adc_digi_pattern_config_t *adc_pattern;
+  uint32_t sample_freq_hz;
+  adc_digi_convert_mode_t conv_mode;
+  adc_digi_output_format_t format;
+} adc_continuous_config_t;
+
+inline esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *config, adc_continuous_handle_t *handle) {
+  *handle = NULL;
+  return ESP_OK;
+}
+
+inline esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t *config) {
+  return ESP_OK;
+}
+
+inline esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t *callbacks, void *userData) {
+  return ESP_OK;
+}
+
+inline esp_err_t adc_continuous_start(adc_continuous_handle_t handle) {
+  return ESP_OK;
+}
+
+inline esp_err_t adc_continuous_stop(adc_continuous_handle_t handle) {
+  return ESP_OK;
+}
+
+/** GPIO1 - GPIO10: ADC1 channels 0 - 9, GPIO11 - GPIO20: ADC2 channels 0 - 9 */
+inline esp_err_t adc_continuous_io_to_channel(int ioNum, adc_unit_t *unit, adc_channel_t *channel) {
+  if ((ioNum < 1) || (ioNum > 20)) {
+    return ESP_FAIL;
+  }
+
+  *unit = ioNum <= 10 ? ADC_UNIT_1 : ADC_UNIT_2;
+  *channel = (ioNum - 1) % 10;
+  return ESP_OK;
+}
+
+#endif
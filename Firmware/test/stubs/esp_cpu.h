@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+/* CPU cycle counter (native unit tests: nanoseconds of the host clock) */
+
+#include <stdint.h>
+#include <chrono>
+
+inline uint32_t esp_cpu_get_cycle_count() {
+  return (uint32_t) std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+/* Heap capabilities allocator (native unit tests: plain malloc) */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) {
+  return malloc(size);
+}
+
+inline void* heap_caps_malloc_prefer(size_t size, size_t nrCaps, ...) {
+  return malloc(size);
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+/* 64-bit microsecond time since boot (native unit tests: the simulated time) */
+
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() {
+  return (int64_t) nativeMicros.load();
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#ifndef GPIO_HAL_H
+#define GPIO_HAL_H
+
+/* GPIO set / clear registers (native unit tests: update the simulated levels in nativeGpioLevels) */
+
+#include <Arduino.h>
+
+/** Write-only set (or clear) register of 32 pins */
+struct NativeGpioReg {
+  const bool set;
+  const uint8_t firstPin;
+
+  NativeGpioReg &operator=(uint32_t mask) {
+    if (this->set) {
+      nativeGpioLevels.fetch_or((uint64_t) mask << this->firstPin);
+    } else {
+      nativeGpioLevels.fetch_and(~((uint64_t) mask << this->firstPin));
+    }
+
+    std::function<void()> hook = nativeGpioWriteHook;
+    if (hook) {
+      hook();
+    }
+    return *this;
+  }
+};
+
+struct NativeGpioRegVal {
+  NativeGpioReg val;
+};
+
+struct NativeGpioDev {
+  NativeGpioReg out_w1ts { true, 0 };
+  NativeGpioReg out_w1tc { false, 0 };
+  NativeGpioRegVal out1_w1ts { { true, 32 } };
+  NativeGpioRegVal out1_w1tc { { false, 32 } };
+};
+
+inline NativeGpioDev GPIO;
+
+#endif
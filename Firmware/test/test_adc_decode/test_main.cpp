@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#include <unity.h>
+#include "adc.h"
+
+/* DMA frame decoding tests: demultiplexing and averaging per channel, published frames, decode time */
+
+/** ADC pins (as on the board): voltage 1, current 1, current 2, temperature, voltage 2 => ADC1 channels 5, 9, 8, 4, 6 */
+const uint8_t NR_PINS = 5;
+const uint8_t PINS[NR_PINS] = { 6, 10, 9, 5, 7 };
+
+/**
+ * DMA buffers, 4 conversions per pin in pattern order (raw codes per channel):
+ *   5: 2048 2050 2046 2052, 9: 1000 1003 997 1004, 8: 12 10 14 12, 4: 3000 2999 3001 3004, 6: 0 1 0 3
+ */
+#if defined ESP32_S2
+// type 1: data:12, channel:4
+uint8_t FULL_FRAME[] = {
+  0x00, 0x58, 0xe8, 0x93, 0x0c, 0x80, 0xb8, 0x4b, 0x00, 0x60, 0x02, 0x58, 0xeb, 0x93, 0x0a, 0x80,
+  0xb7, 0x4b, 0x01, 0x60, 0xfe, 0x57, 0xe5, 0x93, 0x0e, 0x80, 0xb9, 0x4b, 0x00, 0x60, 0x04, 0x58,
+  0xec, 0x93, 0x0c, 0x80, 0xbc, 0x4b, 0x03, 0x60,
+};
+#else // S3
+// type 2: data:12, reserved:1, channel:4, unit:1, reserved:14
+uint8_t FULL_FRAME[] = {
+  0x00, 0xa8, 0x00, 0x00, 0xe8, 0x23, 0x01, 0x00, 0x0c, 0x00, 0x01, 0x00, 0xb8, 0x8b, 0x00, 0x00,
+  0x00, 0xc0, 0x00, 0x00, 0x02, 0xa8, 0x00, 0x00, 0xeb, 0x23, 0x01, 0x00, 0x0a, 0x00, 0x01, 0x00,
+  0xb7, 0x8b, 0x00, 0x00, 0x01, 0xc0, 0x00, 0x00, 0xfe, 0xa7, 0x00, 0x00, 0xe5, 0x23, 0x01, 0x00,
+  0x0e, 0x00, 0x01, 0x00, 0xb9, 0x8b, 0x00, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x04, 0xa8, 0x00, 0x00,
+  0xec, 0x23, 0x01, 0x00, 0x0c, 0x00, 0x01, 0x00, 0xbc, 0x8b, 0x00, 0x00, 0x03, 0xc0, 0x00, 0x00,
+};
+#endif
+const uint16_t FULL_FRAME_VALUES[NR_PINS] = { 2049, 1001, 12, 3001, 1 };
+
+/**
+ * DMA buffers, out of order conversions, a channel without a pin (0), no conversion of channel 8:
+ *   9:4095 5:100 0:4095 5:102 4:1500 9:4093 6:2000 5:98 4:1502 6:2002 0:4095 5:104
+ */
+#if defined ESP32_S2
+uint8_t PARTIAL_FRAME[] = {
+  0xff, 0x9f, 0x64, 0x50, 0xff, 0x0f, 0x66, 0x50, 0xdc, 0x45, 0xfd, 0x9f, 0xd0, 0x67, 0x62, 0x50,
+  0xde, 0x45, 0xd2, 0x67, 0xff, 0x0f, 0x68, 0x50,
+};
+#else // S3
+uint8_t PARTIAL_FRAME[] = {
+  0xff, 0x2f, 0x01, 0x00, 0x64, 0xa0, 0x00, 0x00, 0xff, 0x0f, 0x00, 0x00, 0x66, 0xa0, 0x00, 0x00,
+  0xdc, 0x85, 0x00, 0x00, 0xfd, 0x2f, 0x01, 0x00, 0xd0, 0xc7, 0x00, 0x00, 0x62, 0xa0, 0x00, 0x00,
+  0xde, 0x85, 0x00, 0x00, 0xd2, 0xc7, 0x00, 0x00, 0xff, 0x0f, 0x00, 0x00, 0x68, 0xa0, 0x00, 0x00,
+};
+#endif
+const uint16_t PARTIAL_FRAME_VALUES[NR_PINS] = { 101, 4094, 0, 1501, 2001 };
+
+ADC *adc;
+
+/** Feed a DMA buffer through the continuous ADC callback */
+bool feed(uint8_t *buffer, uint32_t size) {
+  adc_continuous_evt_data_t edata = {};
+  edata.conv_frame_buffer = buffer;
+  edata.size = size;
+  return adcComplete(NULL, &edata, adc);
+}
+
+void setUp() {
+  nativeMicros = 1000000;
+  adc = new ADC(NR_PINS, PINS);
+  adc->begin();
+}
+
+void tearDown() {
+  delete adc;
+}
+
+void test_full_frame_averaged_per_channel() {
+  SampleBuffer::Cursor cursor(adc->samples);
+  feed(FULL_FRAME, sizeof(FULL_FRAME));
+
+  SampleFrame frame;
+  TEST_ASSERT_TRUE(cursor.read(frame));
+  TEST_ASSERT_EQUAL_UINT32(0, frame.seq);
+  TEST_ASSERT_EQUAL_UINT64(1000000, frame.timestampMicros);
+  for (uint8_t idx = 0; idx < NR_PINS; idx++) {
+    TEST_ASSERT_EQUAL_UINT16(FULL_FRAME_VALUES[idx], frame.values[idx]);
+  }
+  TEST_ASSERT_FALSE(cursor.read(frame));
+}
+
+void test_partial_frame_ignores_unknown_channels() {
+  SampleBuffer::Cursor cursor(adc->samples);
+  feed(PARTIAL_FRAME, sizeof(PARTIAL_FRAME));
+
+  SampleFrame frame;
+  TEST_ASSERT_TRUE(cursor.read(frame));
+  for (uint8_t idx = 0; idx < NR_PINS; idx++) {
+    TEST_ASSERT_EQUAL_UINT16(PARTIAL_FRAME_VALUES[idx], frame.values[idx]);
+  }
+}
+
+void test_frames_published_in_order() {
+  SampleBuffer::Cursor cursor(adc->samples);
+  for (uint32_t nr = 0; nr < 10; nr++) {
+    nativeMicros += adc->getFramePeriodMicros();
+    if (nr % 2 == 0) {
+      feed(FULL_FRAME, sizeof(FULL_FRAME));
+    } else {
+      feed(PARTIAL_FRAME, sizeof(PARTIAL_FRAME));
+    }
+  }
+
+  SampleFrame frame;
+  for (uint32_t nr = 0; nr < 10; nr++) {
+    TEST_ASSERT_TRUE(cursor.read(frame));
+    TEST_ASSERT_EQUAL_UINT32(nr, frame.seq);
+    TEST_ASSERT_EQUAL_UINT64(1000000 + (nr + 1) * adc->getFramePeriodMicros(), frame.timestampMicros);
+    TEST_ASSERT_EQUAL_UINT16(nr % 2 == 0 ? FULL_FRAME_VALUES[0] : PARTIAL_FRAME_VALUES[0], frame.values[0]);
+  }
+  TEST_ASSERT_EQUAL_UINT16(PARTIAL_FRAME_VALUES[1], adc->getRaw(1));
+}
+
+void test_timestamps_monotonic_across_micros_wrap() {
+  SampleBuffer::Cursor cursor(adc->samples);
+  nativeMicros = 0xFFFFFFFFull - 100;
+  feed(FULL_FRAME, sizeof(FULL_FRAME));
+  nativeMicros += 1000;
+  feed(FULL_FRAME, sizeof(FULL_FRAME));
+
+  SampleFrame first;
+  SampleFrame second;
+  TEST_ASSERT_TRUE(cursor.read(first));
+  TEST_ASSERT_TRUE(cursor.read(second));
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFFFFull - 100, first.timestampMicros);
+  TEST_ASSERT_EQUAL_UINT64(0xFFFFFFFFull + 900, second.timestampMicros);
+}
+
+void test_empty_frame() {
+  SampleBuffer::Cursor cursor(adc->samples);
+  feed(FULL_FRAME, 0);
+
+  SampleFrame frame;
+  TEST_ASSERT_TRUE(cursor.read(frame));
+  for (uint8_t idx = 0; idx < NR_PINS; idx++) {
+    TEST_ASSERT_EQUAL_UINT16(0, frame.values[idx]);
+  }
+}
+
+void test_decode_time_recorded_per_frame() {
+  adc->decodeCycles.reset();
+  feed(FULL_FRAME, sizeof(FULL_FRAME));
+  feed(PARTIAL_FRAME, sizeof(PARTIAL_FRAME));
+  TEST_ASSERT_EQUAL_UINT32(2, adc->decodeCycles.getCount());
+}
+
+void test_notify_task_woken() {
+  TEST_ASSERT_FALSE(feed(FULL_FRAME, sizeof(FULL_FRAME)));
+
+  adc->setNotifyTask(xTaskGetCurrentTaskHandle());
+  TEST_ASSERT_TRUE(feed(FULL_FRAME, sizeof(FULL_FRAME)));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_frame_averaged_per_channel);
+  RUN_TEST(test_partial_frame_ignores_unknown_channels);
+  RUN_TEST(test_frames_published_in_order);
+  RUN_TEST(test_timestamps_monotonic_across_micros_wrap);
+  RUN_TEST(test_empty_frame);
+  RUN_TEST(test_decode_time_recorded_per_frame);
+  RUN_TEST(test_notify_task_woken);
+  return UNITY_END();
+}
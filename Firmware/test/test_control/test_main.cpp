@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#include <unity.h>
+#include "control.h"
+#include "scpiport.h"
+
+/* Control loop command tests: batches validated and applied in one tick (*RST settings) */
+
+/** Pins (as on the ESP32-S3 board) */
+const uint8_t LOAD_PWR_EN_PIN = 8;
+const uint8_t FAN_PIN = 3;
+
+const uint8_t NR_DAC_PINS = 14;
+const uint8_t DAC_PINS[NR_DAC_PINS] = { 48, 14, 35, 36, 37, 38, 39, 1, 2, 42, 12, 13, 41, 40 };
+
+const uint8_t NR_ADC_PINS = 5;
+const uint8_t ADC_PINS[NR_ADC_PINS] = { 6, 10, 9, 5, 7 };
+
+/** Protection limits */
+const float OVER_VOLTAGE_LIMIT = 20.0;
+
+DAC *dac;
+ADC *adc;
+Fan *fan;
+FastProtection *fastProtection;
+Load *load;
+Shaper *shaper;
+DynamicLoad *dynamicLoad;
+Sequencer *sequencer;
+Capture *capture;
+EventLog *events;
+CommandQueue *commands;
+ControlLoop *controlLoop;
+
+/** Feed a DMA frame with the same raw code for every conversion of a pin through the continuous ADC callback */
+void feedFrame(const uint16_t codes[NR_ADC_PINS]) {
+  adc_digi_output_data_t data[ADC_CONTINUOUS_CONVERSIONS_PER_PIN * NR_ADC_PINS] = {};
+  for (uint8_t nr = 0; nr < ADC_CONTINUOUS_CONVERSIONS_PER_PIN; nr++) {
+    for (uint8_t idx = 0; idx < NR_ADC_PINS; idx++) {
+      adc_unit_t unit;
+      adc_channel_t channel = 0;
+      adc_continuous_io_to_channel(ADC_PINS[idx], &unit, &channel);
+
+      adc_digi_output_data_t *conversion = &data[nr * NR_ADC_PINS + idx];
+      ADC_GET_CHANNEL(conversion) = channel;
+      ADC_GET_DATA(conversion) = codes[idx];
+    }
+  }
+
+  adc_continuous_evt_data_t edata = {};
+  edata.conv_frame_buffer = (uint8_t*) data;
+  edata.size = sizeof(data);
+  adcComplete(NULL, &edata, adc);
+}
+
+/** Frame below the protection limits (~1V, no current) */
+void feedNormalFrame() {
+  const uint16_t codes[NR_ADC_PINS] = { 1000, 0, 0, 2000, 100 };
+  feedFrame(codes);
+}
+
+/** Frame above the over voltage limit */
+void feedOverVoltageFrame() {
+  const uint16_t codes[NR_ADC_PINS] = { 4095, 0, 0, 2000, 4095 };
+  feedFrame(codes);
+}
+
+/** Run control loop ticks (1ms apart, one normal frame each) */
+void tick(uint32_t nrTicks = 1) {
+  for (uint32_t nr = 0; nr < nrTicks; nr++) {
+    delay(1);
+    feedNormalFrame();
+    controlLoop->handle();
+  }
+}
+
+/** Post a batch, apply it in the next tick. Returns the result of the batch. */
+bool applyBatch(CommandBatch &batch) {
+  int8_t token = commands->post(Command::BATCH, 0.0, 0, &batch);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, token);
+
+  tick();
+
+  bool result = false;
+  TEST_ASSERT_TRUE(commands->poll(token, result));
+  return result;
+}
+
+/** Check the state left by *RST */
+void assertResetState() {
+  TEST_ASSERT_FALSE(load->isEnabled());
+  TEST_ASSERT_EQUAL(Load::CONSTANT_CURRENT, load->getMode());
+  TEST_ASSERT_EQUAL_FLOAT(0.0, load->getSetCurrent());
+  TEST_ASSERT_EQUAL_FLOAT(0.0, load->getSetPower());
+}
+
+void setUp() {
+  nativeMicros = 1000000;
+  nativeGpioLevels = 0;
+
+  HardwareValues::init();
+  dac = new DAC(NR_DAC_PINS, DAC_PINS, HardwareValues::DAC_NR_PRESETS);
+  adc = new ADC(NR_ADC_PINS, ADC_PINS);
+  fan = new Fan(FAN_PIN, 255);
+  fastProtection = new FastProtection(*dac, LOAD_PWR_EN_PIN, HardwareValues::DAC_PRESET_ZERO);
+  load = new Load(*dac, *adc, *fan, *fastProtection, LOAD_PWR_EN_PIN);
+  shaper = new Shaper(*load, *dac, 16);
+  dynamicLoad = new DynamicLoad(*load, *dac);
+  sequencer = new Sequencer(*load);
+  capture = new Capture(adc->samples, *load);
+  events = new EventLog();
+  commands = new CommandQueue();
+  controlLoop = new ControlLoop(*adc, *load, *shaper, *dynamicLoad, *sequencer, *capture, *events, *commands);
+
+  TEST_ASSERT_TRUE(load->begin());
+  controlLoop->begin();
+  TEST_ASSERT_TRUE(load->setOverVoltageLimit(OVER_VOLTAGE_LIMIT));
+  TEST_ASSERT_TRUE(load->setAutoEnableDisableOnPower(false));
+
+  tick();
+}
+
+void tearDown() {
+  delete controlLoop;
+  delete commands;
+  delete events;
+  delete capture;
+  delete sequencer;
+  delete dynamicLoad;
+  delete shaper;
+  delete load;
+  delete fastProtection;
+  delete fan;
+  delete adc;
+  delete dac;
+}
+
+void test_reset_from_constant_current() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  tick(load->getPowerEnableSettleMs() + 1);
+  TEST_ASSERT_TRUE(load->isPowerReady());
+
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  TEST_ASSERT_TRUE(applyBatch(batch));
+  for (uint8_t idx = 0; idx < batch.nrCommands; idx++) {
+    TEST_ASSERT_EQUAL(CommandBatch::OK, batch.results[idx]);
+  }
+  assertResetState();
+}
+
+void test_reset_from_constant_power() {
+  TEST_ASSERT_TRUE(load->setMode(Load::CONSTANT_POWER));
+  TEST_ASSERT_TRUE(load->setEnabled(true));
+  TEST_ASSERT_TRUE(load->setPower(2.0));
+  tick();
+  TEST_ASSERT_TRUE(load->isEnabled());
+
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  TEST_ASSERT_TRUE(applyBatch(batch));
+  assertResetState();
+}
+
+void test_reset_from_constant_resistance() {
+  TEST_ASSERT_TRUE(load->setMode(Load::CONSTANT_RESISTANCE));
+  TEST_ASSERT_TRUE(load->setResistance(10.0));
+  tick();
+  TEST_ASSERT_TRUE(load->isEnabled());
+
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  TEST_ASSERT_TRUE(applyBatch(batch));
+  assertResetState();
+  TEST_ASSERT_TRUE(load->getSetResistance() > 1000000.0);
+}
+
+void test_reset_while_tripped() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  tick(load->getPowerEnableSettleMs() + 1);
+
+  feedOverVoltageFrame();
+  controlLoop->handle();
+  TEST_ASSERT_TRUE(load->isTripped());
+
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  TEST_ASSERT_TRUE(applyBatch(batch));
+  assertResetState();
+  TEST_ASSERT_TRUE(load->isTripped());
+}
+
+void test_invalid_batch_not_applied() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  tick();
+
+  // set power after switching to constant current mode: rejected, nothing applied
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  batch.commands[batch.nrCommands].type = Command::SET_POWER;
+  batch.nrCommands++;
+  TEST_ASSERT_FALSE(applyBatch(batch));
+  TEST_ASSERT_EQUAL(CommandBatch::SKIPPED, batch.results[0]);
+  TEST_ASSERT_EQUAL(CommandBatch::FAILED, batch.results[batch.nrCommands - 1]);
+
+  TEST_ASSERT_TRUE(load->isEnabled());
+  TEST_ASSERT_EQUAL_FLOAT(1.0, load->getSetCurrent());
+}
+
+void test_settings_busy_while_sequencer_active() {
+  Program program;
+  ProgramCompiler compiler;
+  compiler.begin(&program);
+  const char source[] = "CC 0.5 FOR 1h\n";
+  TEST_ASSERT_TRUE(compiler.feed((const uint8_t*) source, strlen(source)));
+  TEST_ASSERT_TRUE(compiler.end());
+
+  TEST_ASSERT_TRUE(sequencer->setProgram(program));
+  TEST_ASSERT_TRUE(sequencer->start());
+  tick(load->getPowerEnableSettleMs() + 1);
+  TEST_ASSERT_TRUE(sequencer->isActive());
+  TEST_ASSERT_EQUAL(Sequencer::RUNNING, sequencer->getStatus().state);
+  TEST_ASSERT_EQUAL_FLOAT(0.5, load->getSetCurrent());
+
+  // set points owned by the sequencer
+  int8_t token = commands->post(Command::SET_CURRENT, 2.0);
+  tick();
+  bool result = true;
+  TEST_ASSERT_TRUE(commands->poll(token, result));
+  TEST_ASSERT_FALSE(result);
+
+  CommandBatch batch;
+  ScpiPort::resetSettings(batch);
+  TEST_ASSERT_FALSE(applyBatch(batch));
+  TEST_ASSERT_EQUAL(CommandBatch::BUSY, batch.results[1]);
+  TEST_ASSERT_TRUE(sequencer->isActive());
+  TEST_ASSERT_EQUAL_FLOAT(0.5, load->getSetCurrent());
+
+  // *RST: stopped first, then the settings applied (in the same tick)
+  token = commands->post(Command::SEQUENCER_STOP);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, token);
+  TEST_ASSERT_TRUE(applyBatch(batch));
+  TEST_ASSERT_TRUE(commands->poll(token, result));
+  TEST_ASSERT_TRUE(result);
+  TEST_ASSERT_FALSE(sequencer->isActive());
+  TEST_ASSERT_EQUAL(Sequencer::IDLE, sequencer->getStatus().state);
+  TEST_ASSERT_EQUAL(Sequencer::STOPPED, sequencer->getStatus().stopReason);
+  assertResetState();
+}
+
+void test_scpi_reset_response_after_tick() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  tick();
+
+  ScpiPort scpiPort(*load, *commands);
+  scpiPort.begin();
+  nativeCdcInput = "*RST;*OPC?\n:CURR?\n";
+  nativeCdcOutput.clear();
+
+  // settings posted without blocking, the response (and the next line) waits for the control loop
+  scpiPort.handle();
+  TEST_ASSERT_EQUAL_STRING("", nativeCdcOutput.c_str());
+  TEST_ASSERT_TRUE(load->isEnabled());
+
+  tick();
+  scpiPort.handle();
+  TEST_ASSERT_FALSE(load->isEnabled());
+  TEST_ASSERT_EQUAL_STRING("1\n0.000\n", nativeCdcOutput.c_str());
+
+  nativeCdcInput = "SYST:ERR?\n";
+  nativeCdcOutput.clear();
+  scpiPort.handle();
+  TEST_ASSERT_EQUAL_STRING("0,\"No error\"\n", nativeCdcOutput.c_str());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reset_from_constant_current);
+  RUN_TEST(test_reset_from_constant_power);
+  RUN_TEST(test_reset_from_constant_resistance);
+  RUN_TEST(test_reset_while_tripped);
+  RUN_TEST(test_invalid_batch_not_applied);
+  RUN_TEST(test_settings_busy_while_sequencer_active);
+  RUN_TEST(test_scpi_reset_response_after_tick);
+  return UNITY_END();
+}
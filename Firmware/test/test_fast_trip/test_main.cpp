@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#include <unity.h>
+#include "load.h"
+
+/* Fast protection trip simulation: trip in the ADC interrupt, bookkeeping in the control loop, trips during control loop writes */
+
+/** Pins (as on the ESP32-S3 board) */
+const uint8_t LOAD_PWR_EN_PIN = 8;
+const uint8_t FAN_PIN = 3;
+
+const uint8_t NR_DAC_PINS = 14;
+const uint8_t DAC_PINS[NR_DAC_PINS] = { 48, 14, 35, 36, 37, 38, 39, 1, 2, 42, 12, 13, 41, 40 };
+
+const uint8_t NR_ADC_PINS = 5;
+const uint8_t ADC_PINS[NR_ADC_PINS] = { 6, 10, 9, 5, 7 };
+
+/** Protection limits */
+const float OVER_VOLTAGE_LIMIT = 20.0;
+const float OVER_CURRENT_LIMIT = 1.0;
+
+DAC *dac;
+ADC *adc;
+Fan *fan;
+FastProtection *fastProtection;
+Load *load;
+
+/** Feed a DMA frame with the same raw code for every conversion of a pin through the continuous ADC callback */
+void feedFrame(const uint16_t codes[NR_ADC_PINS]) {
+  adc_digi_output_data_t data[ADC_CONTINUOUS_CONVERSIONS_PER_PIN * NR_ADC_PINS] = {};
+  for (uint8_t nr = 0; nr < ADC_CONTINUOUS_CONVERSIONS_PER_PIN; nr++) {
+    for (uint8_t idx = 0; idx < NR_ADC_PINS; idx++) {
+      adc_unit_t unit;
+      adc_channel_t channel;
+      adc_continuous_io_to_channel(ADC_PINS[idx], &unit, &channel);
+
+      adc_digi_output_data_t *conversion = &data[nr * NR_ADC_PINS + idx];
+      ADC_GET_CHANNEL(conversion) = channel;
+      ADC_GET_DATA(conversion) = codes[idx];
+    }
+  }
+
+  adc_continuous_evt_data_t edata = {};
+  edata.conv_frame_buffer = (uint8_t*) data;
+  edata.size = sizeof(data);
+  adcComplete(NULL, &edata, adc);
+}
+
+/** Frame below the protection limits (~1V, no current) */
+void feedNormalFrame() {
+  const uint16_t codes[NR_ADC_PINS] = { 1000, 0, 0, 2000, 100 };
+  feedFrame(codes);
+}
+
+/** Frame above the over voltage limit */
+void feedOverVoltageFrame() {
+  const uint16_t codes[NR_ADC_PINS] = { 4095, 0, 0, 2000, 4095 };
+  feedFrame(codes);
+}
+
+/**
+ * Frame with a current spike on the 1st channel only (above the fast protection threshold of the
+ * channel, but the total current stays bellow the over current limit of the control loop)
+ */
+void feedCurrentSpikeFrame() {
+  SampleFrame frame = {};
+  uint16_t code = 0;
+  for (; code < CalibrationTable::SIZE; code++) {
+    frame.values[1] = code;
+    Load::Measurement measurement;
+    load->measure(frame, measurement);
+    if (measurement.current >= 0.75 * OVER_CURRENT_LIMIT) {
+      break;
+    }
+  }
+
+  const uint16_t codes[NR_ADC_PINS] = { 1000, code, 0, 2000, 100 };
+  feedFrame(codes);
+}
+
+/** Simulated DAC output code (from the GPIO levels) */
+uint16_t dacOutput() {
+  uint64_t levels = nativeGpioLevels.load();
+  uint16_t value = 0;
+  for (uint8_t nr = 0; nr < NR_DAC_PINS; nr++) {
+    if ((levels >> DAC_PINS[nr]) & 1) {
+      value |= 1 << nr;
+    }
+  }
+  return value;
+}
+
+bool powerEnabled() {
+  return digitalRead(LOAD_PWR_EN_PIN) == HIGH;
+}
+
+/** Run control loop ticks (1ms apart) */
+void tick(uint32_t nrTicks = 1) {
+  for (uint32_t nr = 0; nr < nrTicks; nr++) {
+    delay(1);
+    load->handle();
+  }
+}
+
+/** Enable the load at 1A and wait until the power stage is on */
+void enableLoad() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  tick(load->getPowerEnableSettleMs() + 1);
+  TEST_ASSERT_EQUAL(Load::POWER_ON, load->getPowerState());
+}
+
+void setUp() {
+  nativeMicros = 1000000;
+  nativeGpioLevels = 0;
+
+  HardwareValues::init();
+  dac = new DAC(NR_DAC_PINS, DAC_PINS, HardwareValues::DAC_NR_PRESETS);
+  adc = new ADC(NR_ADC_PINS, ADC_PINS);
+  fan = new Fan(FAN_PIN, 255);
+  fastProtection = new FastProtection(*dac, LOAD_PWR_EN_PIN, HardwareValues::DAC_PRESET_ZERO);
+  load = new Load(*dac, *adc, *fan, *fastProtection, LOAD_PWR_EN_PIN);
+
+  TEST_ASSERT_TRUE(load->begin());
+  adc->begin();
+  TEST_ASSERT_TRUE(load->setOverVoltageLimit(OVER_VOLTAGE_LIMIT));
+  TEST_ASSERT_TRUE(load->setOverCurrentLimit(OVER_CURRENT_LIMIT));
+
+  feedNormalFrame();
+  tick();
+}
+
+void tearDown() {
+  delete load;
+  delete fastProtection;
+  delete fan;
+  delete adc;
+  delete dac;
+}
+
+void test_no_trip_below_threshold() {
+  enableLoad();
+  for (uint8_t nr = 0; nr < 10; nr++) {
+    feedNormalFrame();
+    tick();
+  }
+
+  TEST_ASSERT_FALSE(fastProtection->isTripped());
+  TEST_ASSERT_FALSE(load->isTripped());
+  TEST_ASSERT_TRUE(powerEnabled());
+  TEST_ASSERT_GREATER_THAN(0, dacOutput());
+}
+
+void test_trip_disables_outputs_in_interrupt() {
+  enableLoad();
+  TEST_ASSERT_TRUE(powerEnabled());
+  TEST_ASSERT_GREATER_THAN(0, dacOutput());
+
+  feedOverVoltageFrame();
+
+  // outputs disabled by the interrupt, before any control loop tick
+  TEST_ASSERT_TRUE(fastProtection->isTripped());
+  TEST_ASSERT_EQUAL(FastProtection::OVER_VOLTAGE, fastProtection->getTrip());
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+  TEST_ASSERT_EQUAL_UINT64(nativeMicros.load(), fastProtection->getTripTimestampMicros());
+  TEST_ASSERT_LESS_OR_EQUAL(adc->getFramePeriodMicros(), fastProtection->getTripLatencyMicros());
+
+  // state bookkeeping in the control loop
+  TEST_ASSERT_TRUE(load->isEnabled());
+  tick();
+  TEST_ASSERT_EQUAL(Load::TRIPPED_OVER_VOLTAGE, load->getProtectState());
+  TEST_ASSERT_FALSE(load->isEnabled());
+  TEST_ASSERT_EQUAL(Load::POWER_OFF, load->getPowerState());
+  TEST_ASSERT_EQUAL_UINT32(fastProtection->getTripLatencyMicros(), load->getState().fastTripLatencyMicros);
+}
+
+void test_control_loop_writes_rejected_after_trip() {
+  // trip while the power stage is enabling, with a queued set point
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  TEST_ASSERT_EQUAL(Load::POWER_ENABLING, load->getPowerState());
+  feedOverVoltageFrame();
+
+  // the settle time elapses in the same tick as the trip is handled
+  delay(load->getPowerEnableSettleMs() + 1);
+  load->handle();
+
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+
+  // no new set points / enable until reset
+  TEST_ASSERT_FALSE(load->setCurrent(1.0));
+  TEST_ASSERT_FALSE(fastProtection->setDac(1000));
+  TEST_ASSERT_FALSE(fastProtection->enablePower());
+  tick(10);
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+
+  // reset
+  feedNormalFrame();
+  TEST_ASSERT_TRUE(load->resetProtections());
+  enableLoad();
+  TEST_ASSERT_GREATER_THAN(0, dacOutput());
+  TEST_ASSERT_TRUE(powerEnabled());
+}
+
+/** Raise the ADC interrupt (with a tripping frame) after the next GPIO register write (ex. in the middle of a DAC write) */
+void tripOnNextGpioWrite(void (*feed)()) {
+  nativeGpioWriteHook = [feed]() {
+    nativeGpioWriteHook = nullptr;
+    nativeRaiseInterrupt(feed);
+  };
+}
+
+void test_current_spike_trips_fast_protection_only() {
+  enableLoad();
+  feedCurrentSpikeFrame();
+  TEST_ASSERT_TRUE(fastProtection->isTripped());
+  TEST_ASSERT_EQUAL(FastProtection::OVER_CURRENT, fastProtection->getTrip());
+  TEST_ASSERT_TRUE(load->getMeasurement().current < OVER_CURRENT_LIMIT);
+
+  tick();
+  TEST_ASSERT_EQUAL(Load::TRIPPED_OVER_CURRENT, load->getProtectState());
+  TEST_ASSERT_TRUE(load->getMeasurement().current < OVER_CURRENT_LIMIT);
+}
+
+void test_trip_during_set_current() {
+  enableLoad();
+
+  tripOnNextGpioWrite(feedOverVoltageFrame);
+  load->setCurrent(2.5);
+  TEST_ASSERT_TRUE(fastProtection->isTripped());
+
+  // the interrupt was held off until the DAC write completed => not overwritten
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+
+  tick();
+  TEST_ASSERT_EQUAL(Load::TRIPPED_OVER_VOLTAGE, load->getProtectState());
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+}
+
+void test_trip_during_queued_set_point() {
+  TEST_ASSERT_TRUE(load->setCurrent(1.0));
+  TEST_ASSERT_EQUAL(Load::POWER_ENABLING, load->getPowerState());
+
+  // the queued set point is written once the power stage settled (the control loop does not trip on the spike)
+  delay(load->getPowerEnableSettleMs() + 1);
+  tripOnNextGpioWrite(feedCurrentSpikeFrame);
+  load->handle();
+  TEST_ASSERT_TRUE(fastProtection->isTripped());
+  TEST_ASSERT_EQUAL(Load::OK, load->getProtectState());
+
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+
+  tick();
+  TEST_ASSERT_EQUAL(Load::TRIPPED_OVER_CURRENT, load->getProtectState());
+  TEST_ASSERT_FALSE(load->isEnabled());
+  TEST_ASSERT_EQUAL_UINT16(0, dacOutput());
+  TEST_ASSERT_FALSE(powerEnabled());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_trip_below_threshold);
+  RUN_TEST(test_trip_disables_outputs_in_interrupt);
+  RUN_TEST(test_control_loop_writes_rejected_after_trip);
+  RUN_TEST(test_current_spike_trips_fast_protection_only);
+  RUN_TEST(test_trip_during_set_current);
+  RUN_TEST(test_trip_during_queued_set_point);
+  return UNITY_END();
+}
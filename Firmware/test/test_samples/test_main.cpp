@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#include <unity.h>
+#include <thread>
+#include "samples.h"
+
+/* SampleBuffer tests: ordering, overrun / drop counting, torn read rejection (producer on an "ISR" thread) */
+
+/** Push a frame with every value (and the timestamp) derived from the sequence number */
+static void pushFrame(SampleBuffer &buffer, uint32_t seq) {
+  uint16_t values[SAMPLE_MAX_CHANNELS];
+  for (uint8_t chan = 0; chan < SAMPLE_MAX_CHANNELS; chan++) {
+    values[chan] = (uint16_t) (seq + chan);
+  }
+  buffer.push(values, SAMPLE_MAX_CHANNELS, (uint64_t) seq * 244);
+}
+
+/** Check that a frame is not torn (all fields written by the same push) */
+static bool isConsistent(const SampleFrame &frame) {
+  if (frame.timestampMicros != (uint64_t) frame.seq * 244) {
+    return false;
+  }
+  for (uint8_t chan = 0; chan < SAMPLE_MAX_CHANNELS; chan++) {
+    if (frame.values[chan] != (uint16_t) (frame.seq + chan)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_read_in_order() {
+  SampleBuffer buffer;
+  SampleBuffer::Cursor cursor(buffer);
+
+  SampleFrame frame;
+  TEST_ASSERT_FALSE(cursor.read(frame));
+
+  for (uint32_t seq = 0; seq < 10; seq++) {
+    pushFrame(buffer, seq);
+  }
+  TEST_ASSERT_EQUAL_UINT32(10, cursor.available());
+
+  for (uint32_t seq = 0; seq < 10; seq++) {
+    TEST_ASSERT_TRUE(cursor.read(frame));
+    TEST_ASSERT_EQUAL_UINT32(seq, frame.seq);
+    TEST_ASSERT_TRUE(isConsistent(frame));
+  }
+  TEST_ASSERT_FALSE(cursor.read(frame));
+  TEST_ASSERT_EQUAL_UINT32(0, cursor.getDropped());
+}
+
+void test_read_not_yet_written() {
+  SampleBuffer buffer;
+  SampleFrame frame;
+
+  // fresh slots hold seq 0, but frame 0 was not written yet
+  TEST_ASSERT_FALSE(buffer.read(0, frame));
+  TEST_ASSERT_FALSE(buffer.readLatest(frame));
+
+  pushFrame(buffer, 0);
+  TEST_ASSERT_TRUE(buffer.read(0, frame));
+  TEST_ASSERT_FALSE(buffer.read(1, frame));
+  TEST_ASSERT_FALSE(buffer.read(SAMPLE_BUFFER_SIZE, frame));
+}
+
+void test_overrun_drops_oldest_frames() {
+  SampleBuffer buffer;
+  SampleBuffer::Cursor cursor(buffer);
+
+  const uint32_t total = SAMPLE_BUFFER_SIZE + 100;
+  for (uint32_t seq = 0; seq < total; seq++) {
+    pushFrame(buffer, seq);
+  }
+
+  // the overwritten frames are no longer readable
+  SampleFrame frame;
+  TEST_ASSERT_FALSE(buffer.read(0, frame));
+  TEST_ASSERT_FALSE(buffer.read(99, frame));
+  TEST_ASSERT_TRUE(buffer.read(100, frame));
+  TEST_ASSERT_TRUE(buffer.read(total - 1, frame));
+
+  // the cursor skips to the oldest frame still available and counts the skipped ones
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_BUFFER_SIZE - 1, cursor.available());
+  TEST_ASSERT_TRUE(cursor.read(frame));
+  TEST_ASSERT_EQUAL_UINT32(total - (SAMPLE_BUFFER_SIZE - 1), frame.seq);
+  TEST_ASSERT_EQUAL_UINT32(total - (SAMPLE_BUFFER_SIZE - 1), cursor.getDropped());
+
+  uint32_t nrRead = 1;
+  while (cursor.read(frame)) {
+    TEST_ASSERT_TRUE(isConsistent(frame));
+    nrRead++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(SAMPLE_BUFFER_SIZE - 1, nrRead);
+  TEST_ASSERT_EQUAL_UINT32(total, nrRead + cursor.getDropped());
+}
+
+void test_read_latest() {
+  SampleBuffer buffer;
+  SampleBuffer::Cursor cursor(buffer);
+
+  for (uint32_t seq = 0; seq < 50; seq++) {
+    pushFrame(buffer, seq);
+  }
+
+  SampleFrame frame;
+  TEST_ASSERT_TRUE(cursor.readLatest(frame));
+  TEST_ASSERT_EQUAL_UINT32(49, frame.seq);
+  TEST_ASSERT_FALSE(cursor.readLatest(frame));
+  TEST_ASSERT_EQUAL_UINT32(0, cursor.getDropped());
+}
+
+/** Consumer thread: reads until the producer finished and the buffer is drained */
+struct Consumer {
+  SampleBuffer &buffer;
+  std::atomic<bool> &done;
+  /** Time spent per frame (a slow consumer gets lapped by the producer) */
+  uint32_t delayMicros;
+
+  uint32_t nrRead = 0;
+  uint32_t nrTorn = 0;
+  uint32_t nrOutOfOrder = 0;
+  uint32_t dropped = 0;
+
+  void run(SampleBuffer::Cursor &cursor) {
+    uint32_t expected = cursor.position();
+    while (true) {
+      bool finished = this->done.load();
+
+      SampleFrame frame;
+      while (cursor.read(frame)) {
+        if (!isConsistent(frame)) {
+          this->nrTorn++;
+        }
+        if ((int32_t) (frame.seq - expected) < 0) {
+          this->nrOutOfOrder++;
+        }
+        expected = frame.seq + 1;
+        this->nrRead++;
+
+        if (this->delayMicros > 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(this->delayMicros));
+        }
+      }
+
+      if (finished) {
+        break;
+      }
+    }
+    this->dropped = cursor.getDropped();
+  }
+};
+
+void test_concurrent_producer_rejects_torn_reads() {
+  SampleBuffer buffer;
+  std::atomic<bool> done { false };
+
+  // cursors created before the producer starts (every frame is either read or dropped)
+  SampleBuffer::Cursor fastCursor(buffer);
+  SampleBuffer::Cursor slowCursor(buffer);
+  Consumer fast { buffer, done, 0 };
+  Consumer slow { buffer, done, 20 };
+  std::thread fastThread([&]() { fast.run(fastCursor); });
+  std::thread slowThread([&]() { slow.run(slowCursor); });
+
+  // producer ("ISR" thread), many laps of the buffer
+  const uint32_t total = SAMPLE_BUFFER_SIZE * 200;
+  std::thread producer([&]() {
+    for (uint32_t seq = 0; seq < total; seq++) {
+      pushFrame(buffer, seq);
+    }
+    done.store(true);
+  });
+
+  producer.join();
+  fastThread.join();
+  slowThread.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, fast.nrTorn);
+  TEST_ASSERT_EQUAL_UINT32(0, fast.nrOutOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(total, fast.nrRead + fast.dropped);
+
+  TEST_ASSERT_EQUAL_UINT32(0, slow.nrTorn);
+  TEST_ASSERT_EQUAL_UINT32(0, slow.nrOutOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(total, slow.nrRead + slow.dropped);
+  TEST_ASSERT_GREATER_THAN(0, slow.dropped);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_in_order);
+  RUN_TEST(test_read_not_yet_written);
+  RUN_TEST(test_overrun_drops_oldest_frames);
+  RUN_TEST(test_read_latest);
+  RUN_TEST(test_concurrent_producer_rejects_torn_reads);
+  return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+#include <unity.h>
+#include <string>
+#include "scpi.h"
+
+/* ScpiParser tests: chaining, relative header paths, long / short forms, input overrun, error queue */
+
+/** Command handler with a few ScpiPort-like commands */
+struct TestHandler {
+  float current = 2.0;
+  bool enabled = false;
+  uint32_t nrExecuted = 0;
+  ScpiParser *parser = NULL;
+
+  int16_t execute(const ScpiCommand &command, ScpiResponse &response) {
+    this->nrExecuted++;
+
+    if (command.matches("*IDN?")) {
+      response.add("TEST");
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("SYSTem:ERRor[:NEXT]?")) {
+      response.add((int32_t) this->parser->popError());
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("MEASure:VOLTage?")) {
+      response.add(1.5f, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("MEASure:CURRent?")) {
+      response.add(0.25f, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("[SOURce:]CURRent")) {
+      if (command.parameter.isEmpty()) {
+        return ScpiParser::MISSING_PARAMETER;
+      }
+      return command.parameter.toFloat(this->current) ? ScpiParser::NO_ERROR : ScpiParser::DATA_TYPE_ERROR;
+
+    } else if (command.matches("[SOURce:]CURRent?")) {
+      response.add(this->current, 3);
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("INPut[:STATe]")) {
+      if (command.isParameter("ON") || command.isParameter("1")) {
+        this->enabled = true;
+      } else if (command.isParameter("OFF") || command.isParameter("0")) {
+        this->enabled = false;
+      } else {
+        return ScpiParser::DATA_TYPE_ERROR;
+      }
+      return ScpiParser::NO_ERROR;
+
+    } else if (command.matches("INPut[:STATe]?")) {
+      // fails after writing a partial response (dropped by the parser)
+      response.add("partial");
+      return ScpiParser::EXECUTION_ERROR;
+    }
+
+    return ScpiParser::UNDEFINED_HEADER;
+  }
+};
+
+static ScpiParser parser;
+static TestHandler handler;
+
+/** Feed a line (with the terminator), execute it if complete. Returns the response line. */
+static std::string run(const char *line) {
+  std::string response;
+  for (const char *p = line; *p != '\0'; p++) {
+    if (parser.feed(*p)) {
+      parser.execute(handler);
+      response.append(parser.getResponse().data(), parser.getResponse().length());
+    }
+  }
+  return response;
+}
+
+void setUp() {
+  parser = ScpiParser();
+  handler = TestHandler();
+  handler.parser = &parser;
+}
+
+void tearDown() {
+}
+
+void test_single_query() {
+  TEST_ASSERT_EQUAL_STRING("TEST\n", run("*IDN?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("1.500\n", run("MEAS:VOLT?\r\n").c_str());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+}
+
+void test_chained_commands() {
+  TEST_ASSERT_EQUAL_STRING("1.500;TEST;3.250\n", run("CURR 3.25;:MEAS:VOLT?;*IDN?;:CURR?\n").c_str());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 3.25, handler.current);
+  TEST_ASSERT_EQUAL_UINT32(4, handler.nrExecuted);
+
+  // setting only: no response line, empty commands ignored
+  TEST_ASSERT_EQUAL_STRING("", run("CURR 1;;INP ON;\n").c_str());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, handler.current);
+  TEST_ASSERT_TRUE(handler.enabled);
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+}
+
+void test_relative_header_path() {
+  // "CURR?" inherits "MEAS:" from the previous command
+  TEST_ASSERT_EQUAL_STRING("1.500;0.250\n", run("MEAS:VOLT?;CURR?\n").c_str());
+
+  // a leading ':' restarts from the root
+  TEST_ASSERT_EQUAL_STRING("1.500;2.000\n", run("MEAS:VOLT?;:CURR?\n").c_str());
+
+  // common commands do not change the path
+  TEST_ASSERT_EQUAL_STRING("1.500;TEST;0.250\n", run("MEAS:VOLT?;*IDN?;CURR?\n").c_str());
+
+  // the path is reset on each line
+  TEST_ASSERT_EQUAL_STRING("1.500\n", run("MEAS:VOLT?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("2.000\n", run("CURR?\n").c_str());
+
+  // inherited path without a match
+  TEST_ASSERT_EQUAL_STRING("", run("INP ON;VOLT?\n").c_str());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::UNDEFINED_HEADER, parser.popError());
+}
+
+void test_long_and_short_forms() {
+  TEST_ASSERT_EQUAL_STRING("1.500\n", run("MEASURE:VOLTAGE?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("1.500\n", run("meas:volt?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("1.500\n", run("Measure:Volt?\n").c_str());
+
+  // optional nodes
+  run("SOUR:CURR 4\n");
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 4.0, handler.current);
+  run("SOURCE:CURRENT 5\n");
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 5.0, handler.current);
+  run("INPUT:STATE ON\n");
+  TEST_ASSERT_TRUE(handler.enabled);
+  run("INP off\n");
+  TEST_ASSERT_FALSE(handler.enabled);
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+
+  // neither the short nor the long form
+  TEST_ASSERT_EQUAL_STRING("", run("MEASU:VOLT?\n").c_str());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::UNDEFINED_HEADER, parser.popError());
+
+  // setting without a parameter, query with a parameter
+  run("CURR\n");
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::MISSING_PARAMETER, parser.popError());
+  run("INP MAYBE\n");
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::DATA_TYPE_ERROR, parser.popError());
+}
+
+void test_syntax_error_drops_rest_of_line() {
+  TEST_ASSERT_EQUAL_STRING("", run("CURR 1;MEAS:VO$T?;CURR 2\n").c_str());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1.0, handler.current);
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::SYNTAX_ERROR, parser.popError());
+
+  // too many nodes
+  run("A:B:C:D:E\n");
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::UNDEFINED_HEADER, parser.popError());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+}
+
+void test_input_buffer_overrun() {
+  std::string line = "CURR 7;";
+  while (line.length() <= SCPI_MAX_LINE_LENGTH) {
+    line += "*IDN?;";
+  }
+  line += "\n";
+
+  // dropped as a whole
+  TEST_ASSERT_EQUAL_STRING("", run(line.c_str()).c_str());
+  TEST_ASSERT_EQUAL_UINT32(0, handler.nrExecuted);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 2.0, handler.current);
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::INPUT_BUFFER_OVERRUN, parser.popError());
+
+  // the next line is parsed from the start
+  TEST_ASSERT_EQUAL_STRING("TEST\n", run("*IDN?\n").c_str());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+}
+
+void test_error_queue() {
+  // failed query: its partial response is dropped, the rest of the line is executed
+  TEST_ASSERT_EQUAL_STRING("TEST;1.500\n", run("*IDN?;INP?;MEAS:VOLT?\n").c_str());
+
+  run("FOO\n");
+  run("CURR X\n");
+
+  // oldest first, through SYSTem:ERRor?
+  TEST_ASSERT_EQUAL_STRING("-200\n", run("SYST:ERR?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("-113\n", run("SYSTEM:ERROR:NEXT?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("-104\n", run("SYST:ERR?\n").c_str());
+  TEST_ASSERT_EQUAL_STRING("0\n", run("SYST:ERR?\n").c_str());
+
+  // overflow: the last entry is replaced
+  for (uint8_t idx = 0; idx < SCPI_ERROR_QUEUE_SIZE + 3; idx++) {
+    run("FOO\n");
+  }
+  for (uint8_t idx = 0; idx < SCPI_ERROR_QUEUE_SIZE - 1; idx++) {
+    TEST_ASSERT_EQUAL_INT16(ScpiParser::UNDEFINED_HEADER, parser.popError());
+  }
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::QUEUE_OVERFLOW, parser.popError());
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+
+  // clear
+  run("FOO\n");
+  parser.clearErrors();
+  TEST_ASSERT_EQUAL_INT16(ScpiParser::NO_ERROR, parser.popError());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_single_query);
+  RUN_TEST(test_chained_commands);
+  RUN_TEST(test_relative_header_path);
+  RUN_TEST(test_long_and_short_forms);
+  RUN_TEST(test_syntax_error_drops_rest_of_line);
+  RUN_TEST(test_input_buffer_overrun);
+  RUN_TEST(test_error_queue);
+  return UNITY_END();
+}
\ No newline at end of file
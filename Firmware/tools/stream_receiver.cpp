@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2025 by Attila Tőkés.
+ *
+ * Licence: MIT
+ */
+
+/*
+ * Raw sample stream receiver (Linux).
+ *
+ * Reads the raw ADC sample stream from the sample stream USB CDC port (src/stream.h),
+ * writes the records to a file, and reports the throughput and the dropped frames
+ * once per second.
+ *
+ * Build:  g++ -O2 -std=c++17 -o stream_receiver stream_receiver.cpp
+ * Usage:  stream_receiver <port> <output file> [seconds]
+ *
+ * The output file is the sequence of the 24 byte records, as received (little endian):
+ *   uint32_t seq, uint64_t timestampMicros, uint16_t values[6]
+ */
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/** Packet format (see src/stream.h) */
+const uint32_t STREAM_MAGIC = 0x4D525453; // "STRM"
+const uint16_t STREAM_VERSION = 1;
+
+struct __attribute__((packed)) Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t packetSeq;
+  uint32_t dropped;
+  uint16_t nrRecords;
+  uint16_t reserved;
+};
+
+struct __attribute__((packed)) Record {
+  uint32_t seq;
+  uint64_t timestampMicros;
+  uint16_t values[6];
+};
+
+static volatile sig_atomic_t stopRequest = 0;
+
+static void onSignal(int) {
+  stopRequest = 1;
+}
+
+static double nowSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Open the CDC port in raw mode, with DTR set (starts the stream) */
+static int openPort(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  termios tty;
+  if (tcgetattr(fd, &tty) != 0) {
+    fprintf(stderr, "Failed to get the port attributes: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  // raw mode, reads return after 100ms at the latest
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 1;
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    fprintf(stderr, "Failed to set the port attributes: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  int dtr = TIOCM_DTR;
+  ioctl(fd, TIOCMBIS, &dtr);
+
+  // old data (from a previous session)
+  tcflush(fd, TCIFLUSH);
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  if ((argc < 3) || (argc > 4)) {
+    fprintf(stderr, "Usage: %s <port> <output file> [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  double duration = argc == 4 ? atof(argv[3]) : 0.0;
+
+  int fd = openPort(argv[1]);
+  if (fd < 0) {
+    return 1;
+  }
+
+  FILE *output = fopen(argv[2], "wb");
+  if (output == NULL) {
+    fprintf(stderr, "Failed to create %s: %s\n", argv[2], strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  // receive buffer (packets are parsed in place, the incomplete rest is moved to the front)
+  static uint8_t buffer[65536];
+  size_t len = 0;
+
+  bool first = true;
+  uint32_t nextSeq = 0;
+  uint32_t nextPacketSeq = 0;
+  uint32_t deviceDropped = 0;
+
+  uint64_t totalFrames = 0;
+  uint64_t totalLost = 0;
+  uint64_t totalBytes = 0;
+  uint64_t resyncBytes = 0;
+  uint64_t intervalFrames = 0;
+  uint64_t intervalBytes = 0;
+
+  double startTime = nowSeconds();
+  double reportTime = startTime;
+
+  while (!stopRequest) {
+    ssize_t received = read(fd, buffer + len, sizeof(buffer) - len);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Read failed: %s\n", strerror(errno));
+      break;
+    }
+    len += received;
+    totalBytes += received;
+    intervalBytes += received;
+
+    size_t idx = 0;
+    while (len - idx >= sizeof(Header)) {
+      Header header;
+      memcpy(&header, buffer + idx, sizeof(header));
+      if ((header.magic != STREAM_MAGIC) || (header.version != STREAM_VERSION) || (header.recordSize != sizeof(Record))) {
+        // not at a packet boundary => resync
+        idx++;
+        resyncBytes++;
+        continue;
+      }
+
+      size_t packetLen = sizeof(Header) + (size_t) header.nrRecords * sizeof(Record);
+      if (len - idx < packetLen) {
+        break;
+      }
+
+      if (!first && (header.packetSeq != nextPacketSeq)) {
+        fprintf(stderr, "Packet sequence gap: expected %u, got %u\n", nextPacketSeq, header.packetSeq);
+      }
+      nextPacketSeq = header.packetSeq + 1;
+      deviceDropped = header.dropped;
+
+      for (uint16_t nr = 0; nr < header.nrRecords; nr++) {
+        Record record;
+        memcpy(&record, buffer + idx + sizeof(Header) + nr * sizeof(Record), sizeof(record));
+        if (!first && (record.seq != nextSeq)) {
+          // lost frames (dropped by the device, or a broken packet)
+          totalLost += (uint32_t) (record.seq - nextSeq);
+        }
+        first = false;
+        nextSeq = record.seq + 1;
+      }
+
+      fwrite(buffer + idx + sizeof(Header), sizeof(Record), header.nrRecords, output);
+      totalFrames += header.nrRecords;
+      intervalFrames += header.nrRecords;
+      idx += packetLen;
+    }
+
+    memmove(buffer, buffer + idx, len - idx);
+    len -= idx;
+
+    double now = nowSeconds();
+    if (now - reportTime >= 1.0) {
+      double interval = now - reportTime;
+      printf("%8.1f frames/s  %7.1f kB/s  frames: %llu  lost: %llu  dropped (device): %u  resync: %llu bytes\n",
+          intervalFrames / interval, intervalBytes / interval / 1000.0, (unsigned long long) totalFrames,
+          (unsigned long long) totalLost, deviceDropped, (unsigned long long) resyncBytes);
+      fflush(stdout);
+
+      intervalFrames = 0;
+      intervalBytes = 0;
+      reportTime = now;
+    }
+
+    if ((duration > 0.0) && (now - startTime >= duration)) {
+      break;
+    }
+  }
+
+  double elapsed = nowSeconds() - startTime;
+  printf("Received %llu frames (%llu bytes) in %.1fs: %.1f frames/s, %.1f kB/s, lost %llu frames\n",
+      (unsigned long long) totalFrames, (unsigned long long) totalBytes, elapsed,
+      totalFrames / elapsed, totalBytes / elapsed / 1000.0, (unsigned long long) totalLost);
+
+  fclose(output);
+  close(fd);
+  return 0;
+}
\ No newline at end of file